@@ -8,6 +8,8 @@ LOCAL_CFLAGS     += -DWILDMIDI_BUILD
 LOCAL_CFLAGS     += -fvisibility=hidden -DSYM_VISIBILITY
 
 LOCAL_SRC_FILES := \
+	src/bank.c \
+	src/convert.c \
 	src/f_hmi.c \
 	src/f_hmp.c \
 	src/f_midi.c \
@@ -19,8 +21,10 @@ LOCAL_SRC_FILES := \
 	src/lock.c \
 	src/mus2mid.c \
 	src/patches.c \
+	src/resample.c \
 	src/reverb.c \
 	src/sample.c \
+	src/threadpool.c \
 	src/wildmidi_lib.c \
 	src/wm_error.c \
 	src/xmi2mid.c
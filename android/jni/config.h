@@ -61,5 +61,8 @@
 /* Define if you have the <inttypes.h> header file. */
 #define HAVE_INTTYPES_H
 
+/* Define if you have the <sys/mman.h> header file and mmap. */
+#define HAVE_SYS_MMAN_H
+
 /* Define our audio drivers */
 
@@ -0,0 +1,49 @@
+/*
+ * bank.h -- Midi Wavetable Processing library
+ *
+ * Copyright (C) WildMIDI Developers 2001-2024
+ *
+ * This file is part of WildMIDI.
+ *
+ * WildMIDI is free software: you can redistribute and/or modify the player
+ * under the terms of the GNU General Public License and you can redistribute
+ * and/or modify the library under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either version 3 of
+ * the licenses, or(at your option) any later version.
+ *
+ * WildMIDI is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License and
+ * the GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License and the
+ * GNU Lesser General Public License along with WildMIDI.  If not,  see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __BANK_H
+#define __BANK_H
+
+/*
+ * A bank holds every patch of a context as _WM_load_sample leaves it, so
+ * that loading one costs no more than pointing its samples into the
+ * mapped bank. It only applies to contexts with the same sample rate and
+ * amp and release settings, patches whose config line changed since are
+ * loaded from their .pat file again.
+ */
+
+struct _patch;
+struct _sample;
+struct _WM_Context;
+
+/* builds a bank of ctx's patches in a malloc'd buffer */
+extern int _WM_make_bank(struct _WM_Context *ctx, uint8_t **bank, uint32_t *size);
+
+/* maps filename and sets it as ctx's bank, checking all of it first */
+extern int _WM_load_bank(struct _WM_Context *ctx, const char *filename);
+extern void _WM_free_bank(struct _WM_Context *ctx);
+
+/* patch's samples from ctx's bank, NULL if it has none for it */
+extern struct _sample *_WM_get_bank_samples(struct _WM_Context *ctx, struct _patch *patch);
+
+#endif /* __BANK_H */
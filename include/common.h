@@ -31,15 +31,49 @@
 #endif
 #define MEM_CHUNK 8192
 
-extern int16_t _WM_MasterVolume;
-extern uint16_t _WM_SampleRate;
-extern uint16_t _WM_MixerOptions;
+struct _patch;
+struct _WM_Bank;
+struct _hndl;
 
-extern float _WM_reverb_room_width;  /* = 16.875f; */
-extern float _WM_reverb_room_length; /* = 22.5f;   */
+/*
+ * Settings and patches shared by every midi opened in it. WildMidi_Init
+ * sets up the default context, WildMidi_CreateContext any number of
+ * others which may use different rates and configs.
+ */
+struct _WM_Context {
+    uint16_t sample_rate;
+    uint16_t mixer_options;
+    int16_t master_volume;
+
+    struct _patch *patch[128];
+    int patch_lock;
+    uint32_t patch_loads; /* posted to the pool and not yet done */
+
+    /* loaded patches no midi uses, least recently used first */
+    struct _patch *lru_first;
+    struct _patch *lru_last;
+    uint64_t cache_budget;
+    uint64_t cache_resident;
+    uint64_t cache_hits;
+    uint64_t cache_misses;
+    uint64_t cache_evictions;
+
+    struct _WM_Bank *bank; /* from WildMidi_LoadBank, NULL if none */
+
+    int fix_release;
+    int auto_amp;
+    int auto_amp_with_amp;
+
+    float reverb_room_width;  /* = 16.875f; */
+    float reverb_room_length; /* = 22.5f;   */
+
+    float reverb_listen_posx; /* = 8.4375f; */
+    float reverb_listen_posy; /* = 16.875f; */
+    uint8_t reverb_engine;    /* = WM_RE_ROOM; */
 
-extern float _WM_reverb_listen_posx; /* = 8.4375f; */
-extern float _WM_reverb_listen_posy; /* = 16.875f; */
+    int handle_lock;
+    struct _hndl *first_handle;
+};
 
 extern void _cvt_reset_options (void);
 extern uint16_t _cvt_get_option (uint16_t tag);
@@ -49,6 +49,18 @@
 #define __builtin_expect(x,c) x
 #endif
 
+/* define this to build without the SIMD mixing code */
+#cmakedefine WM_NO_SIMD 1
+
+/* define this to render batches without a pool of threads */
+#cmakedefine WM_NO_THREADS 1
+
+/* define this to abort on allocations in the real-time render path */
+#cmakedefine WM_RTCHECK 1
+
+/* Define if you have the <pthread.h> header file and pthreads work. */
+#cmakedefine HAVE_PTHREAD_H
+
 /* define this if you are running a bigendian system (motorola, sparc, etc) */
 #cmakedefine WORDS_BIGENDIAN 1
 
@@ -61,6 +73,9 @@
 /* Define if you have the <inttypes.h> header file. */
 #cmakedefine HAVE_INTTYPES_H
 
+/* Define if you have the <sys/mman.h> header file and mmap. */
+#cmakedefine HAVE_SYS_MMAN_H
+
 /* Define our audio drivers */
 #cmakedefine AUDIODRV_ALSA
 #cmakedefine AUDIODRV_OSS
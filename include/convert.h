@@ -0,0 +1,50 @@
+/*
+ * convert.h -- Midi Wavetable Processing library
+ *
+ * Copyright (C) WildMIDI Developers 2001-2024
+ *
+ * This file is part of WildMIDI.
+ *
+ * WildMIDI is free software: you can redistribute and/or modify the player
+ * under the terms of the GNU General Public License and you can redistribute
+ * and/or modify the library under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either version 3 of
+ * the licenses, or(at your option) any later version.
+ *
+ * WildMIDI is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License and
+ * the GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License and the
+ * GNU Lesser General Public License along with WildMIDI.  If not,  see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __CONVERT_H
+#define __CONVERT_H
+
+/*
+ * A converter turns count samples of the int32 mix, which is at 16bit
+ * scale, into one of the WM_OF_* formats in native byte order. Integer
+ * formats saturate rather than wrap. out needs no particular alignment.
+ */
+typedef void (*_WM_Convert)(const int32_t *in, int8_t *out, uint32_t count);
+
+/* the converter for a WM_OF_* format, NULL if there is no such format */
+extern _WM_Convert _WM_get_converter(uint8_t format);
+
+/* bytes per sample of a WM_OF_* format, 0 if there is no such format */
+extern uint32_t _WM_sample_size(uint8_t format);
+
+extern void _WM_init_convert(void);
+
+/*
+ * Every converter for a WM_OF_* format the cpu can run, the C version
+ * first, for the tests. names gets what each was built for. Returns how
+ * many there are, never more than WM_CONVERT_KERNELS.
+ */
+#define WM_CONVERT_KERNELS 2
+extern uint32_t _WM_convert_all(uint8_t format, _WM_Convert *converts, const char **names);
+
+#endif /* __CONVERT_H */
@@ -24,6 +24,8 @@
 #ifndef __HMP_H
 #define __HMP_H
 
-extern struct _mdi *_WM_ParseNewHmp(const uint8_t *hmp_data, uint32_t hmp_size);
+struct _WM_Context;
+
+extern struct _mdi *_WM_ParseNewHmp(struct _WM_Context *ctx, const uint8_t *hmp_data, uint32_t hmp_size);
 
 #endif /* __HMP_H */
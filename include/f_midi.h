@@ -24,7 +24,9 @@
 #ifndef __MIDI_H
 #define __MIDI_H
 
-extern struct _mdi *_WM_ParseNewMidi(const uint8_t *midi_data, uint32_t midi_size);
+struct _WM_Context;
+
+extern struct _mdi *_WM_ParseNewMidi(struct _WM_Context *ctx, const uint8_t *midi_data, uint32_t midi_size);
 extern int _WM_Event2Midi(struct _mdi *mdi, uint8_t **out, uint32_t *outsize);
 
 #endif /* __MIDI_H */
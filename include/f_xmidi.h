@@ -24,6 +24,8 @@
 #ifndef __XMI_H
 #define __XMI_H
 
-extern struct _mdi *_WM_ParseNewXmi(const uint8_t *xmi_data, uint32_t xmi_size);
+struct _WM_Context;
+
+extern struct _mdi *_WM_ParseNewXmi(struct _WM_Context *ctx, const uint8_t *xmi_data, uint32_t xmi_size);
 
 #endif /* __XMI_H */
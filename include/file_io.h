@@ -31,4 +31,31 @@ extern void  _WM_FreeBufferFileImpl(void*);
 extern void * (*_WM_BufferFile)(const char *, uint32_t *);
 extern void   (*_WM_FreeBufferFile)(void*);
 
+/*
+ * A VIO that maps files copy on write rather than reading them, falling
+ * back to _WM_BufferFileImpl for files it can't map.
+ */
+extern void *_WM_MapBufferFile(const char *filename, uint32_t *size);
+extern void  _WM_UnmapBufferFile(void *data);
+
+/*
+ * A whole file mapped read only, or read in through _WM_BufferFile where
+ * it can't be mapped or the caller set a VIO of its own. Anything pointing
+ * into data holds a reference, the last _WM_UnrefMap unmaps it. next is
+ * only used by _WM_MapBufferFile.
+ */
+struct _WM_Map {
+    uint8_t *data;
+    uint32_t size;
+    int mapped;
+    int lock;
+    uint32_t refs;
+    struct _WM_Map *next;
+};
+
+/* returns the map holding one reference, NULL with the error set if not */
+extern struct _WM_Map *_WM_MapFile(const char *filename);
+extern void _WM_RefMap(struct _WM_Map *map);
+extern void _WM_UnrefMap(struct _WM_Map *map);
+
 #endif /* __FILE_IO_H */
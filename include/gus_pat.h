@@ -69,7 +69,7 @@ static float env_time_table[] = {
 };
 #endif /* !_WILDMIDI_LIB_C */
 
-extern struct _sample * _WM_load_gus_pat (const char *filename, int _fix_release);
+extern struct _sample * _WM_load_gus_pat (const char *filename, int _fix_release, uint16_t rate);
 
 #endif /* __GUS_PAT_H */
 
@@ -24,6 +24,16 @@
 #ifndef __INTERNAL_MIDI_H
 #define __INTERNAL_MIDI_H
 
+/*
+ * A dense array of playing notes. Notes are appended on note on and taken
+ * out by moving the last note into their slot, so the order is not kept.
+ */
+struct _voices {
+    struct _note **note;
+    uint32_t count;
+    uint32_t size;
+};
+
 struct _channel {
     uint8_t bank;
     struct _patch *patch;
@@ -41,6 +51,7 @@ struct _channel {
     uint16_t reg_data;
     uint8_t reg_non;
     uint8_t isdrum;
+    struct _voices voices;
 };
 
 struct _event_data {
@@ -51,27 +62,57 @@ struct _event_data {
     } data;
 };
 
+/*
+ * Everything the mixer reads or writes for every frame comes first so that
+ * it shares a cache line, notes are handed out 64 byte aligned by the note
+ * pool.
+ */
 struct _note {
-    uint16_t noteid;
-    uint8_t velocity;
-    struct _patch *patch;
-    struct _sample *sample;
+    /* mixer state */
     uint32_t sample_pos;
     uint32_t sample_inc;
+    int32_t env_level;
     int32_t env_inc;
+    uint32_t left_mix_volume;
+    uint32_t right_mix_volume;
+    /* the two averaged, for mixing to mono */
+    uint32_t mono_mix_volume;
+    /* the same without the fixed point, for the float mix */
+    float left_gain;
+    float right_gain;
+    float mono_gain;
+    struct _sample *sample;
     uint8_t env;
-    int32_t env_level;
     uint8_t modes;
+
+    /* only looked at by midi events and when the note changes stage */
+    uint8_t velocity;
     uint8_t hold;
     uint8_t active;
-    struct _note *replay;
-    struct _note *next;
-    uint32_t left_mix_volume;
-    uint32_t right_mix_volume;
     uint8_t is_off;
     uint8_t ignore_chan_events;
+    uint8_t finished;   /* set while mixing in parts, see WM_MixParts */
+    uint8_t stolen;     /* fading out to make room for another note */
+    /*
+     * A key plays at most two notes at a time, the one sounding and the
+     * one to take over from it, and they take turns as note 0 and note 1.
+     * Only note 0 can hold back a note on, even after it has finished and
+     * note 1 plays, so note 1 keeps whether it still would.
+     */
+    uint8_t turn;
+    uint8_t turn0_blocks;
+    uint16_t noteid;
+    uint16_t voice_idx; /* slot in mdi->voices */
+    uint16_t chan_idx;  /* slot in the channel's voices */
+    struct _patch *patch;
+    struct _note *replay; /* also links the free notes in the pool */
+    uint32_t started;   /* mdi->note_ons when it started, the lower the older */
 };
 
+/* values of _note.finished */
+#define NOTE_ENDED      1
+#define NOTE_REPLACED   2
+
 struct _mdi;
 
 enum _event_type {
@@ -132,7 +173,9 @@ struct _event {
 
 struct _mdi {
     int lock;
+    struct _WM_Context *ctx;
     uint32_t samples_to_mix;
+    struct _voices voices;
     struct _event *events;
     struct _event *current_event;
     uint32_t event_count;
@@ -141,8 +184,19 @@ struct _mdi {
     struct _WM_Info *tmp_info;
     uint16_t midi_master_vol;
     struct _channel channel[16];
-    struct _note *note;
-    struct _note note_table[2][16][128];
+
+    /* notes are allocated in blocks as needed and never move */
+    struct _note *free_notes;
+    void **note_blocks;
+    uint32_t note_block_count;
+    uint32_t note_ons;
+
+    /*
+     most voices played at once, 0 for no limit, beyond which voices are
+     stolen. Stolen voices fade out on top of those, up to as many again.
+     */
+    uint16_t max_voices;
+    uint16_t stolen_voices;
 
     struct _patch **patches;
     uint32_t patch_count;
@@ -150,6 +204,20 @@ struct _mdi {
 
     int32_t *mix_buffer;
     uint32_t mix_buffer_size;
+    /* set by WildMidi_Prime, the mix buffers then never grow while rendering */
+    uint32_t primed_frames;
+
+    /* voice count from which the mix is split over the thread pool, 0 never */
+    uint16_t parallel_voices;
+    int32_t *part_buffer;
+    uint32_t part_buffer_size;
+
+    uint8_t resampler;
+    uint8_t gauss_order;
+    /* WM_OF_* */
+    uint8_t output_format;
+    /* 2, or 1 to mix and output mono */
+    uint8_t channels;
 
     struct _rvb *reverb;
 
@@ -238,7 +306,7 @@ extern int _WM_midi_setup_divisions(struct _mdi *mdi, uint32_t divisions);
  * All other declarations
  */
 
-extern struct _mdi * _WM_initMDI(void);
+extern struct _mdi * _WM_initMDI(struct _WM_Context *ctx);
 extern void _WM_freeMDI(struct _mdi *mdi);
 extern uint32_t _WM_SetupMidiEvent(struct _mdi *mdi, const uint8_t *event_data, uint32_t inlen, uint8_t running_event);
 extern void _WM_ResetToStart(struct _mdi *mdi);
@@ -246,7 +314,11 @@ extern void _WM_do_pan_adjust(struct _mdi *mdi, uint8_t ch);
 extern void _WM_do_note_off_extra(struct _note *nte);
 /* extern void _WM_DynamicVolumeAdjust(struct _mdi *mdi, int32_t *tmp_buffer, uint32_t buffer_used);*/
 extern void _WM_AdjustChannelVolumes(struct _mdi *mdi, uint8_t ch);
-extern float _WM_GetSamplesPerTick(uint32_t divisions, uint32_t tempo);
+extern void _WM_RemoveVoice(struct _mdi *mdi, struct _note *nte);
+extern void _WM_ReplaceVoice(struct _mdi *mdi, struct _note *nte);
+extern void _WM_ClearVoices(struct _mdi *mdi);
+extern int _WM_ReserveVoices(struct _mdi *mdi);
+extern float _WM_GetSamplesPerTick(uint32_t divisions, uint32_t tempo, uint16_t rate);
 
 #endif /* __INTERNAL_MIDI_H */
 
@@ -26,11 +26,39 @@
 #define __LOCK_H
 
 extern void _WM_Lock (int * wmlock);
+extern int _WM_TryLock (int * wmlock);
 extern void _WM_Unlock (int *wmlock);
+/* for waiting on something other than a lock, tries counts up from 0 */
+extern void _WM_Backoff (uint32_t tries);
 
 #if defined WM_NO_LOCK
 #define _WM_Lock(p) do {} while (0)
+#define _WM_TryLock(p) (0)
 #define _WM_Unlock(p) do {} while (0)
+#define _WM_Backoff(t) do {} while (0)
+#endif
+
+/*
+ * For pointers that are read without taking a lock: _WM_StoreRelease
+ * publishes a fully set up structure, _WM_LoadAcquire is then guaranteed
+ * to see all of it. On MSVC volatile accesses already behave this way.
+ * The 8 versions are the same for single byte flags.
+ */
+#if defined(__clang__) || (defined(__GNUC__) && ((__GNUC__ > 4) || (__GNUC__ == 4 && __GNUC_MINOR__ >= 7)))
+#define _WM_LoadAcquire(p) __atomic_load_n(&(p), __ATOMIC_ACQUIRE)
+#define _WM_StoreRelease(p, v) __atomic_store_n(&(p), (v), __ATOMIC_RELEASE)
+#define _WM_LoadAcquire8(p) __atomic_load_n(&(p), __ATOMIC_ACQUIRE)
+#define _WM_StoreRelease8(p, v) __atomic_store_n(&(p), (v), __ATOMIC_RELEASE)
+#elif defined(_MSC_VER)
+#define _WM_LoadAcquire(p) (*(void * volatile *)&(p))
+#define _WM_StoreRelease(p, v) (*(void * volatile *)&(p) = (v))
+#define _WM_LoadAcquire8(p) (*(volatile uint8_t *)&(p))
+#define _WM_StoreRelease8(p, v) (*(volatile uint8_t *)&(p) = (v))
+#else
+#define _WM_LoadAcquire(p) (p)
+#define _WM_StoreRelease(p, v) ((p) = (v))
+#define _WM_LoadAcquire8(p) (p)
+#define _WM_StoreRelease8(p, v) ((p) = (v))
 #endif
 
 #endif /* __LOCK_H */
@@ -32,10 +32,21 @@ struct _env {
 
 struct _sample;
 struct _mdi;
+struct _WM_Context;
+
+/*
+ * patch->loaded, only changed with the context's patch_lock held. The
+ * stores are releases so that a note on can check it without the lock.
+ */
+#define WM_PATCH_UNLOADED 0
+#define WM_PATCH_LOADED   1 /* or failed to, first_sample is NULL then */
+#define WM_PATCH_QUEUED   2
+#define WM_PATCH_LOADING  3
 
 struct _patch {
     uint16_t patchid;
     uint8_t loaded;
+    int load_lock; /* held while loading */
     char *filename;
     int16_t amp;
     uint8_t keep;
@@ -43,15 +54,20 @@ struct _patch {
     struct _env env[6];
     uint8_t  note;
     uint32_t inuse_count;
+    uint32_t bytes; /* taken up by the samples while loaded */
     struct _sample *first_sample;
+    struct _patch *lru_prev;
+    struct _patch *lru_next;
     struct _patch *next;
 };
 
-extern struct _patch *_WM_patch[128];
-
-extern int _WM_patch_lock;
-
 extern struct _patch *_WM_get_patch_data(struct _mdi *mdi, uint16_t patchid);
 extern void _WM_load_patch(struct _mdi *mdi, uint16_t patchid);
+extern void _WM_load_patches(struct _mdi *mdi);
+extern void _WM_wait_patch(struct _WM_Context *ctx, struct _patch *patch);
+extern void _WM_wait_patches(struct _mdi *mdi);
+extern void _WM_wait_patch_loads(struct _WM_Context *ctx);
+extern void _WM_release_patches(struct _mdi *mdi);
+extern void _WM_trim_patches(struct _WM_Context *ctx);
 
 #endif /* __PATCHES_H */
@@ -0,0 +1,92 @@
+/*
+ * resample.h -- Midi Wavetable Processing library
+ *
+ * Copyright (C) WildMIDI Developers 2001-2024
+ *
+ * This file is part of WildMIDI.
+ *
+ * WildMIDI is free software: you can redistribute and/or modify the player
+ * under the terms of the GNU General Public License and you can redistribute
+ * and/or modify the library under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either version 3 of
+ * the licenses, or(at your option) any later version.
+ *
+ * WildMIDI is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License and
+ * the GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License and the
+ * GNU Lesser General Public License along with WildMIDI.  If not,  see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __RESAMPLE_H
+#define __RESAMPLE_H
+
+/* sample positions are fixed point with FPBITS of fraction */
+#define FPBITS 10
+#define FPMASK ((1L<<FPBITS)-1L)
+
+struct _note;
+
+/*
+ * The mix buses a resampler can write to. Either holds interleaved
+ * left/right frames of 4 byte samples, or just one sample per frame with
+ * WM_BUS_MONO added, so the code driving the resamplers can step through
+ * any of them the same way by WM_BUS_FRAME.
+ */
+#define WM_BUS_INT 0    /* int32 at 16bit scale */
+#define WM_BUS_FLOAT 1  /* float, -1.0 to 1.0 */
+#define WM_BUS_MONO 2   /* added to either, the notes mixed to one channel */
+#define WM_BUS_COUNT 4
+
+#define WM_BUS_CHANNELS(bus) (((bus) & WM_BUS_MONO) ? 1 : 2)
+#define WM_BUS_FRAME(bus) (WM_BUS_CHANNELS(bus) * 4)  /* bytes per frame */
+
+/*
+ * A resampler mixes count frames of a single note into buffer, a mix bus
+ * of the kind it was picked for, and moves the note's sample position
+ * and envelope level on by count steps.
+ *
+ * The caller guarantees that no loop wrap, sample end or envelope stage
+ * change happens before the last of those frames, so resamplers never need
+ * to check for any of them.
+ */
+typedef void (*_WM_Resample)(struct _note *nte, void *buffer, uint32_t count);
+
+/* the plain C linear interpolation, which all other versions must match */
+extern void _WM_resample_linear_c(struct _note *nte, void *buffer, uint32_t count);
+extern void _WM_resample_linear_mono_c(struct _note *nte, void *buffer, uint32_t count);
+
+/*
+ * The same for the float bus. Float versions may differ from it by
+ * rounding, where they use fused multiply-adds for instance.
+ */
+extern void _WM_resample_linear_float_c(struct _note *nte, void *buffer, uint32_t count);
+extern void _WM_resample_linear_float_mono_c(struct _note *nte, void *buffer, uint32_t count);
+
+/* 34 is as high as we can go before errors crop up */
+#define MAX_GAUSS_ORDER 34
+
+/*
+ * The resampler for one of the WM_RS_* modes writing to a WM_BUS_* mix
+ * bus, building any table it needs on first use. gauss_order (8, 16 or
+ * 34) is only used by WM_RS_GAUSS. Returns NULL if the order is not
+ * supported or a table can't be built.
+ */
+extern _WM_Resample _WM_get_resampler(uint8_t mode, uint8_t gauss_order, uint8_t bus);
+extern void _WM_free_resample(void);
+
+extern void _WM_init_resample(void);
+
+/*
+ * Every linear interpolation for the WM_BUS_* bus the cpu can run, the C
+ * version first, so the tests can hold the others against it. names gets
+ * what each was built for. Returns how many there are, never more than
+ * WM_RESAMPLE_KERNELS.
+ */
+#define WM_RESAMPLE_KERNELS 4
+extern uint32_t _WM_resample_linear_all(uint8_t bus, _WM_Resample *kernels, const char **names);
+
+#endif /* __RESAMPLE_H */
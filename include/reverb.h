@@ -25,31 +25,67 @@
 #ifndef __REVERB_H
 #define __REVERB_H
 
+/* 8 reflection points times 6 bands */
+#define RVB_FILTERS 48
+
 struct _rvb {
-    /* filter data */
-    int32_t l_buf_flt_in[8][6][2];
-    int32_t l_buf_flt_out[8][6][2];
-    int32_t r_buf_flt_in[8][6][2];
-    int32_t r_buf_flt_out[8][6][2];
-    int32_t coeff[8][6][5];
-    /* buffer data */
+    /* WM_RE_ROOM, or WM_RE_FDN which only uses pos, quiet and the fdn fields */
+    uint8_t engine;
+    /*
+     filter data, filter n is band n / 8 of reflection point n % 8 so that
+     the reflection points of a band sit next to each other in memory.
+     coeff holds b0, b1, b2, a1 and a2 of every filter.
+     */
+    int32_t coeff[5][RVB_FILTERS];
+    /* all filters of a side are fed the same input, so they share x[n-1] and x[n-2] */
+    int32_t l_buf_flt_in[2];
+    int32_t r_buf_flt_in[2];
+    /* y[n-1] and y[n-2] of every filter */
+    int32_t l_buf_flt_out[2][RVB_FILTERS];
+    int32_t r_buf_flt_out[2][RVB_FILTERS];
+    void (*filter)(struct _rvb *rvb, int32_t l_rfl, int32_t r_rfl, int32_t *frame);
+    /* the left side only, for the mono mix */
+    void (*filter_mono)(struct _rvb *rvb, int32_t rfl, int32_t *frame);
+    /* buffer data, the sizes are powers of two */
     int32_t *l_buf;
     int32_t *r_buf;
-    int l_buf_size;
-    int r_buf_size;
-    int l_out;
-    int r_out;
-    int l_sp_in[8];
-    int r_sp_in[8];
-    int l_in[4];
-    int r_in[4];
+    uint32_t l_buf_mask;
+    uint32_t r_buf_mask;
+    /* reading position, the delays below are offsets from it */
+    uint32_t pos;
+    /* frames in a row that put nothing into the ring buffers */
+    uint32_t quiet;
+    uint32_t l_sp_in[8];
+    uint32_t r_sp_in[8];
+    uint32_t l_in[4];
+    uint32_t r_in[4];
     int gain;
     uint32_t max_reverb_time;
+    /*
+     feedback delay network, 4 lines of fdn_mask + 1 entries each one after
+     the other, read fdn_len behind pos. fdn_gain (x1024) sets how much each
+     line feeds back and fdn_damp (x1024) its low pass.
+     */
+    int32_t *fdn_buf;
+    uint32_t fdn_mask;
+    uint32_t fdn_len[4];
+    int32_t fdn_gain[4];
+    int32_t fdn_damp;
+    int32_t fdn_lp[4];
 };
 
 extern void _WM_reset_reverb (struct _rvb *rvb);
-extern struct _rvb *_WM_init_reverb(int rate, float room_x, float room_y, float listen_x, float listen_y);
+extern struct _rvb *_WM_init_reverb(uint8_t engine, int rate, float room_x, float room_y, float listen_x, float listen_y);
 extern void _WM_free_reverb (struct _rvb *rvb);
-extern void _WM_do_reverb (struct _rvb *rvb, int32_t *buffer, int size);
+/*
+ size is in samples, channels 2 for interleaved left/right frames or 1 for
+ a mono mix. The state carries over between the two, so a handle switching
+ between them should reset the reverb.
+ */
+extern void _WM_do_reverb (struct _rvb *rvb, int32_t *buffer, int size, int channels);
+/* the same for the float mix bus */
+extern void _WM_do_reverb_float (struct _rvb *rvb, float *buffer, int size, int channels);
+/* 1 once everything fed to the reverb has died away, it then only adds silence */
+extern int _WM_reverb_idle (struct _rvb *rvb);
 
 #endif /* __REVERB_H */
@@ -33,6 +33,12 @@
 #define SAMPLE_ENVELOPE  0x40
 #define SAMPLE_CLAMPED   0x80
 
+/*
+ * Zeroed samples kept either side of the sample data so the resamplers
+ * can always read their full window, even at data[0] and data_length.
+ */
+#define SAMPLE_GUARD     24
+
 #ifdef DEBUG_SAMPLES
 #define SAMPLE_CONVERT_DEBUG(dx) printf("\r%s\n",dx)
 #else
@@ -41,6 +47,8 @@
 
 struct _patch;
 struct _mdi;
+struct _WM_Context;
+struct _WM_Map;
 
 struct _sample {
     uint32_t data_length;
@@ -57,17 +65,18 @@ struct _sample {
     int32_t env_target[7];
     uint32_t inc_div;
     int16_t *data;
+    struct _WM_Map *map; /* data points into this, NULL if it was allocated */
     struct _sample *next;
 
     uint32_t note_off_decay;
 };
 
-extern int _WM_fix_release;
-extern int _WM_auto_amp;
-extern int _WM_auto_amp_with_amp;
-
 extern struct _sample *_WM_get_sample_data(struct _patch *sample_patch, uint32_t freq);
-extern int _WM_load_sample(struct _patch *sample_patch);
+extern int _WM_load_sample(struct _WM_Context *ctx, struct _patch *sample_patch);
 extern uint32_t _WM_get_decay_samples(struct _mdi * mdi, uint8_t channel, uint8_t note);
 
+extern int16_t *_WM_alloc_sample_data(uint32_t length);
+extern void _WM_free_sample_data(int16_t *data);
+extern void _WM_free_samples(struct _sample *sample);
+
 #endif /* __SAMPLE_H */
@@ -0,0 +1,147 @@
+/*
+ * simd.h -- Midi Wavetable Processing library
+ *
+ * Copyright (C) WildMIDI Developers 2001-2024
+ *
+ * This file is part of WildMIDI.
+ *
+ * WildMIDI is free software: you can redistribute and/or modify the player
+ * under the terms of the GNU General Public License and you can redistribute
+ * and/or modify the library under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either version 3 of
+ * the licenses, or(at your option) any later version.
+ *
+ * WildMIDI is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License and
+ * the GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License and the
+ * GNU Lesser General Public License along with WildMIDI.  If not,  see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __SIMD_H
+#define __SIMD_H
+
+/*
+ * Pick the vector units we know how to use.  x86 code is built with
+ * function level target attributes (or MSVC, which needs none) so the
+ * library itself does not need any special compiler flags, the avx2 and
+ * sse2 kernels are then only used if the cpu says it has them.
+ *
+ * The helpers below do exactly what the C code they stand in for does,
+ * including dividing with truncation towards zero, so that the output is
+ * the same bit for bit whichever version is used.
+ */
+#if !defined(WM_NO_SIMD)
+# if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#  define WM_SIMD_X86 1
+#  define WM_TARGET_SSE2 __attribute__((target("sse2")))
+#  define WM_TARGET_AVX2 __attribute__((target("avx2")))
+#  define WM_TARGET_AVX2_FMA __attribute__((target("avx2,fma")))
+# elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#  define WM_SIMD_X86 1
+#  define WM_TARGET_SSE2
+#  define WM_TARGET_AVX2
+#  define WM_TARGET_AVX2_FMA
+# elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#  define WM_SIMD_NEON 1
+# endif
+#endif
+
+#if defined(WM_SIMD_X86)
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#elif defined(WM_SIMD_NEON)
+#include <arm_neon.h>
+#endif
+
+#if defined(WM_SIMD_X86)
+
+static inline WM_TARGET_SSE2 __m128i wm_div1024_sse2(__m128i x) {
+    __m128i bias = _mm_and_si128(_mm_srai_epi32(x, 31), _mm_set1_epi32(1023));
+    return _mm_srai_epi32(_mm_add_epi32(x, bias), 10);
+}
+
+static inline WM_TARGET_SSE2 __m128i wm_div8_sse2(__m128i x) {
+    __m128i bias = _mm_and_si128(_mm_srai_epi32(x, 31), _mm_set1_epi32(7));
+    return _mm_srai_epi32(_mm_add_epi32(x, bias), 3);
+}
+
+/* sse2 has no 32bit multiply that keeps the low half, so build one */
+static inline WM_TARGET_SSE2 __m128i wm_mullo_sse2(__m128i a, __m128i b) {
+    __m128i even = _mm_mul_epu32(a, b);
+    __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+    return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+                              _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+
+static inline WM_TARGET_AVX2 __m256i wm_div1024_avx2(__m256i x) {
+    __m256i bias = _mm256_and_si256(_mm256_srai_epi32(x, 31), _mm256_set1_epi32(1023));
+    return _mm256_srai_epi32(_mm256_add_epi32(x, bias), 10);
+}
+
+static inline WM_TARGET_AVX2 __m256i wm_div8_avx2(__m256i x) {
+    __m256i bias = _mm256_and_si256(_mm256_srai_epi32(x, 31), _mm256_set1_epi32(7));
+    return _mm256_srai_epi32(_mm256_add_epi32(x, bias), 3);
+}
+
+static inline int wm_cpu_has_sse2(void) {
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    return ((info[3] >> 26) & 1);
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("sse2");
+#endif
+}
+
+static inline int wm_cpu_has_avx2(void) {
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7) return 0;
+    __cpuid(info, 1);
+    /* osxsave and avx, then check the os saves the ymm registers */
+    if ((info[2] & 0x18000000) != 0x18000000) return 0;
+    if ((_xgetbv(0) & 6) != 6) return 0;
+    __cpuidex(info, 7, 0);
+    return ((info[1] >> 5) & 1);
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+
+static inline int wm_cpu_has_fma(void) {
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    /* fma, osxsave and avx */
+    if ((info[2] & 0x18001000) != 0x18001000) return 0;
+    return ((_xgetbv(0) & 6) == 6);
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("fma");
+#endif
+}
+
+#elif defined(WM_SIMD_NEON)
+
+static inline int32x4_t wm_div1024_neon(int32x4_t x) {
+    int32x4_t bias = vandq_s32(vshrq_n_s32(x, 31), vdupq_n_s32(1023));
+    return vshrq_n_s32(vaddq_s32(x, bias), 10);
+}
+
+static inline int32x4_t wm_div8_neon(int32x4_t x) {
+    int32x4_t bias = vandq_s32(vshrq_n_s32(x, 31), vdupq_n_s32(7));
+    return vshrq_n_s32(vaddq_s32(x, bias), 3);
+}
+
+#endif
+
+#endif /* __SIMD_H */
@@ -0,0 +1,75 @@
+/*
+ * threadpool.h -- Midi Wavetable Processing library
+ *
+ * Copyright (C) WildMIDI Developers 2001-2024
+ *
+ * This file is part of WildMIDI.
+ *
+ * WildMIDI is free software: you can redistribute and/or modify the player
+ * under the terms of the GNU General Public License and you can redistribute
+ * and/or modify the library under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either version 3 of
+ * the licenses, or(at your option) any later version.
+ *
+ * WildMIDI is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License and
+ * the GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License and the
+ * GNU Lesser General Public License along with WildMIDI.  If not,  see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __THREADPOOL_H
+#define __THREADPOOL_H
+
+/*
+ * A pool job handles item index of a batch. worker is the thread running
+ * it, 0 being the thread that called _WM_pool_run, and can be passed to
+ * _WM_pool_scratch. Jobs must not set the global error, except posted ones
+ * as nobody waits on those.
+ */
+typedef void (*_WM_PoolJob)(void *data, uint32_t index, uint32_t worker);
+
+/*
+ * Runs job on every index from 0 to count - 1 and returns once all of them
+ * are done. The pool has one thread less than the machine has cpus, started
+ * on first use, and the caller takes items too. Without thread support, or
+ * when the threads can't be started, everything runs on the calling thread.
+ */
+extern void _WM_pool_run(_WM_PoolJob job, void *data, uint32_t count);
+
+/*
+ * Same as _WM_pool_run, except that it returns -1 without running anything
+ * if the pool is busy with another batch, which includes being called from
+ * within a job, or if there are no threads to help.
+ */
+extern int _WM_pool_try_run(_WM_PoolJob job, void *data, uint32_t count);
+
+/*
+ * Queues job for every index from 0 to count - 1 and returns straight
+ * away. The pool's threads take the items in the order they were posted
+ * whenever they have no batch to help with, batches only use the threads
+ * that are free. Returns -1 without queuing anything if there are no
+ * threads or no memory, the caller then has to do the work itself.
+ * _WM_free_pool runs whatever is still queued before stopping the threads.
+ */
+extern int _WM_pool_post(_WM_PoolJob job, void *data, uint32_t count);
+
+/*
+ * How many threads, counting the caller's, take part in a batch. 1 while
+ * the pool is busy, as _WM_pool_try_run would fail then anyway.
+ */
+extern uint32_t _WM_pool_workers(void);
+
+/*
+ * A buffer of at least size bytes owned by worker, kept between batches.
+ * Only valid within a job running on that worker. NULL if out of memory.
+ */
+extern void *_WM_pool_scratch(uint32_t worker, uint32_t size);
+
+/* stops the threads and frees the scratch buffers */
+extern void _WM_free_pool(void);
+
+#endif /* __THREADPOOL_H */
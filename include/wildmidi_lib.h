@@ -43,6 +43,32 @@
 #define WM_MO_STRIPSILENCE      0x4000
 #define WM_MO_TEXTASLYRIC       0x8000
 
+/* mixer settings that take a value rather than on/off,
+ * these are passed to WildMidi_SetOption on their own */
+#define WM_MO_GAUSS_ORDER       0x0010
+#define WM_MO_RESAMPLER         0x0020
+#define WM_MO_PARALLEL_VOICES   0x0040
+#define WM_MO_REVERB_ENGINE     0x0080
+#define WM_MO_OUTPUT_FORMAT     0x0100
+#define WM_MO_CHANNELS          0x0200  /* 2, or 1 for mono */
+#define WM_MO_MAX_VOICES        0x0400  /* 0 for no limit */
+
+/* settings for WM_MO_RESAMPLER */
+#define WM_RS_LINEAR            0
+#define WM_RS_GAUSS             1
+#define WM_RS_CUBIC             2
+#define WM_RS_SINC              3
+
+/* settings for WM_MO_REVERB_ENGINE */
+#define WM_RE_ROOM              0
+#define WM_RE_FDN               1
+
+/* settings for WM_MO_OUTPUT_FORMAT, interleaved left/right in native byte order */
+#define WM_OF_S16               0
+#define WM_OF_S24               1   /* 24bit in the low bits of an int32 */
+#define WM_OF_S32               2
+#define WM_OF_F32               3   /* float, -1.0 to 1.0 */
+
 /* conversion options */
 #define WM_CO_XMI_TYPE          0x0010
 #define WM_CO_FREQUENCY         0x0020
@@ -96,7 +122,17 @@ struct _WM_Info {
     uint32_t total_midi_time;
 };
 
+/* for WildMidi_GetPatchCache, sizes are in bytes */
+struct _WM_PatchCache {
+    uint64_t budget;     /* how much loaded patches may take up before unused ones get freed */
+    uint64_t resident;   /* what loaded patches take up, used or not */
+    uint64_t hits;       /* patches a midi found loaded, or being loaded, already */
+    uint64_t misses;     /* patches that had to be loaded for a midi */
+    uint64_t evictions;  /* unused patches freed to stay within budget */
+};
+
 typedef void midi;
+typedef void midi_context;
 
 typedef void * (*_WM_VIO_Allocate)(const char *, uint32_t *);
 typedef void   (*_WM_VIO_Free)(void *);
@@ -119,15 +155,39 @@ struct _WM_VIO {
     _WM_VIO_Free free_file;
 };
 
+/*
+ * Pass { WildMidi_MapFile, WildMidi_UnmapFile } to WildMidi_InitVIO to have
+ * files mapped into memory rather than read, where the system can do so.
+ */
+
 WM_SYMBOL const char * WildMidi_GetString (uint16_t info);
 WM_SYMBOL long WildMidi_GetVersion (void);
 WM_SYMBOL int WildMidi_Init (const char *config_file, uint16_t rate, uint16_t mixer_options);
 WM_SYMBOL int WildMidi_InitVIO(struct _WM_VIO * callbacks, const char *config_file, uint16_t rate, uint16_t mixer_options);
+WM_SYMBOL void * WildMidi_MapFile (const char *filename, uint32_t *size);
+WM_SYMBOL void WildMidi_UnmapFile (void *buffer);
 WM_SYMBOL int WildMidi_MasterVolume (uint8_t master_volume);
+WM_SYMBOL midi_context * WildMidi_CreateContext (const char *config_file, uint16_t rate, uint16_t mixer_options);
+WM_SYMBOL int WildMidi_DestroyContext (midi_context *context);
+WM_SYMBOL int WildMidi_ContextMasterVolume (midi_context *context, uint8_t master_volume);
+WM_SYMBOL int WildMidi_SetPatchCache (uint64_t budget);
+WM_SYMBOL int WildMidi_ContextSetPatchCache (midi_context *context, uint64_t budget);
+WM_SYMBOL int WildMidi_GetPatchCache (struct _WM_PatchCache *cache);
+WM_SYMBOL int WildMidi_ContextGetPatchCache (midi_context *context, struct _WM_PatchCache *cache);
+WM_SYMBOL int WildMidi_MakeBank (uint8_t **bank, uint32_t *size);
+WM_SYMBOL int WildMidi_ContextMakeBank (midi_context *context, uint8_t **bank, uint32_t *size);
+WM_SYMBOL int WildMidi_LoadBank (const char *bank_file);
+WM_SYMBOL int WildMidi_ContextLoadBank (midi_context *context, const char *bank_file);
+WM_SYMBOL midi * WildMidi_OpenInContext (midi_context *context, const char *midifile);
+WM_SYMBOL midi * WildMidi_OpenBufferInContext (midi_context *context, const uint8_t *midibuffer, uint32_t size);
 WM_SYMBOL midi * WildMidi_Open (const char *midifile);
 WM_SYMBOL midi * WildMidi_OpenBuffer (const uint8_t *midibuffer, uint32_t size);
 WM_SYMBOL int WildMidi_GetMidiOutput (midi *handle, int8_t **buffer, uint32_t *size);
 WM_SYMBOL int WildMidi_GetOutput (midi *handle, int8_t *buffer, uint32_t size);
+WM_SYMBOL int WildMidi_GetOutputFloat (midi *handle, float *buffer, uint32_t size);
+WM_SYMBOL int WildMidi_Prime (midi *handle, uint32_t max_frames);
+WM_SYMBOL int WildMidi_Render (midi *handle, void *frames, uint32_t frame_count, uint16_t format);
+WM_SYMBOL int WildMidi_RenderBatch (midi **handles, int8_t **buffers, uint32_t *sizes, int *results, uint32_t count);
 WM_SYMBOL int WildMidi_SetOption (midi *handle, uint16_t options, uint16_t setting);
 WM_SYMBOL int WildMidi_SetCvtOption (uint16_t tag, uint16_t setting);
 WM_SYMBOL int WildMidi_ConvertToMidi (const char *file, uint8_t **out, uint32_t *size);
@@ -94,4 +94,30 @@ extern void _WM_DEBUG_MSG(const char * wmfmt, ...)
 #endif
         ;
 
+/*
+ * Real-time checking. With WM_RTCHECK defined, allocating while a thread is
+ * between WM_RT_ENTER and WM_RT_LEAVE prints where it happened and aborts.
+ * The allocation functions of every file including this header are
+ * redirected to do the check, which is why stdlib.h has to come first.
+ */
+#if defined(WM_RTCHECK)
+#include <stdlib.h>
+
+extern void _WM_rt_enter(void);
+extern void _WM_rt_leave(void);
+extern void *_WM_rt_malloc(size_t size, const char *func);
+extern void *_WM_rt_calloc(size_t nmemb, size_t size, const char *func);
+extern void *_WM_rt_realloc(void *ptr, size_t size, const char *func);
+
+#define malloc(s) _WM_rt_malloc((s), _WM_FUNCTION)
+#define calloc(n, s) _WM_rt_calloc((n), (s), _WM_FUNCTION)
+#define realloc(p, s) _WM_rt_realloc((p), (s), _WM_FUNCTION)
+
+#define WM_RT_ENTER() _WM_rt_enter()
+#define WM_RT_LEAVE() _WM_rt_leave()
+#else
+#define WM_RT_ENTER() do {} while (0)
+#define WM_RT_LEAVE() do {} while (0)
+#endif
+
 #endif /* __WM_ERROR_H */
@@ -20,6 +20,7 @@
 
 #define HAVE_STDINT_H 1
 #define HAVE_INTTYPES_H 1
+#define HAVE_SYS_MMAN_H 1
 
 /* #undef AUDIODRV_OPENAL */
 #define AUDIODRV_COREAUDIO 1
@@ -11,7 +11,7 @@ PLAYER  = wildmidi.exe
 LIBS_DLL=
 LIBS_PLY= $(IMPNAME) winmm.lib
 
-DLL_OBJ = wm_error.obj file_io.obj lock.obj wildmidi_lib.obj reverb.obj gus_pat.obj f_xmidi.obj f_mus.obj f_hmp.obj f_midi.obj f_hmi.obj mus2mid.obj xmi2mid.obj internal_midi.obj patches.obj sample.obj
+DLL_OBJ = wm_error.obj file_io.obj lock.obj wildmidi_lib.obj reverb.obj resample.obj gus_pat.obj f_xmidi.obj f_mus.obj f_hmp.obj f_midi.obj f_hmi.obj mus2mid.obj xmi2mid.obj internal_midi.obj patches.obj sample.obj threadpool.obj convert.obj bank.obj
 PLY_OBJ = wm_tty.obj msleep.obj getopt_long.obj out_none.obj out_wave.obj out_win32mm.obj wildmidi.obj
 # out_openal.obj
 
@@ -33,6 +33,8 @@ wildmidi_lib.obj: ..\src\wildmidi_lib.c
 	$(CC) $(DLL_FLAGS) $(INCLUDES) -c -Fo$@ $?
 reverb.obj: ..\src\reverb.c
 	$(CC) $(DLL_FLAGS) $(INCLUDES) -c -Fo$@ $?
+resample.obj: ..\src\resample.c
+	$(CC) $(DLL_FLAGS) $(INCLUDES) -c -Fo$@ $?
 gus_pat.obj: ..\src\gus_pat.c
 	$(CC) $(DLL_FLAGS) $(INCLUDES) -c -Fo$@ $?
 f_xmidi.obj: ..\src\f_xmidi.c
@@ -55,6 +57,12 @@ patches.obj: ..\src\patches.c
 	$(CC) $(DLL_FLAGS) $(INCLUDES) -c -Fo$@ $?
 sample.obj: ..\src\sample.c
 	$(CC) $(DLL_FLAGS) $(INCLUDES) -c -Fo$@ $?
+threadpool.obj: ..\src\threadpool.c
+	$(CC) $(DLL_FLAGS) $(INCLUDES) -c -Fo$@ $?
+convert.obj: ..\src\convert.c
+	$(CC) $(DLL_FLAGS) $(INCLUDES) -c -Fo$@ $?
+bank.obj: ..\src\bank.c
+	$(CC) $(DLL_FLAGS) $(INCLUDES) -c -Fo$@ $?
 
 # player objects:
 wildmidi.obj: ..\src\player\wildmidi.c
@@ -0,0 +1,521 @@
+/*
+ * bank.c -- Midi Wavetable Processing library
+ *
+ * Copyright (C) WildMIDI Developers 2001-2024
+ *
+ * This file is part of WildMIDI.
+ *
+ * WildMIDI is free software: you can redistribute and/or modify the player
+ * under the terms of the GNU General Public License and you can redistribute
+ * and/or modify the library under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either version 3 of
+ * the licenses, or(at your option) any later version.
+ *
+ * WildMIDI is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License and
+ * the GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License and the
+ * GNU Lesser General Public License along with WildMIDI.  If not,  see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "config.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "wm_error.h"
+#include "common.h"
+#include "file_io.h"
+#include "lock.h"
+#include "patches.h"
+#include "sample.h"
+#include "bank.h"
+
+/*
+ * The file is written in the byte order and struct layout of the machine
+ * making it, which the header records, so that loading needs no more than
+ * checking everything points inside the file. A machine that differs just
+ * turns it down. Everything the offsets point at is 16 byte aligned.
+ *
+ *   header, patch table, patch file names,
+ *   then per patch its sample table and each sample's data
+ *
+ * Sample data is stored with SAMPLE_GUARD zeroed samples either side,
+ * data_offset pointing past the leading ones.
+ */
+
+#define BANK_VERSION 1
+#define BANK_ENDIAN  0x01020304
+
+#define BANK_FIX_RELEASE       0x01
+#define BANK_AUTO_AMP          0x02
+#define BANK_AUTO_AMP_WITH_AMP 0x04
+
+static const char bank_magic[8] = { 'W', 'M', 'B', 'A', 'N', 'K', 0, 0 };
+
+struct _bank_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t endian;
+    uint32_t header_size;
+    uint32_t patch_size;
+    uint32_t sample_size;
+    uint32_t rate;
+    uint32_t flags;
+    uint32_t size;
+    uint32_t patch_count;
+    uint32_t patch_offset;
+};
+
+struct _bank_patch {
+    uint16_t patchid;
+    int16_t amp;        /* from the config */
+    int16_t loaded_amp; /* after auto amp */
+    uint8_t keep;
+    uint8_t remove;
+    uint8_t note;
+    uint8_t env_set[6];
+    uint8_t pad;
+    float env_time[6];
+    float env_level[6];
+    uint32_t name_offset;
+    uint32_t sample_count;
+    uint32_t sample_offset;
+};
+
+struct _bank_sample {
+    uint32_t data_length;
+    uint32_t loop_start;
+    uint32_t loop_end;
+    uint32_t loop_size;
+    uint32_t freq_low;
+    uint32_t freq_high;
+    uint32_t freq_root;
+    uint32_t inc_div;
+    uint32_t note_off_decay;
+    int32_t env_rate[7];
+    int32_t env_target[7];
+    uint16_t rate;
+    uint8_t loop_fraction;
+    uint8_t modes;
+    uint32_t data_offset;
+};
+
+struct _WM_Bank {
+    struct _WM_Map *map;
+    const struct _bank_patch *patch;
+    uint32_t patch_count;
+};
+
+#define BANK_ALIGN(x) (((x) + 15) & ~15U)
+
+static uint32_t bank_flags(struct _WM_Context *ctx) {
+    uint32_t flags = 0;
+
+    if (ctx->fix_release) flags |= BANK_FIX_RELEASE;
+    if (ctx->auto_amp) flags |= BANK_AUTO_AMP;
+    if (ctx->auto_amp_with_amp) flags |= BANK_AUTO_AMP_WITH_AMP;
+    return (flags);
+}
+
+/* the loaded amp depends on the configured one, except with plain auto amp */
+static int bank_amp_matters(struct _WM_Context *ctx) {
+    return ((!ctx->auto_amp) || ctx->auto_amp_with_amp);
+}
+
+/* making one */
+
+struct _bank_out {
+    uint8_t *data;
+    uint32_t size;
+    uint32_t alloc;
+};
+
+/* makes room for size more bytes at a 16 byte boundary, returns where */
+static int32_t bank_reserve(struct _bank_out *out, uint32_t size) {
+    uint32_t offset = BANK_ALIGN(out->size);
+    uint32_t alloc = out->alloc;
+    uint8_t *data;
+
+    if ((size > WM_MAXFILESIZE) || (offset > (WM_MAXFILESIZE - size))) {
+        _WM_GLOBAL_ERROR(WM_ERR_LONGFIL, "(bank)", 0);
+        return (-1);
+    }
+    if ((offset + size) > alloc) {
+        if (alloc == 0) alloc = MEM_CHUNK;
+        while ((offset + size) > alloc) alloc *= 2;
+        data = (uint8_t *) realloc(out->data, alloc);
+        if (data == NULL) {
+            _WM_GLOBAL_ERROR(WM_ERR_MEM, NULL, errno);
+            return (-1);
+        }
+        out->data = data;
+        out->alloc = alloc;
+    }
+    memset(out->data + out->size, 0, (offset + size) - out->size);
+    out->size = offset + size;
+    return ((int32_t) offset);
+}
+
+/* loads a copy of patch and adds its samples, leaving patch as it is */
+static int bank_add_patch(struct _WM_Context *ctx, struct _bank_out *out,
+                          uint32_t patch_offset, struct _patch *patch) {
+    struct _bank_patch *bank_patch;
+    struct _bank_sample *bank_sample;
+    struct _sample *sample;
+    struct _patch copy;
+    uint32_t count = 0;
+    int32_t table;
+    int32_t offset;
+    uint32_t length;
+    uint32_t i;
+
+    memcpy(&copy, patch, sizeof(struct _patch));
+    copy.first_sample = NULL;
+    if (_WM_load_sample(ctx, &copy) == -1) {
+        /* left out, so it gets loaded (or not) from its .pat file */
+        return (0);
+    }
+
+    for (sample = copy.first_sample; sample; sample = sample->next) {
+        count++;
+    }
+    if ((table = bank_reserve(out, count * sizeof(struct _bank_sample))) == -1) {
+        _WM_free_samples(copy.first_sample);
+        return (-1);
+    }
+
+    i = 0;
+    for (sample = copy.first_sample; sample; sample = sample->next) {
+        length = sample->data_length >> 10;
+        offset = bank_reserve(out, (length + (SAMPLE_GUARD * 2)) * sizeof(int16_t));
+        if (offset == -1) {
+            _WM_free_samples(copy.first_sample);
+            return (-1);
+        }
+        offset += SAMPLE_GUARD * sizeof(int16_t);
+        memcpy(out->data + offset, sample->data, length * sizeof(int16_t));
+
+        /* out->data may have moved */
+        bank_sample = (struct _bank_sample *) (out->data + table) + i++;
+        bank_sample->data_length = sample->data_length;
+        bank_sample->loop_start = sample->loop_start;
+        bank_sample->loop_end = sample->loop_end;
+        bank_sample->loop_size = sample->loop_size;
+        bank_sample->freq_low = sample->freq_low;
+        bank_sample->freq_high = sample->freq_high;
+        bank_sample->freq_root = sample->freq_root;
+        bank_sample->inc_div = sample->inc_div;
+        bank_sample->note_off_decay = sample->note_off_decay;
+        memcpy(bank_sample->env_rate, sample->env_rate, sizeof(bank_sample->env_rate));
+        memcpy(bank_sample->env_target, sample->env_target, sizeof(bank_sample->env_target));
+        bank_sample->rate = sample->rate;
+        bank_sample->loop_fraction = sample->loop_fraction;
+        bank_sample->modes = sample->modes;
+        bank_sample->data_offset = (uint32_t) offset;
+    }
+
+    bank_patch = (struct _bank_patch *) (out->data + patch_offset);
+    bank_patch->amp = patch->amp;
+    bank_patch->loaded_amp = copy.amp;
+    bank_patch->sample_count = count;
+    bank_patch->sample_offset = (uint32_t) table;
+
+    _WM_free_samples(copy.first_sample);
+    return (1);
+}
+
+int _WM_make_bank(struct _WM_Context *ctx, uint8_t **bank, uint32_t *size) {
+    struct _bank_out out = { NULL, 0, 0 };
+    struct _bank_header *header;
+    struct _bank_patch *bank_patch;
+    struct _patch *patch;
+    uint32_t patch_count = 0;
+    uint32_t stored = 0;
+    int32_t patch_offset;
+    int32_t name_offset;
+    uint32_t entry;
+    uint32_t i, j;
+    int ret;
+
+    for (i = 0; i < 128; i++) {
+        for (patch = ctx->patch[i]; patch; patch = patch->next) {
+            patch_count++;
+        }
+    }
+
+    if ((bank_reserve(&out, sizeof(struct _bank_header)) == -1)
+            || ((patch_offset = bank_reserve(&out, patch_count * sizeof(struct _bank_patch))) == -1)) {
+        free(out.data);
+        return (-1);
+    }
+
+    for (i = 0; i < 128; i++) {
+        for (patch = ctx->patch[i]; patch; patch = patch->next) {
+            if (patch->filename == NULL) {
+                continue;
+            }
+            if ((name_offset = bank_reserve(&out, strlen(patch->filename) + 1)) == -1) {
+                free(out.data);
+                return (-1);
+            }
+            strcpy((char *) out.data + name_offset, patch->filename);
+
+            entry = patch_offset + (stored * sizeof(struct _bank_patch));
+            bank_patch = (struct _bank_patch *) (out.data + entry);
+            bank_patch->patchid = patch->patchid;
+            bank_patch->keep = patch->keep;
+            bank_patch->remove = patch->remove;
+            bank_patch->note = patch->note;
+            for (j = 0; j < 6; j++) {
+                bank_patch->env_set[j] = patch->env[j].set;
+                if (patch->env[j].set & 0x01) bank_patch->env_time[j] = patch->env[j].time;
+                if (patch->env[j].set & 0x02) bank_patch->env_level[j] = patch->env[j].level;
+            }
+            bank_patch->name_offset = (uint32_t) name_offset;
+
+            ret = bank_add_patch(ctx, &out, entry, patch);
+            if (ret == -1) {
+                free(out.data);
+                return (-1);
+            }
+            if (ret == 0) {
+                /* not stored, the slot gets reused */
+                memset(out.data + entry, 0, sizeof(struct _bank_patch));
+                continue;
+            }
+            stored++;
+        }
+    }
+
+    header = (struct _bank_header *) out.data;
+    memcpy(header->magic, bank_magic, sizeof(header->magic));
+    header->version = BANK_VERSION;
+    header->endian = BANK_ENDIAN;
+    header->header_size = sizeof(struct _bank_header);
+    header->patch_size = sizeof(struct _bank_patch);
+    header->sample_size = sizeof(struct _bank_sample);
+    header->rate = ctx->sample_rate;
+    header->flags = bank_flags(ctx);
+    header->size = out.size;
+    header->patch_count = stored;
+    header->patch_offset = (uint32_t) patch_offset;
+
+    *bank = out.data;
+    *size = out.size;
+    return (0);
+}
+
+/* loading one */
+
+/* whether size bytes at offset lie within a file of file_size bytes */
+static int bank_fits(uint32_t file_size, uint32_t offset, uint64_t size) {
+    return ((offset <= file_size) && (size <= (uint64_t) (file_size - offset)));
+}
+
+static int bank_check_samples(const uint8_t *data, uint32_t size,
+                              const struct _bank_patch *bank_patch) {
+    const struct _bank_sample *bank_sample;
+    uint32_t length;
+    uint32_t i;
+
+    if ((bank_patch->sample_count == 0) || (bank_patch->sample_offset & 15)
+            || !bank_fits(size, bank_patch->sample_offset,
+                          (uint64_t) bank_patch->sample_count * sizeof(struct _bank_sample))) {
+        return (-1);
+    }
+    bank_sample = (const struct _bank_sample *) (data + bank_patch->sample_offset);
+    for (i = 0; i < bank_patch->sample_count; i++, bank_sample++) {
+        /* the resamplers trust these, so anything off would read past the data */
+        if ((bank_sample->inc_div == 0)
+                || (bank_sample->loop_start > bank_sample->loop_end)
+                || (bank_sample->loop_end > bank_sample->data_length)
+                || (bank_sample->loop_size != (bank_sample->loop_end - bank_sample->loop_start))
+                || ((bank_sample->modes & SAMPLE_LOOP) && (bank_sample->loop_size == 0))) {
+            return (-1);
+        }
+        length = bank_sample->data_length >> 10;
+        if ((bank_sample->data_offset & 1)
+                || (bank_sample->data_offset < (SAMPLE_GUARD * sizeof(int16_t)))
+                || !bank_fits(size, bank_sample->data_offset - (SAMPLE_GUARD * sizeof(int16_t)),
+                              ((uint64_t) length + (SAMPLE_GUARD * 2)) * sizeof(int16_t))) {
+            return (-1);
+        }
+    }
+    return (0);
+}
+
+int _WM_load_bank(struct _WM_Context *ctx, const char *filename) {
+    const struct _bank_header *header;
+    const struct _bank_patch *bank_patch;
+    struct _WM_Bank *bank;
+    struct _WM_Map *map;
+    uint32_t i;
+
+    if ((map = _WM_MapFile(filename)) == NULL) {
+        return (-1);
+    }
+
+    header = (const struct _bank_header *) map->data;
+    if ((map->size < sizeof(struct _bank_header))
+            || memcmp(header->magic, bank_magic, sizeof(header->magic))
+            || (header->version != BANK_VERSION)
+            || (header->endian != BANK_ENDIAN)
+            || (header->header_size != sizeof(struct _bank_header))
+            || (header->patch_size != sizeof(struct _bank_patch))
+            || (header->sample_size != sizeof(struct _bank_sample))) {
+        _WM_GLOBAL_ERROR(WM_ERR_INVALID, filename, 0);
+        _WM_UnrefMap(map);
+        return (-1);
+    }
+    if ((header->rate != ctx->sample_rate) || (header->flags != bank_flags(ctx))) {
+        _WM_GLOBAL_ERROR(WM_ERR_INVALID_ARG, "(bank made for another rate or config)", 0);
+        _WM_UnrefMap(map);
+        return (-1);
+    }
+
+    if ((header->size != map->size) || (header->patch_offset & 15)
+            || !bank_fits(map->size, header->patch_offset,
+                          (uint64_t) header->patch_count * sizeof(struct _bank_patch))) {
+        _WM_GLOBAL_ERROR(WM_ERR_CORUPT, filename, 0);
+        _WM_UnrefMap(map);
+        return (-1);
+    }
+    bank_patch = (const struct _bank_patch *) (map->data + header->patch_offset);
+    for (i = 0; i < header->patch_count; i++) {
+        if ((bank_patch[i].name_offset >= map->size)
+                || (memchr(map->data + bank_patch[i].name_offset, 0,
+                           map->size - bank_patch[i].name_offset) == NULL)
+                || (bank_check_samples(map->data, map->size, &bank_patch[i]) == -1)) {
+            _WM_GLOBAL_ERROR(WM_ERR_CORUPT, filename, 0);
+            _WM_UnrefMap(map);
+            return (-1);
+        }
+    }
+
+    bank = (struct _WM_Bank *) malloc(sizeof(struct _WM_Bank));
+    if (bank == NULL) {
+        _WM_GLOBAL_ERROR(WM_ERR_MEM, NULL, errno);
+        _WM_UnrefMap(map);
+        return (-1);
+    }
+    bank->map = map;
+    bank->patch = bank_patch;
+    bank->patch_count = header->patch_count;
+
+    _WM_Lock(&ctx->patch_lock);
+    if (ctx->bank != NULL) {
+        /* another thread got there while we were checking ours */
+        _WM_Unlock(&ctx->patch_lock);
+        _WM_GLOBAL_ERROR(WM_ERR_INVALID_ARG, "(bank already loaded)", 0);
+        free(bank);
+        _WM_UnrefMap(map);
+        return (-1);
+    }
+    ctx->bank = bank;
+    _WM_Unlock(&ctx->patch_lock);
+    return (0);
+}
+
+/* samples still pointing into the bank keep it mapped */
+void _WM_free_bank(struct _WM_Context *ctx) {
+    if (ctx->bank == NULL) {
+        return;
+    }
+    _WM_UnrefMap(ctx->bank->map);
+    free(ctx->bank);
+    ctx->bank = NULL;
+}
+
+static int bank_patch_matches(struct _WM_Context *ctx, const char *name,
+                              const struct _bank_patch *bank_patch,
+                              struct _patch *patch) {
+    uint32_t i;
+
+    if ((bank_patch->patchid != patch->patchid)
+            || (bank_patch->keep != patch->keep)
+            || (bank_patch->remove != patch->remove)
+            || (bank_patch->note != patch->note)
+            || (bank_amp_matters(ctx) && (bank_patch->amp != patch->amp))
+            || strcmp(name, patch->filename)) {
+        return (0);
+    }
+    for (i = 0; i < 6; i++) {
+        if ((bank_patch->env_set[i] != patch->env[i].set)
+                || ((patch->env[i].set & 0x01) && (bank_patch->env_time[i] != patch->env[i].time))
+                || ((patch->env[i].set & 0x02) && (bank_patch->env_level[i] != patch->env[i].level))) {
+            return (0);
+        }
+    }
+    return (1);
+}
+
+struct _sample *_WM_get_bank_samples(struct _WM_Context *ctx, struct _patch *patch) {
+    struct _WM_Bank *bank = ctx->bank;
+    const struct _bank_patch *bank_patch = NULL;
+    const struct _bank_sample *bank_sample;
+    struct _sample *first_sample = NULL;
+    struct _sample *sample = NULL;
+    struct _sample *tmp_sample;
+    uint32_t i;
+
+    if ((bank == NULL) || (patch->filename == NULL)) {
+        return (NULL);
+    }
+    for (i = 0; i < bank->patch_count; i++) {
+        if (bank_patch_matches(ctx, (const char *) bank->map->data + bank->patch[i].name_offset,
+                               &bank->patch[i], patch)) {
+            bank_patch = &bank->patch[i];
+            break;
+        }
+    }
+    if (bank_patch == NULL) {
+        return (NULL);
+    }
+
+    bank_sample = (const struct _bank_sample *) (bank->map->data + bank_patch->sample_offset);
+    for (i = 0; i < bank_patch->sample_count; i++, bank_sample++) {
+        tmp_sample = (struct _sample *) malloc(sizeof(struct _sample));
+        if (tmp_sample == NULL) {
+            /* not worth an error, the .pat file is still there */
+            _WM_free_samples(first_sample);
+            return (NULL);
+        }
+        if (first_sample == NULL) {
+            first_sample = tmp_sample;
+        } else {
+            sample->next = tmp_sample;
+        }
+        sample = tmp_sample;
+
+        sample->data_length = bank_sample->data_length;
+        sample->loop_start = bank_sample->loop_start;
+        sample->loop_end = bank_sample->loop_end;
+        sample->loop_size = bank_sample->loop_size;
+        sample->loop_fraction = bank_sample->loop_fraction;
+        sample->rate = bank_sample->rate;
+        sample->freq_low = bank_sample->freq_low;
+        sample->freq_high = bank_sample->freq_high;
+        sample->freq_root = bank_sample->freq_root;
+        sample->modes = bank_sample->modes;
+        memcpy(sample->env_rate, bank_sample->env_rate, sizeof(sample->env_rate));
+        memcpy(sample->env_target, bank_sample->env_target, sizeof(sample->env_target));
+        sample->inc_div = bank_sample->inc_div;
+        sample->note_off_decay = bank_sample->note_off_decay;
+        sample->data = (int16_t *) (bank->map->data + bank_sample->data_offset);
+        sample->map = bank->map;
+        sample->next = NULL;
+        _WM_RefMap(bank->map);
+    }
+
+    if (ctx->auto_amp) {
+        patch->amp = bank_patch->loaded_amp;
+    }
+    return (first_sample);
+}
@@ -0,0 +1,276 @@
+/*
+ * convert.c -- Midi Wavetable Processing library
+ *
+ * Copyright (C) WildMIDI Developers 2001-2024
+ *
+ * This file is part of WildMIDI.
+ *
+ * WildMIDI is free software: you can redistribute and/or modify the player
+ * under the terms of the GNU General Public License and you can redistribute
+ * and/or modify the library under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either version 3 of
+ * the licenses, or(at your option) any later version.
+ *
+ * WildMIDI is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License and
+ * the GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License and the
+ * GNU Lesser General Public License along with WildMIDI.  If not,  see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#include "wildmidi_lib.h"
+#include "convert.h"
+#include "simd.h"
+
+static inline int32_t wm_clamp16(int32_t sample) {
+    if (sample > 32767) return (32767);
+    if (sample < -32768) return (-32768);
+    return (sample);
+}
+
+/*
+ * The plain C converters, which the vector ones must match. They also do
+ * whatever is left over after the vector ones.
+ */
+
+static void convert_s16_c(const int32_t *in, int8_t *out, uint32_t count) {
+    int16_t sample;
+
+    while (count--) {
+        sample = (int16_t) wm_clamp16(*in++);
+        memcpy(out, &sample, 2);
+        out += 2;
+    }
+}
+
+static void convert_s24_c(const int32_t *in, int8_t *out, uint32_t count) {
+    int32_t sample;
+
+    while (count--) {
+        sample = wm_clamp16(*in++) * 256;
+        memcpy(out, &sample, 4);
+        out += 4;
+    }
+}
+
+static void convert_s32_c(const int32_t *in, int8_t *out, uint32_t count) {
+    int32_t sample;
+
+    while (count--) {
+        sample = wm_clamp16(*in++) * 65536;
+        memcpy(out, &sample, 4);
+        out += 4;
+    }
+}
+
+/* float has the headroom, so no clamping to -1.0 to 1.0 here */
+static void convert_f32_c(const int32_t *in, int8_t *out, uint32_t count) {
+    float sample;
+
+    while (count--) {
+        sample = (float) *in++ * (1.0f / 32768.0f);
+        memcpy(out, &sample, 4);
+        out += 4;
+    }
+}
+
+#if defined(WM_SIMD_X86)
+
+/*
+ * Eight samples at a time, packing to 16bit with saturation first. The
+ * wider integer formats then put the 16bit value in the top half of each
+ * 32bit lane and shift it back down as far as needed.
+ */
+
+static WM_TARGET_SSE2 void convert_s16_sse2(const int32_t *in, int8_t *out, uint32_t count) {
+    __m128i lo, hi;
+    uint32_t blocks = count >> 3;
+
+    while (blocks--) {
+        lo = _mm_loadu_si128((const __m128i *)in);
+        hi = _mm_loadu_si128((const __m128i *)(in + 4));
+        _mm_storeu_si128((__m128i *)out, _mm_packs_epi32(lo, hi));
+        in += 8;
+        out += 16;
+    }
+    convert_s16_c(in, out, count & 7);
+}
+
+static WM_TARGET_SSE2 void convert_s24_sse2(const int32_t *in, int8_t *out, uint32_t count) {
+    __m128i packed;
+    __m128i zero = _mm_setzero_si128();
+    uint32_t blocks = count >> 3;
+
+    while (blocks--) {
+        packed = _mm_packs_epi32(_mm_loadu_si128((const __m128i *)in),
+                                 _mm_loadu_si128((const __m128i *)(in + 4)));
+        _mm_storeu_si128((__m128i *)out, _mm_srai_epi32(_mm_unpacklo_epi16(zero, packed), 8));
+        _mm_storeu_si128((__m128i *)(out + 16), _mm_srai_epi32(_mm_unpackhi_epi16(zero, packed), 8));
+        in += 8;
+        out += 32;
+    }
+    convert_s24_c(in, out, count & 7);
+}
+
+static WM_TARGET_SSE2 void convert_s32_sse2(const int32_t *in, int8_t *out, uint32_t count) {
+    __m128i packed;
+    __m128i zero = _mm_setzero_si128();
+    uint32_t blocks = count >> 3;
+
+    while (blocks--) {
+        packed = _mm_packs_epi32(_mm_loadu_si128((const __m128i *)in),
+                                 _mm_loadu_si128((const __m128i *)(in + 4)));
+        _mm_storeu_si128((__m128i *)out, _mm_unpacklo_epi16(zero, packed));
+        _mm_storeu_si128((__m128i *)(out + 16), _mm_unpackhi_epi16(zero, packed));
+        in += 8;
+        out += 32;
+    }
+    convert_s32_c(in, out, count & 7);
+}
+
+static WM_TARGET_SSE2 void convert_f32_sse2(const int32_t *in, int8_t *out, uint32_t count) {
+    __m128 scale = _mm_set1_ps(1.0f / 32768.0f);
+    uint32_t blocks = count >> 3;
+
+    while (blocks--) {
+        _mm_storeu_ps((float *)out, _mm_mul_ps(_mm_cvtepi32_ps(_mm_loadu_si128((const __m128i *)in)), scale));
+        _mm_storeu_ps((float *)(out + 16), _mm_mul_ps(_mm_cvtepi32_ps(_mm_loadu_si128((const __m128i *)(in + 4))), scale));
+        in += 8;
+        out += 32;
+    }
+    convert_f32_c(in, out, count & 7);
+}
+
+#elif defined(WM_SIMD_NEON)
+
+static void convert_s16_neon(const int32_t *in, int8_t *out, uint32_t count) {
+    uint32_t blocks = count >> 3;
+
+    while (blocks--) {
+        vst1q_s16((int16_t *)out, vcombine_s16(vqmovn_s32(vld1q_s32(in)), vqmovn_s32(vld1q_s32(in + 4))));
+        in += 8;
+        out += 16;
+    }
+    convert_s16_c(in, out, count & 7);
+}
+
+static void convert_s24_neon(const int32_t *in, int8_t *out, uint32_t count) {
+    uint32_t blocks = count >> 3;
+
+    while (blocks--) {
+        vst1q_s32((int32_t *)out, vshll_n_s16(vqmovn_s32(vld1q_s32(in)), 8));
+        vst1q_s32((int32_t *)(out + 16), vshll_n_s16(vqmovn_s32(vld1q_s32(in + 4)), 8));
+        in += 8;
+        out += 32;
+    }
+    convert_s24_c(in, out, count & 7);
+}
+
+static void convert_s32_neon(const int32_t *in, int8_t *out, uint32_t count) {
+    uint32_t blocks = count >> 3;
+
+    while (blocks--) {
+        vst1q_s32((int32_t *)out, vshll_n_s16(vqmovn_s32(vld1q_s32(in)), 16));
+        vst1q_s32((int32_t *)(out + 16), vshll_n_s16(vqmovn_s32(vld1q_s32(in + 4)), 16));
+        in += 8;
+        out += 32;
+    }
+    convert_s32_c(in, out, count & 7);
+}
+
+static void convert_f32_neon(const int32_t *in, int8_t *out, uint32_t count) {
+    uint32_t blocks = count >> 3;
+
+    while (blocks--) {
+        vst1q_f32((float *)out, vmulq_n_f32(vcvtq_f32_s32(vld1q_s32(in)), 1.0f / 32768.0f));
+        vst1q_f32((float *)(out + 16), vmulq_n_f32(vcvtq_f32_s32(vld1q_s32(in + 4)), 1.0f / 32768.0f));
+        in += 8;
+        out += 32;
+    }
+    convert_f32_c(in, out, count & 7);
+}
+
+#endif
+
+/* indexed by WM_OF_*, filled in by _WM_init_convert() */
+static _WM_Convert converters[4] = {
+    convert_s16_c, convert_s24_c, convert_s32_c, convert_f32_c
+};
+
+_WM_Convert _WM_get_converter(uint8_t format) {
+    if (format > WM_OF_F32) return (NULL);
+    return (converters[format]);
+}
+
+uint32_t _WM_sample_size(uint8_t format) {
+    switch (format) {
+    case WM_OF_S16:
+        return (2);
+    case WM_OF_S24:
+    case WM_OF_S32:
+    case WM_OF_F32:
+        return (4);
+    default:
+        return (0);
+    }
+}
+
+void _WM_init_convert(void) {
+    converters[WM_OF_S16] = convert_s16_c;
+    converters[WM_OF_S24] = convert_s24_c;
+    converters[WM_OF_S32] = convert_s32_c;
+    converters[WM_OF_F32] = convert_f32_c;
+
+#if defined(WM_SIMD_X86)
+    if (wm_cpu_has_sse2()) {
+        converters[WM_OF_S16] = convert_s16_sse2;
+        converters[WM_OF_S24] = convert_s24_sse2;
+        converters[WM_OF_S32] = convert_s32_sse2;
+        converters[WM_OF_F32] = convert_f32_sse2;
+    }
+#elif defined(WM_SIMD_NEON)
+    converters[WM_OF_S16] = convert_s16_neon;
+    converters[WM_OF_S24] = convert_s24_neon;
+    converters[WM_OF_S32] = convert_s32_neon;
+    converters[WM_OF_F32] = convert_f32_neon;
+#endif
+}
+
+uint32_t _WM_convert_all(uint8_t format, _WM_Convert *converts, const char **names) {
+    static const _WM_Convert convert_c[4] = {
+        convert_s16_c, convert_s24_c, convert_s32_c, convert_f32_c
+    };
+#if defined(WM_SIMD_X86)
+    static const _WM_Convert convert_sse2[4] = {
+        convert_s16_sse2, convert_s24_sse2, convert_s32_sse2, convert_f32_sse2
+    };
+#elif defined(WM_SIMD_NEON)
+    static const _WM_Convert convert_neon[4] = {
+        convert_s16_neon, convert_s24_neon, convert_s32_neon, convert_f32_neon
+    };
+#endif
+    uint32_t count = 0;
+
+    if (format > WM_OF_F32) return (0);
+
+    converts[count] = convert_c[format];
+    names[count++] = "c";
+#if defined(WM_SIMD_X86)
+    if (wm_cpu_has_sse2()) {
+        converts[count] = convert_sse2[format];
+        names[count++] = "sse2";
+    }
+#elif defined(WM_SIMD_NEON)
+    converts[count] = convert_neon[format];
+    names[count++] = "neon";
+#endif
+    return (count);
+}
@@ -39,7 +39,7 @@
  Turns hmp file data into an event stream
  */
 struct _mdi *
-_WM_ParseNewHmi(const uint8_t *hmi_data, uint32_t hmi_size) {
+_WM_ParseNewHmi(struct _WM_Context *ctx, const uint8_t *hmi_data, uint32_t hmi_size) {
     uint32_t hmi_tmp = 0;
     const uint8_t *hmi_base = hmi_data;
     const uint8_t *data_end = hmi_data + hmi_size;
@@ -107,16 +107,16 @@ _WM_ParseNewHmi(const uint8_t *hmi_data, uint32_t hmi_size) {
         return NULL;
     }
 
-    hmi_mdi = _WM_initMDI();
+    hmi_mdi = _WM_initMDI(ctx);
 
     _WM_midi_setup_divisions(hmi_mdi, hmi_division);
 
-    if ((_WM_MixerOptions & WM_MO_ROUNDTEMPO)) {
+    if ((ctx->mixer_options & WM_MO_ROUNDTEMPO)) {
         tempo_f = (float) (60000000 / hmi_bpm) + 0.5f;
     } else {
         tempo_f = (float) (60000000 / hmi_bpm);
     }
-    samples_per_delta_f = _WM_GetSamplesPerTick(hmi_division, (uint32_t)tempo_f);
+    samples_per_delta_f = _WM_GetSamplesPerTick(hmi_division, (uint32_t)tempo_f, ctx->sample_rate);
 
     _WM_midi_setup_tempo(hmi_mdi, (uint32_t)tempo_f);
 
@@ -400,7 +400,7 @@ _WM_ParseNewHmi(const uint8_t *hmi_data, uint32_t hmi_size) {
         hmi_mdi->extra_info.approx_total_samples += sample_count;
     }
 
-    if ((hmi_mdi->reverb = _WM_init_reverb(_WM_SampleRate, _WM_reverb_room_width, _WM_reverb_room_length, _WM_reverb_listen_posx, _WM_reverb_listen_posy)) == NULL) {
+    if ((hmi_mdi->reverb = _WM_init_reverb(ctx->reverb_engine, ctx->sample_rate, ctx->reverb_room_width, ctx->reverb_room_length, ctx->reverb_listen_posx, ctx->reverb_listen_posy)) == NULL) {
         _WM_GLOBAL_ERROR(WM_ERR_MEM, NULL, 0);
         goto _hmi_end;
     }
@@ -408,7 +408,7 @@ _WM_ParseNewHmi(const uint8_t *hmi_data, uint32_t hmi_size) {
     hmi_mdi->extra_info.current_sample = 0;
     hmi_mdi->current_event = &hmi_mdi->events[0];
     hmi_mdi->samples_to_mix = 0;
-    hmi_mdi->note = NULL;
+    _WM_ClearVoices(hmi_mdi);
 
     _WM_ResetToStart(hmi_mdi);
 
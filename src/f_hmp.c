@@ -39,7 +39,7 @@
  Turns hmp file data into an event stream
  */
 struct _mdi *
-_WM_ParseNewHmp(const uint8_t *hmp_data, uint32_t hmp_size) {
+_WM_ParseNewHmp(struct _WM_Context *ctx, const uint8_t *hmp_data, uint32_t hmp_size) {
     uint8_t is_hmp2 = 0;
     uint32_t zero_cnt = 0;
     uint32_t i = 0;
@@ -154,13 +154,13 @@ _WM_ParseNewHmp(const uint8_t *hmp_data, uint32_t hmp_size) {
     }
 
     /* Slow but needed for accuracy */
-    if ((_WM_MixerOptions & WM_MO_ROUNDTEMPO)) {
+    if ((ctx->mixer_options & WM_MO_ROUNDTEMPO)) {
         tempo_f = (float) (60000000 / hmp_bpm) + 0.5f;
     } else {
         tempo_f = (float) (60000000 / hmp_bpm);
     }
 
-    samples_per_delta_f = _WM_GetSamplesPerTick(hmp_divisions, (uint32_t) tempo_f);
+    samples_per_delta_f = _WM_GetSamplesPerTick(hmp_divisions, (uint32_t) tempo_f, ctx->sample_rate);
 
     /* DEBUG */
     /* fprintf(stderr, "DEBUG: Samples Per Delta Tick: %f\r\n",samples_per_delta_f); */
@@ -185,7 +185,7 @@ _WM_ParseNewHmp(const uint8_t *hmp_data, uint32_t hmp_size) {
         hmp_size -= 712;
     }
 
-    hmp_mdi = _WM_initMDI();
+    hmp_mdi = _WM_initMDI(ctx);
 
     _WM_midi_setup_divisions(hmp_mdi, hmp_divisions);
     _WM_midi_setup_tempo(hmp_mdi, (uint32_t)tempo_f);
@@ -378,7 +378,7 @@ _WM_ParseNewHmp(const uint8_t *hmp_data, uint32_t hmp_size) {
         /* fprintf(stderr,"DEBUG: Sample Count %u\r\n",sample_count); */
     }
 
-    if ((hmp_mdi->reverb = _WM_init_reverb(_WM_SampleRate, _WM_reverb_room_width, _WM_reverb_room_length, _WM_reverb_listen_posx, _WM_reverb_listen_posy)) == NULL) {
+    if ((hmp_mdi->reverb = _WM_init_reverb(ctx->reverb_engine, ctx->sample_rate, ctx->reverb_room_width, ctx->reverb_room_length, ctx->reverb_listen_posx, ctx->reverb_listen_posy)) == NULL) {
         _WM_GLOBAL_ERROR(WM_ERR_MEM, NULL, 0);
         goto _hmp_end;
     }
@@ -386,7 +386,7 @@ _WM_ParseNewHmp(const uint8_t *hmp_data, uint32_t hmp_size) {
     hmp_mdi->extra_info.current_sample = 0;
     hmp_mdi->current_event = &hmp_mdi->events[0];
     hmp_mdi->samples_to_mix = 0;
-    hmp_mdi->note = NULL;
+    _WM_ClearVoices(hmp_mdi);
 
     _WM_ResetToStart(hmp_mdi);
 
@@ -38,7 +38,7 @@
 
 
 struct _mdi *
-_WM_ParseNewMidi(const uint8_t *midi_data, uint32_t midi_size) {
+_WM_ParseNewMidi(struct _WM_Context *ctx, const uint8_t *midi_data, uint32_t midi_size) {
     struct _mdi *mdi;
 
     uint32_t tmp_val;
@@ -141,9 +141,9 @@ _WM_ParseNewMidi(const uint8_t *midi_data, uint32_t midi_size) {
         return (NULL);
     }
 
-    samples_per_delta_f = _WM_GetSamplesPerTick(divisions, tempo);
+    samples_per_delta_f = _WM_GetSamplesPerTick(divisions, tempo, ctx->sample_rate);
 
-    mdi = _WM_initMDI();
+    mdi = _WM_initMDI(ctx);
     _WM_midi_setup_divisions(mdi,divisions);
 
     tracks = (const uint8_t **) malloc(sizeof(uint8_t *) * no_tracks);
@@ -297,7 +297,7 @@ _WM_ParseNewMidi(const uint8_t *midi_data, uint32_t midi_size) {
                             if (!tempo)
                                 tempo = 500000;
 
-                            samples_per_delta_f = _WM_GetSamplesPerTick(divisions, tempo);
+                            samples_per_delta_f = _WM_GetSamplesPerTick(divisions, tempo, ctx->sample_rate);
                         }
                     }
                     tracks[i] += setup_ret;
@@ -371,7 +371,7 @@ _WM_ParseNewMidi(const uint8_t *midi_data, uint32_t midi_size) {
                         if (!tempo)
                             tempo = 500000;
 
-                        samples_per_delta_f = _WM_GetSamplesPerTick(divisions, tempo);
+                        samples_per_delta_f = _WM_GetSamplesPerTick(divisions, tempo, ctx->sample_rate);
                     }
                 }
                 tracks[i] += setup_ret;
@@ -419,8 +419,8 @@ _WM_ParseNewMidi(const uint8_t *midi_data, uint32_t midi_size) {
         }
     }
 
-    if ((mdi->reverb = _WM_init_reverb(_WM_SampleRate, _WM_reverb_room_width,
-            _WM_reverb_room_length, _WM_reverb_listen_posx, _WM_reverb_listen_posy))
+    if ((mdi->reverb = _WM_init_reverb(ctx->reverb_engine, ctx->sample_rate, ctx->reverb_room_width,
+            ctx->reverb_room_length, ctx->reverb_listen_posx, ctx->reverb_listen_posy))
           == NULL) {
         _WM_GLOBAL_ERROR(WM_ERR_MEM, NULL, 0);
         goto _end;
@@ -429,7 +429,7 @@ _WM_ParseNewMidi(const uint8_t *midi_data, uint32_t midi_size) {
     mdi->extra_info.current_sample = 0;
     mdi->current_event = &mdi->events[0];
     mdi->samples_to_mix = 0;
-    mdi->note = NULL;
+    _WM_ClearVoices(mdi);
 
     _WM_ResetToStart(mdi);
 
@@ -480,7 +480,7 @@ _WM_Event2Midi(struct _mdi *mdi, uint8_t **out, uint32_t *outsize) {
         return -1;
     }
 
-    samples_per_tick = _WM_GetSamplesPerTick(divisions, tempo);
+    samples_per_tick = _WM_GetSamplesPerTick(divisions, tempo, mdi->ctx->sample_rate);
 
     /*
      Note: This isn't accurate but will allow enough space for
@@ -497,7 +497,7 @@ _WM_Event2Midi(struct _mdi *mdi, uint8_t **out, uint32_t *outsize) {
     (*out)[5] = 0x00;
     (*out)[6] = 0x00;
     (*out)[7] = 0x06;
-    if ((!(_WM_MixerOptions & WM_MO_SAVEASTYPE0)) && (mdi->is_type2)) {
+    if ((!(mdi->ctx->mixer_options & WM_MO_SAVEASTYPE0)) && (mdi->is_type2)) {
         /* Type 2 */
         (*out)[8] = 0x00;
         (*out)[9] = 0x02;
@@ -527,7 +527,7 @@ _WM_Event2Midi(struct _mdi *mdi, uint8_t **out, uint32_t *outsize) {
             divisions = event->event_data.data.value;
             (*out)[12] = (divisions >> 8) & 0xff;
             (*out)[13] = divisions & 0xff;
-            samples_per_tick = _WM_GetSamplesPerTick(divisions, tempo);
+            samples_per_tick = _WM_GetSamplesPerTick(divisions, tempo, mdi->ctx->sample_rate);
             break;
         case ev_note_off:
             /* DEBUG */
@@ -810,7 +810,7 @@ _WM_Event2Midi(struct _mdi *mdi, uint8_t **out, uint32_t *outsize) {
         case ev_meta_endoftrack:
             /* DEBUG */
             /* fprintf(stderr,"End Of Track\r\n"); */
-            if ((!(_WM_MixerOptions & WM_MO_SAVEASTYPE0)) && (mdi->is_type2)) {
+            if ((!(mdi->ctx->mixer_options & WM_MO_SAVEASTYPE0)) && (mdi->is_type2)) {
                 /* Write end of track marker */
                 (*out)[out_ofs++] = 0xff;
                 (*out)[out_ofs++] = 0x2f;
@@ -842,7 +842,7 @@ _WM_Event2Midi(struct _mdi *mdi, uint8_t **out, uint32_t *outsize) {
             /* fprintf(stderr,"Tempo: %u\r\n",event->event_data.data); */
             tempo = event->event_data.data.value & 0xffffff;
 
-            samples_per_tick = _WM_GetSamplesPerTick(divisions, tempo);
+            samples_per_tick = _WM_GetSamplesPerTick(divisions, tempo, mdi->ctx->sample_rate);
 
             /* DEBUG */
             /* fprintf(stderr,"\rDEBUG: div %i, tempo %i, bpm %f, pps %f, spd %f\r\n", divisions, tempo, bpm_f, pulses_per_second_f, samples_per_delta_f); */
@@ -997,7 +997,7 @@ _WM_Event2Midi(struct _mdi *mdi, uint8_t **out, uint32_t *outsize) {
         event++;
     } while (event->evtype != ev_null);
 
-    if ((_WM_MixerOptions & WM_MO_SAVEASTYPE0) || (!mdi->is_type2)) {
+    if ((mdi->ctx->mixer_options & WM_MO_SAVEASTYPE0) || (!mdi->is_type2)) {
         /* Write end of track marker */
         (*out)[out_ofs++] = 0xff;
         (*out)[out_ofs++] = 0x2f;
@@ -45,7 +45,7 @@
  Turns mus file data into an event stream.
  */
 struct _mdi *
-_WM_ParseNewMus(const uint8_t *mus_data, uint32_t mus_size) {
+_WM_ParseNewMus(struct _WM_Context *ctx, const uint8_t *mus_data, uint32_t mus_size) {
     uint8_t mus_hdr[] = { 'M', 'U', 'S', 0x1A };
     uint32_t mus_song_ofs = 0;
     uint32_t mus_song_len = 0;
@@ -119,16 +119,16 @@ _WM_ParseNewMus(const uint8_t *mus_data, uint32_t mus_size) {
     mus_freq = _cvt_get_option(WM_CO_FREQUENCY);
     if (mus_freq == 0) mus_freq = 140;
 
-    if ((_WM_MixerOptions & WM_MO_ROUNDTEMPO)) {
+    if ((ctx->mixer_options & WM_MO_ROUNDTEMPO)) {
         tempo_f = (float) (60000000 / mus_freq) + 0.5f;
     } else {
         tempo_f = (float) (60000000 / mus_freq);
     }
 
-    samples_per_tick_f = _WM_GetSamplesPerTick(mus_divisions, (uint32_t)tempo_f);
+    samples_per_tick_f = _WM_GetSamplesPerTick(mus_divisions, (uint32_t)tempo_f, ctx->sample_rate);
 
     /* initialise the mdi structure */
-    mus_mdi = _WM_initMDI();
+    mus_mdi = _WM_initMDI(ctx);
     _WM_midi_setup_divisions(mus_mdi, mus_divisions);
     _WM_midi_setup_tempo(mus_mdi, (uint32_t)tempo_f);
 
@@ -355,7 +355,7 @@ _WM_ParseNewMus(const uint8_t *mus_data, uint32_t mus_size) {
 
 _mus_end_of_song:
     /* Finalise mdi structure */
-    if ((mus_mdi->reverb = _WM_init_reverb(_WM_SampleRate, _WM_reverb_room_width, _WM_reverb_room_length, _WM_reverb_listen_posx, _WM_reverb_listen_posy)) == NULL) {
+    if ((mus_mdi->reverb = _WM_init_reverb(ctx->reverb_engine, ctx->sample_rate, ctx->reverb_room_width, ctx->reverb_room_length, ctx->reverb_listen_posx, ctx->reverb_listen_posy)) == NULL) {
         _WM_GLOBAL_ERROR(WM_ERR_MEM, NULL, 0);
         goto _mus_end;
     }
@@ -363,7 +363,7 @@ _mus_end_of_song:
     mus_mdi->extra_info.current_sample = 0;
     mus_mdi->current_event = &mus_mdi->events[0];
     mus_mdi->samples_to_mix = 0;
-    mus_mdi->note = NULL;
+    _WM_ClearVoices(mus_mdi);
 
     _WM_ResetToStart(mus_mdi);
 
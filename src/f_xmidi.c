@@ -36,7 +36,7 @@
 #include "f_xmidi.h"
 
 
-struct _mdi *_WM_ParseNewXmi(const uint8_t *xmi_data, uint32_t xmi_size) {
+struct _mdi *_WM_ParseNewXmi(struct _WM_Context *ctx, const uint8_t *xmi_data, uint32_t xmi_size) {
     struct _mdi *xmi_mdi = NULL;
     uint32_t xmi_tmpdata = 0;
     uint8_t xmi_formcnt = 0;
@@ -131,11 +131,11 @@ struct _mdi *_WM_ParseNewXmi(const uint8_t *xmi_data, uint32_t xmi_size) {
     xmi_data += 4;
     xmi_size -= 4;
 
-    xmi_mdi = _WM_initMDI();
+    xmi_mdi = _WM_initMDI(ctx);
     _WM_midi_setup_divisions(xmi_mdi, xmi_divisions);
     _WM_midi_setup_tempo(xmi_mdi, xmi_tempo);
 
-    xmi_samples_per_delta_f = _WM_GetSamplesPerTick(xmi_divisions, xmi_tempo);
+    xmi_samples_per_delta_f = _WM_GetSamplesPerTick(xmi_divisions, xmi_tempo, ctx->sample_rate);
 
     xmi_notelen = (uint32_t *) malloc(sizeof(uint32_t) * 16 * 128);
     memset(xmi_notelen, 0, (sizeof(uint32_t) * 16 * 128));
@@ -329,14 +329,14 @@ struct _mdi *_WM_ParseNewXmi(const uint8_t *xmi_data, uint32_t xmi_size) {
     }
 
     /* Finalise mdi structure */
-    if ((xmi_mdi->reverb = _WM_init_reverb(_WM_SampleRate, _WM_reverb_room_width, _WM_reverb_room_length, _WM_reverb_listen_posx, _WM_reverb_listen_posy)) == NULL) {
+    if ((xmi_mdi->reverb = _WM_init_reverb(ctx->reverb_engine, ctx->sample_rate, ctx->reverb_room_width, ctx->reverb_room_length, ctx->reverb_listen_posx, ctx->reverb_listen_posy)) == NULL) {
         _WM_GLOBAL_ERROR(WM_ERR_MEM, NULL, 0);
         goto _xmi_end;
     }
     xmi_mdi->extra_info.current_sample = 0;
     xmi_mdi->current_event = &xmi_mdi->events[0];
     xmi_mdi->samples_to_mix = 0;
-    xmi_mdi->note = NULL;
+    _WM_ClearVoices(xmi_mdi);
     /* More than 1 event form in XMI means treat as type 2 */
     if (xmi_evnt_cnt > 1) {
         xmi_mdi->is_type2 = 1;
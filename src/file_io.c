@@ -65,6 +65,9 @@
 #endif
 #include <unistd.h>
 #endif
+#if defined(HAVE_SYS_MMAN_H) && !defined(_WIN32)
+#include <sys/mman.h>
+#endif
 
 #if !defined(O_BINARY)
 # if defined(_O_BINARY)
@@ -75,6 +78,7 @@
 #endif
 
 #include "wm_error.h"
+#include "lock.h"
 #include "file_io.h"
 void* (*_WM_BufferFile)(const char *, uint32_t *) = _WM_BufferFileImpl;
 void  (*_WM_FreeBufferFile)(void*)                = _WM_FreeBufferFileImpl;
@@ -323,3 +327,206 @@ void *_WM_BufferFileImpl(const char *filename, uint32_t *size) {
 void _WM_FreeBufferFileImpl(void *buf) {
     free(buf);
 }
+
+/*
+ * Maps the whole of filename. A private map is copy on write, so the
+ * caller can change what it got like it could a buffer, everything it
+ * doesn't change stays shared with the page cache.
+ */
+#if defined(_WIN32)
+static int map_file(const char *filename, struct _WM_Map *map, int private_map) {
+    HANDLE file;
+    HANDLE mapping;
+    DWORD high = 0;
+    DWORD size;
+
+    file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL,
+                       OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        return (-1);
+    }
+    size = GetFileSize(file, &high);
+    if ((size == INVALID_FILE_SIZE) || (high != 0)
+            || (size == 0) || (size > WM_MAXFILESIZE)) {
+        CloseHandle(file);
+        return (-1);
+    }
+    mapping = CreateFileMappingA(file, NULL, (private_map) ? PAGE_WRITECOPY : PAGE_READONLY,
+                                 0, 0, NULL);
+    CloseHandle(file);
+    if (mapping == NULL) {
+        return (-1);
+    }
+    /* the view keeps the mapping open */
+    map->data = (uint8_t *) MapViewOfFile(mapping, (private_map) ? FILE_MAP_COPY : FILE_MAP_READ,
+                                          0, 0, 0);
+    CloseHandle(mapping);
+    if (map->data == NULL) {
+        return (-1);
+    }
+    map->size = size;
+    return (0);
+}
+
+static void unmap_file(struct _WM_Map *map) {
+    UnmapViewOfFile(map->data);
+}
+
+static uint32_t page_size(void) {
+    SYSTEM_INFO info;
+
+    GetSystemInfo(&info);
+    return (info.dwPageSize);
+}
+#elif defined(HAVE_SYS_MMAN_H)
+static int map_file(const char *filename, struct _WM_Map *map, int private_map) {
+    struct stat st;
+    void *data;
+    int fd;
+
+    if ((fd = open(filename, (O_RDONLY | O_BINARY))) == -1) {
+        return (-1);
+    }
+    if ((fstat(fd, &st) != 0) || (st.st_size == 0) || (st.st_size > WM_MAXFILESIZE)) {
+        close(fd);
+        return (-1);
+    }
+    data = mmap(NULL, (size_t) st.st_size, (private_map) ? (PROT_READ | PROT_WRITE) : PROT_READ,
+                MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        return (-1);
+    }
+    map->data = (uint8_t *) data;
+    map->size = (uint32_t) st.st_size;
+    return (0);
+}
+
+static void unmap_file(struct _WM_Map *map) {
+    munmap(map->data, map->size);
+}
+
+static uint32_t page_size(void) {
+    long size = sysconf(_SC_PAGESIZE);
+
+    return ((size > 0) ? (uint32_t) size : 4096);
+}
+#endif
+
+#if defined(_WIN32) || defined(HAVE_SYS_MMAN_H)
+/* what _WM_MapBufferFile handed out, so it can be found again */
+static struct _WM_Map *mapped_files = NULL;
+static int mapped_lock = 0;
+#endif
+
+void *_WM_MapBufferFile(const char *filename, uint32_t *size) {
+#if defined(_WIN32) || defined(HAVE_SYS_MMAN_H)
+    struct _WM_Map *map = (struct _WM_Map *) malloc(sizeof(struct _WM_Map));
+
+    if ((map != NULL) && (map_file(filename, map, 1) == 0)) {
+        /*
+         * Callers may write the byte after the end, which is fine as long
+         * as the last page has room for it. Otherwise there is no page to
+         * write to, so the file is read in instead.
+         */
+        if ((map->size % page_size()) != 0) {
+            map->mapped = 1;
+            map->lock = 0;
+            map->refs = 1;
+            _WM_Lock(&mapped_lock);
+            map->next = mapped_files;
+            mapped_files = map;
+            _WM_Unlock(&mapped_lock);
+            *size = map->size;
+            return (map->data);
+        }
+        unmap_file(map);
+    }
+    free(map);
+#endif
+    return (_WM_BufferFileImpl(filename, size));
+}
+
+void _WM_UnmapBufferFile(void *data) {
+#if defined(_WIN32) || defined(HAVE_SYS_MMAN_H)
+    struct _WM_Map **link;
+    struct _WM_Map *map = NULL;
+
+    _WM_Lock(&mapped_lock);
+    for (link = &mapped_files; *link != NULL; link = &(*link)->next) {
+        if ((*link)->data == data) {
+            map = *link;
+            *link = map->next;
+            break;
+        }
+    }
+    _WM_Unlock(&mapped_lock);
+    if (map != NULL) {
+        _WM_UnrefMap(map);
+        return;
+    }
+#endif
+    _WM_FreeBufferFileImpl(data);
+}
+
+#if defined(_WIN32) || defined(HAVE_SYS_MMAN_H)
+/* whether files can be mapped behind the back of the VIO in use */
+static int vio_maps(void) {
+    return ((_WM_BufferFile == _WM_BufferFileImpl)
+            || (_WM_BufferFile == _WM_MapBufferFile));
+}
+#endif
+
+struct _WM_Map *_WM_MapFile(const char *filename) {
+    struct _WM_Map *map = (struct _WM_Map *) malloc(sizeof(struct _WM_Map));
+
+    if (map == NULL) {
+        _WM_GLOBAL_ERROR(WM_ERR_MEM, NULL, errno);
+        return (NULL);
+    }
+    map->lock = 0;
+    map->refs = 1;
+    map->next = NULL;
+
+#if defined(_WIN32) || defined(HAVE_SYS_MMAN_H)
+    /* anything odd is left to _WM_BufferFile, which sets the error */
+    if (vio_maps() && (map_file(filename, map, 0) == 0)) {
+        map->mapped = 1;
+        return (map);
+    }
+#endif
+    map->mapped = 0;
+    map->data = (uint8_t *) _WM_BufferFile(filename, &map->size);
+    if (map->data == NULL) {
+        free(map);
+        return (NULL);
+    }
+    return (map);
+}
+
+void _WM_RefMap(struct _WM_Map *map) {
+    _WM_Lock(&map->lock);
+    map->refs++;
+    _WM_Unlock(&map->lock);
+}
+
+void _WM_UnrefMap(struct _WM_Map *map) {
+    uint32_t refs;
+
+    _WM_Lock(&map->lock);
+    refs = --map->refs;
+    _WM_Unlock(&map->lock);
+    if (refs != 0) {
+        return;
+    }
+
+#if defined(_WIN32) || defined(HAVE_SYS_MMAN_H)
+    if (map->mapped) {
+        unmap_file(map);
+        free(map);
+        return;
+    }
+#endif
+    _WM_FreeBufferFile(map->data);
+    free(map);
+}
@@ -64,7 +64,7 @@ static int convert_8s(uint8_t *data, struct _sample *gus_sample) {
     int16_t *write_data = NULL;
 
     SAMPLE_CONVERT_DEBUG(_WM_FUNCTION);
-    gus_sample->data = (int16_t *) calloc((gus_sample->data_length + 2), sizeof(int16_t));
+    gus_sample->data = _WM_alloc_sample_data(gus_sample->data_length);
     if (__builtin_expect((gus_sample->data != NULL), 1)) {
         write_data = gus_sample->data;
         do {
@@ -91,7 +91,7 @@ static int convert_8sp(uint8_t *data, struct _sample *gus_sample) {
     int16_t *write_data_b = NULL;
 
     SAMPLE_CONVERT_DEBUG(_WM_FUNCTION);
-    gus_sample->data = (int16_t *) calloc((new_length + 2), sizeof(int16_t));
+    gus_sample->data = _WM_alloc_sample_data(new_length);
     if (__builtin_expect((gus_sample->data != NULL), 1)) {
         write_data = gus_sample->data;
         while (read_data < read_end) {
@@ -136,7 +136,7 @@ static int convert_8sr(uint8_t *data, struct _sample *gus_sample) {
     uint32_t tmp_loop = 0;
 
     SAMPLE_CONVERT_DEBUG(_WM_FUNCTION);
-    gus_sample->data = (int16_t *) calloc((gus_sample->data_length + 2), sizeof(int16_t));
+    gus_sample->data = _WM_alloc_sample_data(gus_sample->data_length);
     if (__builtin_expect((gus_sample->data != NULL), 1)) {
         write_data = gus_sample->data + gus_sample->data_length - 1;
         do {
@@ -167,7 +167,7 @@ static int convert_8srp(uint8_t *data, struct _sample *gus_sample) {
     int16_t *write_data_b = NULL;
 
     SAMPLE_CONVERT_DEBUG(_WM_FUNCTION);
-    gus_sample->data = (int16_t *) calloc((new_length + 2), sizeof(int16_t));
+    gus_sample->data = _WM_alloc_sample_data(new_length);
     if (__builtin_expect((gus_sample->data != NULL), 1)) {
         write_data = gus_sample->data;
         do {
@@ -212,7 +212,7 @@ static int convert_8u(uint8_t *data, struct _sample *gus_sample) {
     int16_t *write_data = NULL;
 
     SAMPLE_CONVERT_DEBUG(_WM_FUNCTION);
-    gus_sample->data = (int16_t *) calloc((gus_sample->data_length + 2), sizeof(int16_t));
+    gus_sample->data = _WM_alloc_sample_data(gus_sample->data_length);
     if (__builtin_expect((gus_sample->data != NULL), 1)) {
         write_data = gus_sample->data;
         do {
@@ -238,7 +238,7 @@ static int convert_8up(uint8_t *data, struct _sample *gus_sample) {
     int16_t *write_data_b = NULL;
 
     SAMPLE_CONVERT_DEBUG(_WM_FUNCTION);
-    gus_sample->data = (int16_t *) calloc((new_length + 2), sizeof(int16_t));
+    gus_sample->data = _WM_alloc_sample_data(new_length);
     if (__builtin_expect((gus_sample->data != NULL), 1)) {
         write_data = gus_sample->data;
         while (read_data < read_end) {
@@ -284,7 +284,7 @@ static int convert_8ur(uint8_t *data, struct _sample *gus_sample) {
     uint32_t tmp_loop = 0;
 
     SAMPLE_CONVERT_DEBUG(_WM_FUNCTION);
-    gus_sample->data = (int16_t *) calloc((gus_sample->data_length + 2), sizeof(int16_t));
+    gus_sample->data = _WM_alloc_sample_data(gus_sample->data_length);
     if (__builtin_expect((gus_sample->data != NULL), 1)) {
         write_data = gus_sample->data + gus_sample->data_length - 1;
         do {
@@ -315,7 +315,7 @@ static int convert_8urp(uint8_t *data, struct _sample *gus_sample) {
     int16_t *write_data_b = NULL;
 
     SAMPLE_CONVERT_DEBUG(_WM_FUNCTION);
-    gus_sample->data = (int16_t *) calloc((new_length + 2), sizeof(int16_t));
+    gus_sample->data = _WM_alloc_sample_data(new_length);
     if (__builtin_expect((gus_sample->data != NULL), 1)) {
         write_data = gus_sample->data;
         do {
@@ -354,18 +354,29 @@ static int convert_8urp(uint8_t *data, struct _sample *gus_sample) {
 
 /* 16bit signed */
 static int convert_16s(uint8_t *data, struct _sample *gus_sample) {
+#ifdef WORDS_BIGENDIAN
     uint8_t *read_data = data;
     uint8_t *read_end = data + gus_sample->data_length;
     int16_t *write_data = NULL;
+#endif
 
     SAMPLE_CONVERT_DEBUG(_WM_FUNCTION);
-    gus_sample->data = (int16_t *) calloc(((gus_sample->data_length >> 1) + 2), sizeof(int16_t));
+    gus_sample->data = _WM_alloc_sample_data(gus_sample->data_length >> 1);
     if (__builtin_expect((gus_sample->data != NULL), 1)) {
+#ifndef WORDS_BIGENDIAN
+        /*
+         * Already in the right format, but the data sits at an odd offset
+         * in every GF1 file and needs zeroed guard samples either side, so
+         * it can't be used in place. Patch banks can, see bank.c.
+         */
+        memcpy(gus_sample->data, data, gus_sample->data_length & ~1U);
+#else
         write_data = gus_sample->data;
         do {
             *write_data = *read_data++;
             *write_data++ |= (*read_data++) << 8;
         } while (read_data < read_end);
+#endif
 
         gus_sample->loop_start >>= 1;
         gus_sample->loop_end >>= 1;
@@ -389,7 +400,7 @@ static int convert_16sp(uint8_t *data, struct _sample *gus_sample) {
     int16_t *write_data_b = NULL;
 
     SAMPLE_CONVERT_DEBUG(_WM_FUNCTION);
-    gus_sample->data = (int16_t *) calloc(((new_length >> 1) + 2), sizeof(int16_t));
+    gus_sample->data = _WM_alloc_sample_data(new_length >> 1);
     if (__builtin_expect((gus_sample->data != NULL), 1)) {
         write_data = gus_sample->data;
         do {
@@ -444,7 +455,7 @@ static int convert_16sr(uint8_t *data, struct _sample *gus_sample) {
     uint32_t tmp_loop = 0;
 
     SAMPLE_CONVERT_DEBUG(_WM_FUNCTION);
-    gus_sample->data = (int16_t *) calloc(((gus_sample->data_length >> 1) + 2), sizeof(int16_t));
+    gus_sample->data = _WM_alloc_sample_data(gus_sample->data_length >> 1);
     if (__builtin_expect((gus_sample->data != NULL), 1)) {
         write_data = gus_sample->data + (gus_sample->data_length >> 1) - 1;
         do {
@@ -479,7 +490,7 @@ static int convert_16srp(uint8_t *data, struct _sample *gus_sample) {
     int16_t *write_data_b = NULL;
 
     SAMPLE_CONVERT_DEBUG(_WM_FUNCTION);
-    gus_sample->data = (int16_t *) calloc(((new_length >> 1) + 2), sizeof(int16_t));
+    gus_sample->data = _WM_alloc_sample_data(new_length >> 1);
     if (__builtin_expect((gus_sample->data != NULL), 1)) {
         write_data = gus_sample->data;
         do {
@@ -528,7 +539,7 @@ static int convert_16u(uint8_t *data, struct _sample *gus_sample) {
     int16_t *write_data = NULL;
 
     SAMPLE_CONVERT_DEBUG(_WM_FUNCTION);
-    gus_sample->data = (int16_t *) calloc(((gus_sample->data_length >> 1) + 2), sizeof(int16_t));
+    gus_sample->data = _WM_alloc_sample_data(gus_sample->data_length >> 1);
     if (__builtin_expect((gus_sample->data != NULL), 1)) {
         write_data = gus_sample->data;
         do {
@@ -558,7 +569,7 @@ static int convert_16up(uint8_t *data, struct _sample *gus_sample) {
     int16_t *write_data_b = NULL;
 
     SAMPLE_CONVERT_DEBUG(_WM_FUNCTION);
-    gus_sample->data = (int16_t *) calloc(((new_length >> 1) + 2), sizeof(int16_t));
+    gus_sample->data = _WM_alloc_sample_data(new_length >> 1);
     if (__builtin_expect((gus_sample->data != NULL), 1)) {
         write_data = gus_sample->data;
         do {
@@ -613,7 +624,7 @@ static int convert_16ur(uint8_t *data, struct _sample *gus_sample) {
     uint32_t tmp_loop = 0;
 
     SAMPLE_CONVERT_DEBUG(_WM_FUNCTION);
-    gus_sample->data = (int16_t *) calloc(((gus_sample->data_length >> 1) + 2), sizeof(int16_t));
+    gus_sample->data = _WM_alloc_sample_data(gus_sample->data_length >> 1);
     if (__builtin_expect((gus_sample->data != NULL), 1)) {
         write_data = gus_sample->data + (gus_sample->data_length >> 1) - 1;
         do {
@@ -648,7 +659,7 @@ static int convert_16urp(uint8_t *data, struct _sample *gus_sample) {
     int16_t *write_data_b = NULL;
 
     SAMPLE_CONVERT_DEBUG(_WM_FUNCTION);
-    gus_sample->data = (int16_t *) calloc(((new_length >> 1) + 2), sizeof(int16_t));
+    gus_sample->data = _WM_alloc_sample_data(new_length >> 1);
     if (__builtin_expect((gus_sample->data != NULL), 1)) {
         write_data = gus_sample->data;
         do {
@@ -692,7 +703,7 @@ static int convert_16urp(uint8_t *data, struct _sample *gus_sample) {
 
 /* sample loading */
 
-struct _sample * _WM_load_gus_pat(const char *filename, int fix_release) {
+struct _sample * _WM_load_gus_pat(const char *filename, int fix_release, uint16_t rate) {
     uint8_t *gus_patch;
     uint32_t gus_size;
     uint32_t gus_ptr;
@@ -772,6 +783,7 @@ struct _sample * _WM_load_gus_pat(const char *filename, int fix_release) {
         }
 
         gus_sample->next = NULL;
+        gus_sample->map = NULL;
         gus_sample->loop_fraction = gus_patch[gus_ptr + 7];
         gus_sample->data_length = (gus_patch[gus_ptr + 11] << 24)
                                 | (gus_patch[gus_ptr + 10] << 16)
@@ -848,26 +860,26 @@ struct _sample * _WM_load_gus_pat(const char *filename, int fix_release) {
                 gus_sample->env_target[i] = 16448 * gus_patch[gus_ptr + 43 + i];
                 GUSPAT_INT_DEBUG("Envelope Level",gus_patch[gus_ptr+43+i]); GUSPAT_FLOAT_DEBUG("Envelope Time",env_time_table[env_rate]);
                 gus_sample->env_rate[i] = (int32_t) (4194303.0f
-                        / ((float) _WM_SampleRate * env_time_table[env_rate]));
+                        / ((float) rate * env_time_table[env_rate]));
                 GUSPAT_INT_DEBUG("Envelope Rate",gus_sample->env_rate[i]); GUSPAT_INT_DEBUG("GUSPAT Rate",env_rate);
                 if (gus_sample->env_rate[i] == 0) {
                     _WM_DEBUG_MSG("%s: Warning: found invalid envelope(%u) rate setting in %s. Using %f instead.",
                                   _WM_FUNCTION, i, filename, env_time_table[63]);
                     gus_sample->env_rate[i] = (int32_t) (4194303.0f
-                            / ((float) _WM_SampleRate * env_time_table[63]));
+                            / ((float) rate * env_time_table[63]));
                     GUSPAT_FLOAT_DEBUG("Envelope Time",env_time_table[63]);
                 }
             } else {
                 gus_sample->env_target[i] = 4194303;
                 gus_sample->env_rate[i] = (int32_t) (4194303.0f
-                        / ((float) _WM_SampleRate * env_time_table[63]));
+                        / ((float) rate * env_time_table[63]));
                 GUSPAT_FLOAT_DEBUG("Envelope Time",env_time_table[63]);
             }
         }
 
         gus_sample->env_target[6] = 0;
         gus_sample->env_rate[6] = (int32_t) (4194303.0f
-                / ((float) _WM_SampleRate * env_time_table[63]));
+                / ((float) rate * env_time_table[63]));
 
         gus_ptr += 96;
         tmp_cnt = gus_sample->data_length;
@@ -902,7 +914,7 @@ struct _sample * _WM_load_gus_pat(const char *filename, int fix_release) {
             gus_sample->note_off_decay = (uint32_t)samples_f;
 
         } else {
-            gus_sample->note_off_decay = gus_sample->data_length * _WM_SampleRate / gus_sample->rate;
+            gus_sample->note_off_decay = gus_sample->data_length * rate / gus_sample->rate;
         }
 
         gus_ptr += tmp_cnt;
@@ -37,6 +37,7 @@
 #include "wildmidi_lib.h"
 #include "patches.h"
 #include "internal_midi.h"
+#include "resample.h"
 
 #define HOLD_OFF 0x02
 
@@ -407,10 +408,10 @@ void _WM_DynamicVolumeAdjust(struct _mdi *mdi, int32_t *tmp_buffer, uint32_t buf
             if (volume != volume_to_reach) {
                 if (volume_to_reach == MAX_DYN_VOL) {
                     /* if we want normal volume then adjust to it slower */
-                    volume_adjust = (volume_to_reach - volume) / ((double)_WM_SampleRate * 0.1);
+                    volume_adjust = (volume_to_reach - volume) / ((double)mdi->ctx->sample_rate * 0.1);
                 } else {
                     /* if we want to clamp the volume then adjust quickly */
-                    volume_adjust = (volume_to_reach - volume) / ((double)_WM_SampleRate * 0.0001);
+                    volume_adjust = (volume_to_reach - volume) / ((double)mdi->ctx->sample_rate * 0.0001);
                 }
             }
         }
@@ -484,7 +485,7 @@ void _WM_AdjustNoteVolumes(struct _mdi *mdi, uint8_t ch, struct _note *nte) {
      FIXME: Still needs tuning. Clipping heard at a value of 3.75
      */
 #define VOL_DIVISOR 4.0
-    volume_adj = ((double)_WM_MasterVolume / 1024.0) / VOL_DIVISOR;
+    volume_adj = ((double)mdi->ctx->master_volume / 1024.0) / VOL_DIVISOR;
 
     MIDI_EVENT_DEBUG(_WM_FUNCTION,ch, 0);
 
@@ -508,31 +509,275 @@ void _WM_AdjustNoteVolumes(struct _mdi *mdi, uint8_t ch, struct _note *nte) {
     }
     nte->left_mix_volume = (int32_t)(premix_left * 1024.0);
     nte->right_mix_volume = (int32_t)(premix_right * 1024.0);
+    nte->mono_mix_volume = (int32_t)((premix_left + premix_right) * 512.0);
+    nte->left_gain = (float)premix_left;
+    nte->right_gain = (float)premix_right;
+    nte->mono_gain = (float)((premix_left + premix_right) * 0.5);
 }
 
 /* Should be called in any function that effects channel volumes */
 /* Calling this function with a value > 15 will make it adjust notes on all channels */
 void _WM_AdjustChannelVolumes(struct _mdi *mdi, uint8_t ch) {
-    struct _note *nte = mdi->note;
-    if (nte != NULL) {
-        do {
-            if (ch <= 15) {
-                if ((nte->noteid >> 8) == ch) {
-                    goto _DO_ADJUST;
-                }
-            } else {
-            _DO_ADJUST:
-                if (!nte->ignore_chan_events) {
-                    _WM_AdjustNoteVolumes(mdi, ch, nte);
-                    if (nte->replay) _WM_AdjustNoteVolumes(mdi, ch, nte->replay);
-                }
-            }
-            nte = nte->next;
-        } while (nte != NULL);
+    struct _voices *voices = (ch <= 15) ? &mdi->channel[ch].voices : &mdi->voices;
+    struct _note *nte;
+    uint32_t i;
+
+    for (i = 0; i < voices->count; i++) {
+        nte = voices->note[i];
+        if (!nte->ignore_chan_events) {
+            _WM_AdjustNoteVolumes(mdi, ch, nte);
+            if (nte->replay) _WM_AdjustNoteVolumes(mdi, ch, nte->replay);
+        }
+    }
+}
+
+#define NOTE_BLOCK 32
+
+/* one note and its replay for every key of every channel */
+#define MAX_NOTES (16 * 128 * 2)
+
+/* add a block of notes to the pool, returns -1 if out of memory */
+static int grow_notes(struct _mdi *mdi) {
+    struct _note *nte;
+    void **blocks;
+    uint8_t *block;
+    uint32_t i;
+
+    blocks = (void **) realloc(mdi->note_blocks, (mdi->note_block_count + 1) * sizeof(void *));
+    if (blocks == NULL) return (-1);
+    mdi->note_blocks = blocks;
+    block = (uint8_t *) calloc(1, NOTE_BLOCK * sizeof(struct _note) + 63);
+    if (block == NULL) return (-1);
+    mdi->note_blocks[mdi->note_block_count++] = block;
+
+    nte = (struct _note *) (block + ((64 - ((uintptr_t) block & 63)) & 63));
+    for (i = 0; i < NOTE_BLOCK; i++) {
+        nte[i].replay = mdi->free_notes;
+        mdi->free_notes = &nte[i];
+    }
+    return (0);
+}
+
+/* take a note from the pool, returns NULL if the pool can't grow */
+static struct _note *alloc_note(struct _mdi *mdi) {
+    struct _note *nte;
+
+    if ((mdi->free_notes == NULL) && (grow_notes(mdi) != 0)) {
+        return (NULL);
+    }
+
+    nte = mdi->free_notes;
+    mdi->free_notes = nte->replay;
+    nte->replay = NULL;
+    return (nte);
+}
+
+static void free_note(struct _mdi *mdi, struct _note *nte) {
+    nte->active = 0;
+    nte->replay = mdi->free_notes;
+    mdi->free_notes = nte;
+}
+
+/*
+ * The note playing on a channel's key, there is never more than one, or
+ * with active 0 the key's note 0 that sound off let play on.
+ */
+static struct _note *find_note(struct _mdi *mdi, uint8_t ch, uint8_t note, uint8_t active) {
+    struct _voices *voices = &mdi->channel[ch].voices;
+    uint16_t noteid = (ch << 8) | note;
+    struct _note *nte;
+    uint32_t i;
+
+    for (i = 0; i < voices->count; i++) {
+        nte = voices->note[i];
+        if ((nte->noteid == noteid) && (nte->active == active)
+            && (active || (nte->turn == 0)))
+            return (nte);
+    }
+    return (NULL);
+}
+
+/* whether a note on for the note's key has to wait until it is let go */
+static int note_blocks(struct _note *nte) {
+    return ((nte->modes & SAMPLE_ENVELOPE) && (nte->env < 3)
+            && (!(nte->hold & HOLD_OFF)));
+}
+
+static int voices_grow(struct _voices *voices) {
+    struct _note **note;
+    uint32_t size = (voices->size) ? (voices->size * 2) : 16;
+
+    note = (struct _note **) realloc(voices->note, size * sizeof(struct _note *));
+    if (note == NULL) return (-1);
+    voices->note = note;
+    voices->size = size;
+    return (0);
+}
+
+/*
+ * Grows the note pool and the voice lists as far as playing can ever take
+ * them, so that no note on allocates from then on. Returns -1 if out of
+ * memory, with whatever was reserved up to then kept.
+ */
+int _WM_ReserveVoices(struct _mdi *mdi) {
+    uint32_t i;
+
+    while ((mdi->note_block_count * NOTE_BLOCK) < MAX_NOTES) {
+        if (grow_notes(mdi) != 0) return (-1);
+    }
+    while (mdi->voices.size < (16 * 128)) {
+        if (voices_grow(&mdi->voices) != 0) return (-1);
+    }
+    for (i = 0; i < 16; i++) {
+        while (mdi->channel[i].voices.size < 128) {
+            if (voices_grow(&mdi->channel[i].voices) != 0) return (-1);
+        }
+    }
+    return (0);
+}
+
+/* start mixing a new note, returns NULL if there is no room for it */
+static struct _note *add_voice(struct _mdi *mdi, uint8_t ch) {
+    struct _voices *chan_voices = &mdi->channel[ch].voices;
+    struct _note *nte;
+
+    if (mdi->voices.count == mdi->voices.size && voices_grow(&mdi->voices) != 0)
+        return (NULL);
+    if (chan_voices->count == chan_voices->size && voices_grow(chan_voices) != 0)
+        return (NULL);
+    if ((nte = alloc_note(mdi)) == NULL)
+        return (NULL);
+
+    nte->voice_idx = mdi->voices.count;
+    mdi->voices.note[mdi->voices.count++] = nte;
+    nte->chan_idx = chan_voices->count;
+    chan_voices->note[chan_voices->count++] = nte;
+    nte->active = 1;
+    return (nte);
+}
+
+/* stop mixing a note and give it back to the pool, the last note of each list takes its slot */
+void _WM_RemoveVoice(struct _mdi *mdi, struct _note *nte) {
+    struct _voices *chan_voices = &mdi->channel[nte->noteid >> 8].voices;
+    struct _note *last;
+
+    last = mdi->voices.note[--mdi->voices.count];
+    mdi->voices.note[nte->voice_idx] = last;
+    last->voice_idx = nte->voice_idx;
+
+    last = chan_voices->note[--chan_voices->count];
+    chan_voices->note[nte->chan_idx] = last;
+    last->chan_idx = nte->chan_idx;
+
+    if (nte->stolen) mdi->stolen_voices--;
+    if (nte->replay) free_note(mdi, nte->replay);
+    free_note(mdi, nte);
+}
+
+/* swap a finished note for its replay note, which is always on the same channel */
+void _WM_ReplaceVoice(struct _mdi *mdi, struct _note *nte) {
+    struct _note *replay = nte->replay;
+
+    replay->voice_idx = nte->voice_idx;
+    replay->chan_idx = nte->chan_idx;
+    mdi->voices.note[nte->voice_idx] = replay;
+    mdi->channel[nte->noteid >> 8].voices.note[nte->chan_idx] = replay;
+    replay->active = 1;
+    if (replay->turn) replay->turn0_blocks = note_blocks(nte);
+
+    if (nte->stolen) mdi->stolen_voices--;
+    free_note(mdi, nte);
+}
+
+void _WM_ClearVoices(struct _mdi *mdi) {
+    struct _note *nte;
+    uint32_t i;
+
+    for (i = 0; i < mdi->voices.count; i++) {
+        nte = mdi->voices.note[i];
+        if (nte->replay) free_note(mdi, nte->replay);
+        free_note(mdi, nte);
+    }
+    mdi->voices.count = 0;
+    mdi->stolen_voices = 0;
+    for (i = 0; i < 16; i++) {
+        mdi->channel[i].voices.count = 0;
     }
 }
 
-float _WM_GetSamplesPerTick(uint32_t divisions, uint32_t tempo) {
+/*
+ * Voice stealing. Notes already fading out go first, then notes in their
+ * release, then held ones, with drums kept over other notes in the same
+ * stage as a cut off hit is the more noticeable. After that the quieter
+ * and then the older note goes.
+ */
+static int steal_rank(struct _mdi *mdi, struct _note *nte) {
+    int rank;
+
+    if (nte->env == 6) {
+        rank = 0;
+    } else if ((nte->env >= 4) || nte->is_off) {
+        rank = 2;
+    } else {
+        rank = 4;
+    }
+    if (mdi->channel[nte->noteid >> 8].isdrum) rank++;
+    return (rank);
+}
+
+static int steal_before(struct _mdi *mdi, struct _note *a, struct _note *b) {
+    int rank_a = steal_rank(mdi, a);
+    int rank_b = steal_rank(mdi, b);
+
+    if (rank_a != rank_b) return (rank_a < rank_b);
+    if (a->env_level != b->env_level) return (a->env_level < b->env_level);
+    /* wraps, but only matters between notes started close together */
+    return ((int32_t) (a->started - b->started) < 0);
+}
+
+/*
+ * Makes room for one more voice within max_voices. The voice stolen fades
+ * out with the same short release as a note being restarted, and anything
+ * waiting to replay on it is dropped. If as many voices are fading out
+ * already, the quietest of those is cut off first so the total stays
+ * within twice max_voices.
+ */
+static void steal_voice(struct _mdi *mdi) {
+    struct _note *victim = NULL;
+    struct _note *nte;
+    uint32_t i;
+
+    if (mdi->stolen_voices >= mdi->max_voices) {
+        for (i = 0; i < mdi->voices.count; i++) {
+            nte = mdi->voices.note[i];
+            if (nte->stolen && ((victim == NULL) || (nte->env_level < victim->env_level)))
+                victim = nte;
+        }
+        if (victim != NULL) _WM_RemoveVoice(mdi, victim);
+        victim = NULL;
+    }
+
+    for (i = 0; i < mdi->voices.count; i++) {
+        nte = mdi->voices.note[i];
+        if (!nte->stolen && ((victim == NULL) || steal_before(mdi, nte, victim)))
+            victim = nte;
+    }
+    if (victim == NULL) return;
+
+    if (victim->replay) {
+        if (victim->turn) victim->turn0_blocks = note_blocks(victim->replay);
+        free_note(mdi, victim->replay);
+        victim->replay = NULL;
+    }
+    victim->env = 6;
+    victim->env_inc = -victim->sample->env_rate[6];
+    victim->hold = 0;
+    victim->is_off = 0;
+    victim->stolen = 1;
+    mdi->stolen_voices++;
+}
+
+float _WM_GetSamplesPerTick(uint32_t divisions, uint32_t tempo, uint16_t rate) {
     float microseconds_per_tick;
     float secs_per_tick;
     float samples_per_tick;
@@ -540,7 +785,7 @@ float _WM_GetSamplesPerTick(uint32_t divisions, uint32_t tempo) {
     /* Slow but needed for accuracy */
     microseconds_per_tick = (float) tempo / (float) divisions;
     secs_per_tick = microseconds_per_tick / 1000000.0f;
-    samples_per_tick = _WM_SampleRate * secs_per_tick;
+    samples_per_tick = rate * secs_per_tick;
 
     return (samples_per_tick);
 }
@@ -611,12 +856,9 @@ void _WM_do_note_off(struct _mdi *mdi, struct _event_data *data) {
 
     MIDI_EVENT_DEBUG(_WM_FUNCTION,ch, data->data.value);
 
-    nte = &mdi->note_table[0][ch][(data->data.value >> 8)];
-    if (!nte->active) {
-        nte = &mdi->note_table[1][ch][(data->data.value >> 8)];
-        if (!nte->active) {
-            return;
-        }
+    nte = find_note(mdi, ch, (data->data.value >> 8), 1);
+    if ((nte == NULL) || nte->stolen) {
+        return;
     }
 
     if ((mdi->channel[ch].isdrum) && (!(nte->modes & SAMPLE_LOOP))) {
@@ -650,20 +892,20 @@ static inline uint32_t get_inc(struct _mdi *mdi, struct _note *nte) {
         note_f = 12700;
     }
     freq = _WM_freq_table[(note_f % 1200)] >> (10 - (note_f / 1200));
-    return (((freq / ((_WM_SampleRate * 100) / 1024)) * 1024
+    return (((freq / ((mdi->ctx->sample_rate * 100) / 1024)) * 1024
              / nte->sample->inc_div));
 }
 
 void _WM_do_note_on(struct _mdi *mdi, struct _event_data *data) {
     struct _note *nte;
-    struct _note *prev_nte;
-    struct _note *nte_array;
     uint32_t freq = 0;
     struct _patch *patch;
     struct _sample *sample;
     uint8_t ch = data->channel;
     uint8_t note = (data->data.value >> 8);
     uint8_t velocity = (data->data.value & 0xFF);
+    uint8_t loaded;
+    int blocks;
 
     if (velocity == 0x00) {
         _WM_do_note_off(mdi, data);
@@ -692,44 +934,48 @@ void _WM_do_note_on(struct _mdi *mdi, struct _event_data *data) {
         }
     }
 
+    loaded = _WM_LoadAcquire8(patch->loaded);
+    if ((loaded == WM_PATCH_QUEUED) || (loaded == WM_PATCH_LOADING)) {
+        /* the pool hasn't got to this patch yet, or is still loading it */
+        _WM_wait_patch(mdi->ctx, patch);
+    }
+
     sample = _WM_get_sample_data(patch, (freq / 100));
     if (sample == NULL) {
         return;
     }
 
-    nte = &mdi->note_table[0][ch][note];
+    nte = find_note(mdi, ch, note, 1);
 
-    if (nte->active) {
-        if ((nte->modes & SAMPLE_ENVELOPE) && (nte->env < 3)
-            && (!(nte->hold & HOLD_OFF)))
+    if (nte != NULL) {
+        /* it is always note 0 that decides, see struct _note */
+        if (nte->turn == 0) {
+            blocks = note_blocks(nte);
+        } else if (nte->replay != NULL) {
+            blocks = note_blocks(nte->replay);
+        } else {
+            blocks = nte->turn0_blocks;
+        }
+        if (blocks)
             return;
-        nte->replay = &mdi->note_table[1][ch][note];
+        if (nte->replay == NULL) {
+            if ((nte->replay = alloc_note(mdi)) == NULL)
+                return;
+            nte->replay->turn = !nte->turn;
+        }
         nte->env = 6;
         nte->env_inc = -nte->sample->env_rate[6];
         nte = nte->replay;
+    } else if ((nte = find_note(mdi, ch, note, 0)) != NULL) {
+        /* restarts a note that sound off let play on */
+        if (nte->stolen) mdi->stolen_voices--;
+        nte->active = 1;
     } else {
-        if (mdi->note_table[1][ch][note].active) {
-            if ((nte->modes & SAMPLE_ENVELOPE) && (nte->env < 3)
-                && (!(nte->hold & HOLD_OFF)))
-                return;
-            mdi->note_table[1][ch][note].replay = nte;
-            mdi->note_table[1][ch][note].env = 6;
-            mdi->note_table[1][ch][note].env_inc =
-            -mdi->note_table[1][ch][note].sample->env_rate[6];
-        } else {
-            nte_array = mdi->note;
-            if (nte_array == NULL) {
-                mdi->note = nte;
-            } else {
-                do {
-                    prev_nte = nte_array;
-                    nte_array = nte_array->next;
-                } while (nte_array);
-                prev_nte->next = nte;
-            }
-            nte->active = 1;
-            nte->next = NULL;
-        }
+        if (mdi->max_voices && ((mdi->voices.count - mdi->stolen_voices) >= mdi->max_voices))
+            steal_voice(mdi);
+        if ((nte = add_voice(mdi, ch)) == NULL)
+            return;
+        nte->turn = 0;
     }
     nte->noteid = (ch << 8) | note;
     nte->patch = patch;
@@ -745,6 +991,8 @@ void _WM_do_note_on(struct _mdi *mdi, struct _event_data *data) {
     nte->replay = NULL;
     nte->is_off = 0;
     nte->ignore_chan_events = 0;
+    nte->stolen = 0;
+    nte->started = mdi->note_ons++;
     _WM_AdjustNoteVolumes(mdi, ch, nte);
 }
 
@@ -754,12 +1002,9 @@ void _WM_do_aftertouch(struct _mdi *mdi, struct _event_data *data) {
 
     MIDI_EVENT_DEBUG(_WM_FUNCTION,ch, data->data.value);
 
-    nte = &mdi->note_table[0][ch][(data->data.value >> 8)];
-    if (!nte->active) {
-        nte = &mdi->note_table[1][ch][(data->data.value >> 8)];
-        if (!nte->active) {
-            return;
-        }
+    nte = find_note(mdi, ch, (data->data.value >> 8), 1);
+    if (nte == NULL) {
+        return;
     }
 
     nte->velocity = data->data.value & 0xff;
@@ -842,67 +1087,65 @@ void _WM_do_control_data_entry_fine(struct _mdi *mdi,
 }
 
 void _WM_do_control_channel_hold(struct _mdi *mdi, struct _event_data *data) {
-    struct _note *note_data = mdi->note;
+    struct _voices *voices = &mdi->channel[data->channel].voices;
+    struct _note *note_data;
     uint8_t ch = data->channel;
+    uint32_t i;
     MIDI_EVENT_DEBUG(_WM_FUNCTION,ch, data->data.value);
 
     if (data->data.value > 63) {
         mdi->channel[ch].hold = 1;
     } else {
         mdi->channel[ch].hold = 0;
-        if (note_data) {
-            do {
-                if ((note_data->noteid >> 8) == ch) {
-                    if (note_data->hold & HOLD_OFF) {
-                        if (note_data->modes & SAMPLE_ENVELOPE) {
-                            if (note_data->modes & SAMPLE_CLAMPED) {
-                                if (note_data->env < 5) {
-                                    note_data->env = 5;
-                                    if (note_data->env_level
-                                        > note_data->sample->env_target[5]) {
-                                        note_data->env_inc =
-                                        -note_data->sample->env_rate[5];
-                                    } else {
-                                        note_data->env_inc =
-                                        note_data->sample->env_rate[5];
-                                    }
-                                }
-                            /*
-                            } else if (note_data->modes & SAMPLE_SUSTAIN) {
-                                if (note_data->env < 3) {
-                                    note_data->env = 3;
-                                    if (note_data->env_level
-                                        > note_data->sample->env_target[3]) {
-                                        note_data->env_inc =
-                                        -note_data->sample->env_rate[3];
-                                    } else {
-                                        note_data->env_inc =
-                                        note_data->sample->env_rate[3];
-                                    }
-                                }
-                             */
-                             } else if (note_data->env < 3) {
-                                note_data->env = 3;
-                                if (note_data->env_level
-                                    > note_data->sample->env_target[3]) {
-                                    note_data->env_inc =
-                                    -note_data->sample->env_rate[3];
-                                } else {
-                                    note_data->env_inc =
-                                    note_data->sample->env_rate[3];
-                                }
+        for (i = 0; i < voices->count; i++) {
+            note_data = voices->note[i];
+            if (note_data->hold & HOLD_OFF) {
+                if (note_data->modes & SAMPLE_ENVELOPE) {
+                    if (note_data->modes & SAMPLE_CLAMPED) {
+                        if (note_data->env < 5) {
+                            note_data->env = 5;
+                            if (note_data->env_level
+                                > note_data->sample->env_target[5]) {
+                                note_data->env_inc =
+                                -note_data->sample->env_rate[5];
+                            } else {
+                                note_data->env_inc =
+                                note_data->sample->env_rate[5];
                             }
-                        } else {
-                            if (note_data->modes & SAMPLE_LOOP) {
-                                note_data->modes ^= SAMPLE_LOOP;
+                        }
+                    /*
+                    } else if (note_data->modes & SAMPLE_SUSTAIN) {
+                        if (note_data->env < 3) {
+                            note_data->env = 3;
+                            if (note_data->env_level
+                                > note_data->sample->env_target[3]) {
+                                note_data->env_inc =
+                                -note_data->sample->env_rate[3];
+                            } else {
+                                note_data->env_inc =
+                                note_data->sample->env_rate[3];
                             }
-                            note_data->env_inc = 0;
                         }
+                     */
+                     } else if (note_data->env < 3) {
+                        note_data->env = 3;
+                        if (note_data->env_level
+                            > note_data->sample->env_target[3]) {
+                            note_data->env_inc =
+                            -note_data->sample->env_rate[3];
+                        } else {
+                            note_data->env_inc =
+                            note_data->sample->env_rate[3];
+                        }
+                    }
+                } else {
+                    if (note_data->modes & SAMPLE_LOOP) {
+                        note_data->modes ^= SAMPLE_LOOP;
                     }
-                    note_data->hold = 0x00;
+                    note_data->env_inc = 0;
                 }
-                note_data = note_data->next;
-            } while (note_data);
+            }
+            note_data->hold = 0x00;
         }
     }
 }
@@ -968,20 +1211,23 @@ void _WM_do_control_registered_param_course(struct _mdi *mdi,
 
 void _WM_do_control_channel_sound_off(struct _mdi *mdi,
                                       struct _event_data *data) {
-    struct _note *note_data = mdi->note;
     uint8_t ch = data->channel;
+    struct _voices *voices = &mdi->channel[ch].voices;
+    struct _note *nte;
+    uint32_t i;
     MIDI_EVENT_DEBUG(_WM_FUNCTION,ch, data->data.value);
 
-    if (note_data) {
-        do {
-            if ((note_data->noteid >> 8) == ch) {
-                note_data->active = 0;
-                if (note_data->replay) {
-                    note_data->replay = NULL;
-                }
-            }
-            note_data = note_data->next;
-        } while (note_data);
+    /*
+     * The notes play on until they end, but note on, note off and
+     * aftertouch no longer find them.
+     */
+    for (i = 0; i < voices->count; i++) {
+        nte = voices->note[i];
+        nte->active = 0;
+        if (nte->replay) {
+            free_note(mdi, nte->replay);
+            nte->replay = NULL;
+        }
     }
 }
 
@@ -1003,35 +1249,33 @@ void _WM_do_control_channel_controllers_off(struct _mdi *mdi,
 
 void _WM_do_control_channel_notes_off(struct _mdi *mdi,
                                       struct _event_data *data) {
-    struct _note *note_data = mdi->note;
+    struct _voices *voices = &mdi->channel[data->channel].voices;
+    struct _note *note_data;
     uint8_t ch = data->channel;
+    uint32_t i;
     MIDI_EVENT_DEBUG(_WM_FUNCTION,ch, data->data.value);
 
     if (mdi->channel[ch].isdrum)
         return;
-    if (note_data) {
-        do {
-            if ((note_data->noteid >> 8) == ch) {
-                if (!note_data->hold) {
-                    if (note_data->modes & SAMPLE_ENVELOPE) {
-                        if (note_data->env < 5) {
-                            if (note_data->env_level
-                                > note_data->sample->env_target[5]) {
-                                note_data->env_inc =
-                                -note_data->sample->env_rate[5];
-                            } else {
-                                note_data->env_inc =
-                                note_data->sample->env_rate[5];
-                            }
-                            note_data->env = 5;
-                        }
+    for (i = 0; i < voices->count; i++) {
+        note_data = voices->note[i];
+        if (!note_data->hold) {
+            if (note_data->modes & SAMPLE_ENVELOPE) {
+                if (note_data->env < 5) {
+                    if (note_data->env_level
+                        > note_data->sample->env_target[5]) {
+                        note_data->env_inc =
+                        -note_data->sample->env_rate[5];
+                    } else {
+                        note_data->env_inc =
+                        note_data->sample->env_rate[5];
                     }
-                } else {
-                    note_data->hold |= HOLD_OFF;
+                    note_data->env = 5;
                 }
             }
-            note_data = note_data->next;
-        } while (note_data);
+        } else {
+            note_data->hold |= HOLD_OFF;
+        }
     }
 }
 
@@ -1058,29 +1302,30 @@ void _WM_do_patch(struct _mdi *mdi, struct _event_data *data) {
 
 void _WM_do_channel_pressure(struct _mdi *mdi, struct _event_data *data) {
     uint8_t ch = data->channel;
-    struct _note *note_data = mdi->note;
+    struct _voices *voices = &mdi->channel[ch].voices;
+    struct _note *note_data;
+    uint32_t i;
     MIDI_EVENT_DEBUG(_WM_FUNCTION,ch, data->data.value);
 
     mdi->channel[ch].pressure = data->data.value;
 
-    while (note_data) {
+    for (i = 0; i < voices->count; i++) {
+        note_data = voices->note[i];
         if (!note_data->ignore_chan_events) {
-            if ((note_data->noteid >> 8) == ch) {
-                note_data->velocity = data->data.value & 0xff;
-                _WM_AdjustNoteVolumes(mdi, ch, note_data);
-                if (note_data->replay) {
-                    note_data->replay->velocity = data->data.value & 0xff;
-                    _WM_AdjustNoteVolumes(mdi, ch, note_data->replay);
-                }
+            note_data->velocity = data->data.value & 0xff;
+            _WM_AdjustNoteVolumes(mdi, ch, note_data);
+            if (note_data->replay) {
+                note_data->replay->velocity = data->data.value & 0xff;
+                _WM_AdjustNoteVolumes(mdi, ch, note_data->replay);
             }
         }
-        note_data = note_data->next;
     }
 }
 
 void _WM_do_pitch(struct _mdi *mdi, struct _event_data *data) {
-    struct _note *note_data = mdi->note;
+    struct _voices *voices = &mdi->channel[data->channel].voices;
     uint8_t ch = data->channel;
+    uint32_t i;
 
     MIDI_EVENT_DEBUG(_WM_FUNCTION,ch, data->data.value);
     mdi->channel[ch].pitch = data->data.value - 0x2000;
@@ -1093,13 +1338,8 @@ void _WM_do_pitch(struct _mdi *mdi, struct _event_data *data) {
         * mdi->channel[ch].pitch / 8191;
     }
 
-    if (note_data) {
-        do {
-            if ((note_data->noteid >> 8) == ch) {
-                note_data->sample_inc = get_inc(mdi, note_data);
-            }
-            note_data = note_data->next;
-        } while (note_data);
+    for (i = 0; i < voices->count; i++) {
+        voices->note[i]->sample_inc = get_inc(mdi, voices->note[i]);
     }
 }
 
@@ -1175,9 +1415,11 @@ void _WM_Release_Allowance(struct _mdi *mdi) {
     uint32_t release = 0;
     uint32_t longest_release = 0;
 
-    struct _note *note = mdi->note;
+    struct _note *note;
+    uint32_t i;
 
-    while (note != NULL) {
+    for (i = 0; i < mdi->voices.count; i++) {
+        note = mdi->voices.note[i];
 
         if (note->modes & SAMPLE_ENVELOPE) {
             /* ensure envelope isin a release state */
@@ -1198,8 +1440,11 @@ void _WM_Release_Allowance(struct _mdi *mdi) {
         }
 
         if (release > longest_release) longest_release = release;
-        note->replay = NULL;
-        note = note->next;
+        if (note->replay) {
+            if (note->turn) note->turn0_blocks = note_blocks(note->replay);
+            free_note(mdi, note->replay);
+            note->replay = NULL;
+        }
     }
 
     mdi->samples_to_mix = longest_release;
@@ -1413,7 +1658,11 @@ void _WM_ResetToStart(struct _mdi *mdi) {
 
     _WM_do_sysex_gm_reset(mdi, NULL);
 
-    /* Ensure last event is NULL */
+    /*
+     * Ensure last event is NULL. The parsers call this once the events are
+     * all in, so only that first call can grow the pool, never a loop or
+     * seek back to the start while playing.
+     */
     _WM_CheckEventMemoryPool(mdi);
     mdi->events[mdi->event_count].evtype = ev_null;
     mdi->events[mdi->event_count].do_event = NULL;
@@ -1421,7 +1670,7 @@ void _WM_ResetToStart(struct _mdi *mdi) {
     mdi->events[mdi->event_count].event_data.data.value = 0;
     mdi->events[mdi->event_count].samples_to_next = 0;
 
-    if (_WM_MixerOptions & WM_MO_STRIPSILENCE) {
+    if (mdi->ctx->mixer_options & WM_MO_STRIPSILENCE) {
         event = mdi->events;
         /* Scan for first note on removing any samples as we go */
         if (event->evtype != ev_note_on) {
@@ -1916,14 +2165,21 @@ static int midi_setup_cuepoint(struct _mdi *mdi, char * text) {
 }
 
 struct _mdi *
-_WM_initMDI(void) {
+_WM_initMDI(struct _WM_Context *ctx) {
     struct _mdi *mdi;
 
     mdi = (struct _mdi *) malloc(sizeof(struct _mdi));
     memset(mdi, 0, (sizeof(struct _mdi)));
 
+    mdi->ctx = ctx;
     mdi->extra_info.copyright = NULL;
-    mdi->extra_info.mixer_options = _WM_MixerOptions;
+    mdi->extra_info.mixer_options = ctx->mixer_options;
+    mdi->resampler = (ctx->mixer_options & WM_MO_ENHANCED_RESAMPLING)? WM_RS_GAUSS : WM_RS_LINEAR;
+    mdi->gauss_order = MAX_GAUSS_ORDER;
+    mdi->channels = 2;
+    mdi->max_voices = 0;
+    mdi->stolen_voices = 0;
+    mdi->note_ons = 0;
 
     _WM_load_patch(mdi, 0x0000);
 
@@ -1952,25 +2208,10 @@ _WM_initMDI(void) {
 }
 
 void _WM_freeMDI(struct _mdi *mdi) {
-    struct _sample *tmp_sample;
     uint32_t i;
 
     if (mdi->patch_count != 0) {
-        _WM_Lock(&_WM_patch_lock);
-        for (i = 0; i < mdi->patch_count; i++) {
-            mdi->patches[i]->inuse_count--;
-            if (mdi->patches[i]->inuse_count == 0) {
-                /* free samples here */
-                while (mdi->patches[i]->first_sample) {
-                    tmp_sample = mdi->patches[i]->first_sample->next;
-                    free(mdi->patches[i]->first_sample->data);
-                    free(mdi->patches[i]->first_sample);
-                    mdi->patches[i]->first_sample = tmp_sample;
-                }
-                mdi->patches[i]->loaded = 0;
-            }
-        }
-        _WM_Unlock(&_WM_patch_lock);
+        _WM_release_patches(mdi);
         free(mdi->patches);
     }
 
@@ -1996,6 +2237,15 @@ void _WM_freeMDI(struct _mdi *mdi) {
     free(mdi->events);
     _WM_free_reverb(mdi->reverb);
     free(mdi->mix_buffer);
+    free(mdi->part_buffer);
+    free(mdi->voices.note);
+    for (i = 0; i < 16; i++) {
+        free(mdi->channel[i].voices.note);
+    }
+    for (i = 0; i < mdi->note_block_count; i++) {
+        free(mdi->note_blocks[i]);
+    }
+    free(mdi->note_blocks);
     if (mdi->tmp_info) {
         free(mdi->tmp_info->copyright);
         free(mdi->tmp_info);
@@ -26,6 +26,8 @@
 
 #if !defined(WM_NO_LOCK)
 
+#include <stdint.h>
+
 #ifdef _WIN32
 #include <windows.h>
 #elif defined(__OS2__) || defined(__EMX__)
@@ -40,10 +42,89 @@
 #else /* unixish ... */
 #define _GNU_SOURCE
 #include <unistd.h> /* usleep() */
+#include <sched.h>
+#if defined(__linux__)
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#define WM_FUTEX 1
+#endif
 #endif
 
 #include "lock.h"
 
+/*
+ * A lock is 0 when free, 1 when held and 2 when held with other threads
+ * possibly waiting on it, which tells _WM_Unlock it has to wake them.
+ */
+#if defined(_MSC_VER)
+#define lock_cas(p, o, n) InterlockedCompareExchange((volatile LONG *)(p), (n), (o))
+#define lock_xchg(p, n) InterlockedExchange((volatile LONG *)(p), (n))
+#define lock_load(p) (*(volatile LONG *)(p))
+#define cpu_relax() YieldProcessor()
+#elif defined(__GNUC__) && ((__GNUC__ > 4) || (__GNUC__ == 4 && __GNUC_MINOR__ >= 1))
+#define lock_cas(p, o, n) __sync_val_compare_and_swap((p), (o), (n))
+#define lock_xchg(p, n) __sync_lock_test_and_set((p), (n))
+#if defined(__clang__) || (__GNUC__ > 4) || (__GNUC_MINOR__ >= 7)
+#define lock_load(p) __atomic_load_n((p), __ATOMIC_RELAXED)
+#else
+#define lock_load(p) (*(volatile int *)(p))
+#endif
+#if defined(__i386__) || defined(__x86_64__)
+#define cpu_relax() __asm__ __volatile__ ("pause")
+#elif defined(__aarch64__)
+#define cpu_relax() __asm__ __volatile__ ("yield")
+#else
+#define cpu_relax() do {} while (0)
+#endif
+#endif
+
+/* how often to retry before giving the cpu away */
+#define LOCK_SPIN 200
+
+/*
+ _WM_Backoff(tries)
+
+ tries = how often the caller has waited already
+
+ returns nothing
+
+ Lets whichever thread we are waiting on run, only
+ sleeping once we have been waiting for a while.
+ */
+void _WM_Backoff(uint32_t tries) {
+    if (tries < 64) {
+#ifdef _WIN32
+        SwitchToThread();
+#elif defined(__OS2__) || defined(__EMX__)
+        DosSleep(0);
+#elif defined(WILDMIDI_AMIGA)
+        Delay(1);
+#elif defined(__vita__)
+        sceKernelDelayThread(0);
+#elif defined(__SWITCH__)
+        svcSleepThread(0);
+#else
+        sched_yield();
+#endif
+        return;
+    }
+#ifdef _WIN32
+    Sleep(1);
+#elif defined(__OS2__) || defined(__EMX__)
+    DosSleep(1);
+#elif defined(WILDMIDI_AMIGA)
+    Delay(1);
+#elif defined(__vita__)
+    sceKernelDelayThread(100);
+#elif defined(__SWITCH__)
+    svcSleepThread(100 * 1000);
+#else
+    usleep(100);
+#endif
+}
+
+#if defined(lock_cas)
+
 /*
  _WM_Lock(wmlock)
 
@@ -53,9 +134,74 @@
 
  Attempts to set a lock on the MDI tree so that
  only 1 library command may access it at any time.
- If lock fails the process retries until successful.
+ Spins briefly if the lock is taken and then waits
+ until it gets released.
  */
 void _WM_Lock(int * wmlock) {
+    uint32_t tries;
+
+    if (__builtin_expect((lock_cas(wmlock, 0, 1) == 0), 1))
+        return;
+
+    /* locks are only ever held for a short while, so try spinning first */
+    for (tries = 0; tries < LOCK_SPIN; tries++) {
+        cpu_relax();
+        if ((lock_load(wmlock) == 0) && (lock_cas(wmlock, 0, 1) == 0))
+            return;
+    }
+
+#if defined(WM_FUTEX)
+    /* mark the lock contended and sleep until _WM_Unlock wakes us */
+    while (lock_xchg(wmlock, 2) != 0) {
+        syscall(SYS_futex, wmlock, FUTEX_WAIT_PRIVATE, 2, NULL, NULL, 0);
+    }
+#else
+    for (tries = 0; lock_cas(wmlock, 0, 1) != 0; tries++) {
+        _WM_Backoff(tries);
+    }
+#endif
+}
+
+/*
+ _WM_TryLock(wmlock)
+
+ wmlock = a pointer to a value
+
+ returns 0 if the lock was set, -1 if it is held elsewhere
+
+ Like _WM_Lock, without waiting for the lock.
+ */
+int _WM_TryLock(int * wmlock) {
+    return ((lock_cas(wmlock, 0, 1) == 0) ? 0 : -1);
+}
+
+/*
+ _WM_Unlock(wmlock)
+
+ wmlock = a pointer to a value
+
+ returns nothing
+
+ Removes a lock previously placed on the MDI tree.
+ */
+void _WM_Unlock(int *wmlock) {
+#if defined(WM_FUTEX)
+    /* lock_xchg is only an acquire barrier, this has to release */
+    if (__sync_fetch_and_and(wmlock, 0) == 2) {
+        syscall(SYS_futex, wmlock, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+    }
+#elif defined(_MSC_VER)
+    InterlockedExchange((volatile LONG *)wmlock, 0);
+#else
+    __sync_synchronize();
+    *(volatile int *)wmlock = 0;
+#endif
+}
+
+#else /* no atomics, only good enough for single cpu systems */
+
+void _WM_Lock(int * wmlock) {
+    uint32_t tries = 0;
     LOCK_START:
     /* Check if lock is clear, if so set it */
     if (__builtin_expect(((*wmlock) == 0), 1)) {
@@ -68,31 +214,21 @@ void _WM_Lock(int * wmlock) {
         }
         (*wmlock)--;
     }
-#ifdef _WIN32
-    Sleep(10);
-#elif defined(__OS2__) || defined(__EMX__)
-    DosSleep(10);
-#elif defined(WILDMIDI_AMIGA)
-    Delay(1);
-#elif defined(__vita__)
-    sceKernelDelayThread(500);
-#elif defined(__SWITCH__)
-    svcSleepThread(500 * 1000);
-#else
-    usleep(500);
-#endif
+    _WM_Backoff(tries++);
     goto LOCK_START;
 }
 
-/*
- _WM_Unlock(wmlock)
-
- wmlock = a pointer to a value
-
- returns nothing
+int _WM_TryLock(int * wmlock) {
+    if ((*wmlock) == 0) {
+        (*wmlock)++;
+        if ((*wmlock) == 1) {
+            return (0);
+        }
+        (*wmlock)--;
+    }
+    return (-1);
+}
 
- Removes a lock previously placed on the MDI tree.
- */
 void _WM_Unlock(int *wmlock) {
     /* We don't want a -1 lock, so just to make sure */
     if ((*wmlock) != 0) {
@@ -100,4 +236,6 @@ void _WM_Unlock(int *wmlock) {
     }
 }
 
+#endif /* lock_cas */
+
 #endif /* !WM_NO_LOCK */
@@ -27,69 +27,173 @@
 #include <stdint.h>
 #include <stdlib.h>
 
+#include "common.h"
 #include "wildmidi_lib.h"
 #include "internal_midi.h"
 #include "lock.h"
 #include "patches.h"
 #include "sample.h"
+#include "threadpool.h"
 
-struct _patch *_WM_patch[128];
-int _WM_patch_lock = 0;
-
+/*
+ * No locking here, this gets called from note ons. The patch lists are
+ * built when the context is created, before any midi can be opened in it,
+ * and stay as they are until the context is freed.
+ */
 struct _patch *
 _WM_get_patch_data(struct _mdi *mdi, uint16_t patchid) {
     struct _patch *search_patch;
 
-    _WM_Lock(&_WM_patch_lock);
-
-    search_patch = _WM_patch[patchid & 0x007F];
+    search_patch = mdi->ctx->patch[patchid & 0x007F];
 
     if (search_patch == NULL) {
-        _WM_Unlock(&_WM_patch_lock);
         return (NULL);
     }
 
     while (search_patch) {
         if (search_patch->patchid == patchid) {
-            _WM_Unlock(&_WM_patch_lock);
             return (search_patch);
         }
         search_patch = search_patch->next;
     }
     if ((patchid >> 8) != 0) {
-        _WM_Unlock(&_WM_patch_lock);
         return (_WM_get_patch_data(mdi, patchid & 0x00FF));
     }
-    _WM_Unlock(&_WM_patch_lock);
     return (NULL);
 }
 
-void _WM_load_patch(struct _mdi *mdi, uint16_t patchid) {
+/*
+ * Loaded patches that no midi uses are kept on the context's lru list,
+ * oldest first, for as long as cache_resident stays within cache_budget.
+ * All of it is guarded by patch_lock.
+ */
+static void lru_remove(struct _WM_Context *ctx, struct _patch *patch) {
+    if (patch->lru_prev) {
+        patch->lru_prev->lru_next = patch->lru_next;
+    } else {
+        ctx->lru_first = patch->lru_next;
+    }
+    if (patch->lru_next) {
+        patch->lru_next->lru_prev = patch->lru_prev;
+    } else {
+        ctx->lru_last = patch->lru_prev;
+    }
+    patch->lru_prev = NULL;
+    patch->lru_next = NULL;
+}
+
+static void lru_append(struct _WM_Context *ctx, struct _patch *patch) {
+    patch->lru_prev = ctx->lru_last;
+    patch->lru_next = NULL;
+    if (ctx->lru_last) {
+        ctx->lru_last->lru_next = patch;
+    } else {
+        ctx->lru_first = patch;
+    }
+    ctx->lru_last = patch;
+}
+
+static void free_patch_samples(struct _WM_Context *ctx, struct _patch *patch) {
+    _WM_free_samples(patch->first_sample);
+    patch->first_sample = NULL;
+    ctx->cache_resident -= patch->bytes;
+    patch->bytes = 0;
+    _WM_StoreRelease8(patch->loaded, WM_PATCH_UNLOADED);
+}
+
+/* evicts unused patches until the cache is within budget, with patch_lock held */
+void _WM_trim_patches(struct _WM_Context *ctx) {
+    struct _patch *patch;
+
+    while ((ctx->cache_resident > ctx->cache_budget) && (ctx->lru_first != NULL)) {
+        patch = ctx->lru_first;
+        lru_remove(ctx, patch);
+        free_patch_samples(ctx, patch);
+        ctx->cache_evictions++;
+    }
+}
+
+/* what the loaded samples of patch take up, mapped data isn't counted */
+static uint32_t patch_bytes(struct _patch *patch) {
+    struct _sample *sample = patch->first_sample;
+    uint32_t bytes = 0;
+
+    while (sample) {
+        bytes += sizeof(struct _sample);
+        if (sample->map == NULL) {
+            bytes += ((sample->data_length >> 10) + (SAMPLE_GUARD * 2)) * sizeof(int16_t);
+        }
+        sample = sample->next;
+    }
+    return (bytes);
+}
+
+/* called by _WM_freeMDI, keeps what it can within budget */
+void _WM_release_patches(struct _mdi *mdi) {
+    struct _WM_Context *ctx = mdi->ctx;
+    struct _patch *patch;
     uint32_t i;
-    struct _patch *tmp_patch = NULL;
 
+    _WM_Lock(&ctx->patch_lock);
     for (i = 0; i < mdi->patch_count; i++) {
-        if (mdi->patches[i]->patchid == patchid) {
-            return;
+        patch = mdi->patches[i];
+        if (--patch->inuse_count != 0) {
+            continue;
+        }
+        if (patch->loaded == WM_PATCH_QUEUED) {
+            /* nothing to free, just don't load it any more */
+            _WM_StoreRelease8(patch->loaded, WM_PATCH_UNLOADED);
+        } else if (patch->loaded == WM_PATCH_LOADED) {
+            if (patch->first_sample != NULL) {
+                lru_append(ctx, patch);
+            } else {
+                /* failed, so try again next time */
+                _WM_StoreRelease8(patch->loaded, WM_PATCH_UNLOADED);
+            }
         }
+        /* one still loading is dealt with by _WM_wait_patch */
     }
+    _WM_trim_patches(ctx);
+    _WM_Unlock(&ctx->patch_lock);
+}
+
+/*
+ * Parsing only records the patches a midi needs, in the order it first
+ * needs them, and marks those not loaded yet as queued. _WM_load_patches
+ * then has the pool load them in that order in the background so that the
+ * midi can be played straight away. A note on that gets to a patch before
+ * the pool does loads it itself, or waits for the thread loading it.
+ */
+void _WM_load_patch(struct _mdi *mdi, uint16_t patchid) {
+    uint32_t i;
+    struct _patch *tmp_patch = NULL;
 
     tmp_patch = _WM_get_patch_data(mdi, patchid);
     if (tmp_patch == NULL) {
         return;
     }
 
-    _WM_Lock(&_WM_patch_lock);
-    if (!tmp_patch->loaded) {
-        if (_WM_load_sample(tmp_patch) == -1) {
-            _WM_Unlock(&_WM_patch_lock);
+    /* patchid may have fallen back to bank 0, so look for what it found */
+    for (i = 0; i < mdi->patch_count; i++) {
+        if (mdi->patches[i] == tmp_patch) {
             return;
         }
     }
 
-    if (tmp_patch->first_sample == NULL) {
-        _WM_Unlock(&_WM_patch_lock);
+    _WM_Lock(&mdi->ctx->patch_lock);
+    if (tmp_patch->loaded == WM_PATCH_UNLOADED) {
+        _WM_StoreRelease8(tmp_patch->loaded, WM_PATCH_QUEUED);
+        mdi->ctx->cache_misses++;
+    } else if ((tmp_patch->loaded == WM_PATCH_LOADED)
+               && (tmp_patch->first_sample == NULL)) {
+        /* we only want to try loading the guspat once. */
+        _WM_Unlock(&mdi->ctx->patch_lock);
         return;
+    } else {
+        if ((tmp_patch->loaded == WM_PATCH_LOADED) && (tmp_patch->inuse_count == 0)) {
+            lru_remove(mdi->ctx, tmp_patch);
+        }
+        mdi->ctx->cache_hits++;
     }
 
     mdi->patch_count++;
@@ -97,5 +201,130 @@ void _WM_load_patch(struct _mdi *mdi, uint16_t patchid) {
                            (sizeof(struct _patch*) * mdi->patch_count));
     mdi->patches[mdi->patch_count - 1] = tmp_patch;
     tmp_patch->inuse_count++;
-    _WM_Unlock(&_WM_patch_lock);
+    _WM_Unlock(&mdi->ctx->patch_lock);
+}
+
+/*
+ * Loads patch if it is still queued, or waits for whoever is loading it.
+ * Returns straight away for patches that are loaded, failed to load or
+ * were dropped from the queue as nothing uses them any more.
+ */
+void _WM_wait_patch(struct _WM_Context *ctx, struct _patch *patch) {
+    uint8_t loaded;
+
+    _WM_Lock(&patch->load_lock);
+    _WM_Lock(&ctx->patch_lock);
+    loaded = patch->loaded;
+    if (loaded == WM_PATCH_QUEUED) {
+        _WM_StoreRelease8(patch->loaded, WM_PATCH_LOADING);
+    }
+    _WM_Unlock(&ctx->patch_lock);
+
+    if (loaded == WM_PATCH_QUEUED) {
+        _WM_load_sample(ctx, patch);
+        _WM_Lock(&ctx->patch_lock);
+        _WM_StoreRelease8(patch->loaded, WM_PATCH_LOADED);
+        patch->bytes = patch_bytes(patch);
+        ctx->cache_resident += patch->bytes;
+        if ((patch->inuse_count == 0) && (patch->first_sample != NULL)) {
+            /* whoever wanted it has gone already */
+            lru_append(ctx, patch);
+            _WM_trim_patches(ctx);
+        }
+        _WM_Unlock(&ctx->patch_lock);
+    }
+    _WM_Unlock(&patch->load_lock);
+}
+
+void _WM_wait_patches(struct _mdi *mdi) {
+    uint32_t i;
+
+    for (i = 0; i < mdi->patch_count; i++) {
+        _WM_wait_patch(mdi->ctx, mdi->patches[i]);
+    }
+}
+
+/* what a midi posts to the pool, freed by whichever item finishes last */
+struct _patch_loads {
+    struct _WM_Context *ctx;
+    uint32_t left;
+    struct _patch **patch;
+};
+
+static void load_patch_job(void *data, uint32_t index, uint32_t worker) {
+    struct _patch_loads *loads = (struct _patch_loads *) data;
+    struct _WM_Context *ctx = loads->ctx;
+    uint32_t left;
+
+    (void) worker;
+    _WM_wait_patch(ctx, loads->patch[index]);
+
+    /* the context may be freed as soon as patch_loads gets to 0 */
+    _WM_Lock(&ctx->patch_lock);
+    ctx->patch_loads--;
+    left = --loads->left;
+    _WM_Unlock(&ctx->patch_lock);
+    if (left == 0) {
+        free(loads);
+    }
+}
+
+/* starts loading whatever mdi needs, called once it is parsed */
+void _WM_load_patches(struct _mdi *mdi) {
+    struct _WM_Context *ctx = mdi->ctx;
+    struct _patch_loads *loads;
+    uint32_t count = 0;
+    uint32_t i;
+
+    if (mdi->patch_count == 0) {
+        return;
+    }
+
+    loads = (struct _patch_loads *) malloc(sizeof(struct _patch_loads)
+                                      + (sizeof(struct _patch *) * mdi->patch_count));
+    if (loads != NULL) {
+        loads->ctx = ctx;
+        loads->patch = (struct _patch **) (loads + 1);
+        _WM_Lock(&ctx->patch_lock);
+        for (i = 0; i < mdi->patch_count; i++) {
+            if (mdi->patches[i]->loaded == WM_PATCH_QUEUED) {
+                loads->patch[count++] = mdi->patches[i];
+            }
+        }
+        loads->left = count;
+        ctx->patch_loads += count;
+        _WM_Unlock(&ctx->patch_lock);
+
+        if (count == 0) {
+            free(loads);
+            return;
+        }
+        if (_WM_pool_post(load_patch_job, loads, count) == 0) {
+            return;
+        }
+
+        _WM_Lock(&ctx->patch_lock);
+        ctx->patch_loads -= count;
+        _WM_Unlock(&ctx->patch_lock);
+        free(loads);
+    }
+
+    /* no threads to do it in the background, so load them now */
+    _WM_wait_patches(mdi);
+}
+
+/* waits until the pool is done with anything posted for ctx */
+void _WM_wait_patch_loads(struct _WM_Context *ctx) {
+    uint32_t tries;
+    uint32_t loads;
+
+    for (tries = 0; ; tries++) {
+        _WM_Lock(&ctx->patch_lock);
+        loads = ctx->patch_loads;
+        _WM_Unlock(&ctx->patch_lock);
+        if (loads == 0) {
+            break;
+        }
+        _WM_Backoff(tries);
+    }
 }
@@ -208,29 +208,28 @@ static void mk_midifile_name(const char *src) {
     memcpy(p, ".mid", 5);
 }
 
-static int write_midi_output(void *output_data, size_t output_size) {
+static int write_output_file(const char *file, const char *what,
+                             void *output_data, size_t output_size) {
     FILE *outf;
 
-    if (midi_file[0] == '\0')
-        return (-1);
-
 /*
  * Test if file already exists 
  */
-    outf = fopen(midi_file, "rb");
+    outf = fopen(file, "rb");
     if (outf != NULL) {
-        fprintf(stderr, "\rError: %s already exists\r\n", midi_file);
+        fprintf(stderr, "\rError: %s already exists\r\n", file);
+        fclose(outf);
         return (-1);
     }
 
-    outf = fopen(midi_file, "wb");
+    outf = fopen(file, "wb");
     if (!outf) {
         fprintf(stderr, "Error: unable to open file for writing (%s)\r\n", strerror(errno));
         return (-1);
     }
 
     if (fwrite(output_data, 1, output_size, outf) != output_size) {
-        fprintf(stderr, "\nERROR: failed writing midi (%s)\r\n", strerror(errno));
+        fprintf(stderr, "\nERROR: failed writing %s (%s)\r\n", what, strerror(errno));
         fclose(outf);
         return (-1);
     }
@@ -239,6 +238,13 @@ static int write_midi_output(void *output_data, size_t output_size) {
     return (0);
 }
 
+static int write_midi_output(void *output_data, size_t output_size) {
+    if (midi_file[0] == '\0')
+        return (-1);
+
+    return (write_output_file(midi_file, "midi", output_data, output_size));
+}
+
 static struct option const long_options[] = {
     { "version", 0, 0, 'v' },
     { "help", 0, 0, 'h' },
@@ -264,6 +270,8 @@ static struct option const long_options[] = {
     { "textaslyric", 0, 0, 'a' },
     { "playfrom", 1, 0, 'i'},
     { "playto", 1, 0, 'j'},
+    { "savebank", 1, 0, 'B' },
+    { "loadbank", 1, 0, 'K' },
     { NULL, 0, NULL, 0 }
 };
 
@@ -301,6 +309,9 @@ static void do_help(void) {
     printf("  -c P  --config=P    Point to your wildmidi.cfg config file name/path\n");
     printf("                      defaults to: %s\n", WILDMIDI_CFG);
     printf("  -m V  --mastervol=V Set the master volume (0..127), default is 100\n");
+    printf("  -B F  --savebank=F  Save the config's patches to bank file F and exit\n");
+    printf("                      (only usable at the same rate)\n");
+    printf("  -K F  --loadbank=F  Load patches from bank file F made with -B\n");
     printf("  -b    --reverb      Enable final output reverb engine\n\n");
 }
 
@@ -330,6 +341,8 @@ static void do_syntax(void) {
 }
 
 static char config_file[1024];
+static char save_bank_file[1024];
+static char load_bank_file[1024];
 
 int main(int argc, char **argv) {
     char output[1024];
@@ -382,7 +395,7 @@ int main(int argc, char **argv) {
 
     do_version();
     while (1) {
-        i = getopt_long(argc, argv, "0vho:tx:g:P:f:lr:c:m:btak:p:ed:nsi:j:", long_options,
+        i = getopt_long(argc, argv, "0vho:tx:g:P:f:lr:c:m:btak:p:ed:nsi:j:B:K:", long_options,
                 &option_index);
         if (i == -1)
             break;
@@ -495,12 +508,58 @@ int main(int argc, char **argv) {
         case 'j':
             play_to = (unsigned long int)(atof(optarg) * (double)rate);
             break;
+        case 'B': /* Save Bank */
+            if (!*optarg) {
+                fprintf(stderr, "Error: empty bank name.\n");
+                return (1);
+            }
+            strncpy(save_bank_file, optarg, sizeof(save_bank_file));
+            save_bank_file[sizeof(save_bank_file) - 1] = 0;
+            break;
+        case 'K': /* Load Bank */
+            if (!*optarg) {
+                fprintf(stderr, "Error: empty bank name.\n");
+                return (1);
+            }
+            strncpy(load_bank_file, optarg, sizeof(load_bank_file));
+            load_bank_file[sizeof(load_bank_file) - 1] = 0;
+            break;
         default:
             do_syntax();
             return (1);
         }
     }
 
+    if (!config_file[0]) {
+        strncpy(config_file, WILDMIDI_CFG, sizeof(config_file));
+        config_file[sizeof(config_file) - 1] = 0;
+    }
+
+    /* check if we only need to save a bank */
+    if (save_bank_file[0] != '\0') {
+        uint32_t size;
+        uint8_t *data;
+
+        if (WildMidi_Init(config_file, rate, mixer_options) == -1) {
+            fprintf(stderr, "%s\r\n", WildMidi_GetError());
+            WildMidi_ClearError();
+            return (1);
+        }
+        printf("Loading patches from %s\r\n", config_file);
+        if (WildMidi_MakeBank(&data, &size) < 0) {
+            fprintf(stderr, "Making bank failed: %s.\r\n", WildMidi_GetError());
+            WildMidi_ClearError();
+            WildMidi_Shutdown();
+            return (1);
+        }
+        WildMidi_Shutdown();
+
+        printf("Writing %s: %u bytes.\r\n", save_bank_file, size);
+        res = write_output_file(save_bank_file, "bank", data, size);
+        free(data);
+        return ((res == 0) ? 0 : 1);
+    }
+
     if (optind >= argc && !test_midi) {
         fprintf(stderr, "ERROR: No midi file given\r\n");
         do_syntax();
@@ -536,11 +595,6 @@ int main(int argc, char **argv) {
         return (0);
     }
 
-    if (!config_file[0]) {
-        strncpy(config_file, WILDMIDI_CFG, sizeof(config_file));
-        config_file[sizeof(config_file) - 1] = 0;
-    }
-
 #ifdef WILDMIDI_AMIGA
     amiga_sysinit();
 #endif
@@ -563,6 +617,12 @@ int main(int argc, char **argv) {
         return (1);
     }
 
+    if (load_bank_file[0] != '\0' && WildMidi_LoadBank(load_bank_file) == -1) {
+        /* the patches still load the slow way */
+        fprintf(stderr, "Not using bank: %s\r\n", WildMidi_GetError());
+        WildMidi_ClearError();
+    }
+
     output_buffer = malloc(16384);
     if (output_buffer == NULL) {
         fprintf(stderr, "Not enough memory, exiting\n");
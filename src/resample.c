@@ -0,0 +1,1007 @@
+/*
+ * resample.c -- Midi Wavetable Processing library
+ *
+ * Copyright (C) WildMIDI Developers 2001-2024
+ *
+ * This file is part of WildMIDI.
+ *
+ * WildMIDI is free software: you can redistribute and/or modify the player
+ * under the terms of the GNU General Public License and you can redistribute
+ * and/or modify the library under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either version 3 of
+ * the licenses, or(at your option) any later version.
+ *
+ * WildMIDI is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License and
+ * the GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License and the
+ * GNU Lesser General Public License along with WildMIDI.  If not,  see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <stdint.h>
+#include <math.h>
+#include <stdlib.h>
+
+#include "common.h"
+#include "wm_error.h"
+#include "lock.h"
+#include "reverb.h"
+#include "sample.h"
+#include "wildmidi_lib.h"
+#include "internal_midi.h"
+#include "resample.h"
+#include "simd.h"
+
+/* takes a 16bit sample times env_level (1.0 at 1<<22) to -1.0 to 1.0 */
+#define FLOAT_BUS_SCALE (1.0f / 137438953472.0f)
+
+/*
+ * The linear kernels are put together from a few pieces for each
+ * instruction set, much as the FIR ones further down are:
+ *  - a wm_lin_<isa> position steps through the sample a block of
+ *    WM_LIN_WIDTH_<isa> frames at a time, wm_lin_fetch_<isa> reads the
+ *    samples either side of each frame in the block,
+ *  - wm_lin_int_<isa> and wm_lin_float_<isa> interpolate between those
+ *    and apply the envelope, the way the int and float buses want it,
+ *  - the wm_lin_add_<bus>_<isa> functions mix that into their bus.
+ * WM_LINEAR_KERNELS builds the kernel for each bus out of them, with the
+ * plain C kernel doing whatever doesn't fill a block.
+ */
+
+/* a note's volumes, the mono ones mix the premix once at the average of both */
+struct wm_lin_vol {
+    int32_t left;
+    int32_t right;
+    int32_t mono;
+    float left_gain;
+    float right_gain;
+    float mono_gain;
+};
+
+static inline void wm_lin_get_vol(struct wm_lin_vol *vol, const struct _note *nte) {
+    vol->left = (int32_t)nte->left_mix_volume;
+    vol->right = (int32_t)nte->right_mix_volume;
+    vol->mono = (int32_t)nte->mono_mix_volume;
+    vol->left_gain = nte->left_gain * FLOAT_BUS_SCALE;
+    vol->right_gain = nte->right_gain * FLOAT_BUS_SCALE;
+    vol->mono_gain = nte->mono_gain * FLOAT_BUS_SCALE;
+}
+
+/* moves the note on by the done frames its blocks took */
+static inline void wm_lin_done(struct _note *nte, uint32_t done) {
+    nte->sample_pos += nte->sample_inc * done;
+    nte->env_level += nte->env_inc * (int32_t)done;
+}
+
+#define WM_LINEAR_KERNEL(name, isa, attr, premix, add, tail) \
+attr void _WM_resample_linear_##name(struct _note *nte, void *out, uint32_t count) { \
+    const int16_t *data = nte->sample->data; \
+    uint32_t blocks = count / WM_LIN_WIDTH_##isa; \
+    struct wm_lin_##isa lin; \
+    struct wm_lin_vol vol; \
+    \
+    if (blocks) { \
+        wm_lin_start_##isa(&lin, nte); \
+        wm_lin_get_vol(&vol, nte); \
+        do { \
+            out = add(out, premix(&lin, data), &vol); \
+            wm_lin_next_##isa(&lin); \
+        } while (--blocks); \
+        wm_lin_end_##isa(nte, count - (count % WM_LIN_WIDTH_##isa)); \
+    } \
+    if (count % WM_LIN_WIDTH_##isa) \
+        _WM_resample_linear_##tail(nte, out, count % WM_LIN_WIDTH_##isa); \
+}
+
+/* float_attr is for the float bus ones, which may need more than the int ones */
+#define WM_LINEAR_KERNELS(isa, attr, float_attr) \
+WM_LINEAR_KERNEL(isa, isa, attr, wm_lin_int_##isa, wm_lin_add_##isa, c) \
+WM_LINEAR_KERNEL(mono_##isa, isa, attr, wm_lin_int_##isa, wm_lin_add_mono_##isa, mono_c) \
+WM_LINEAR_KERNEL(float_##isa, isa, float_attr, wm_lin_float_##isa, wm_lin_add_float_##isa, float_c) \
+WM_LINEAR_KERNEL(float_mono_##isa, isa, float_attr, wm_lin_float_##isa, wm_lin_add_float_mono_##isa, float_mono_c)
+
+#define WM_LIN_WIDTH_c 1
+
+struct wm_lin_c {
+    uint32_t pos;
+    uint32_t inc;
+    int32_t env;
+    int32_t env_inc;
+};
+
+static inline void wm_lin_start_c(struct wm_lin_c *lin, const struct _note *nte) {
+    lin->pos = nte->sample_pos;
+    lin->inc = nte->sample_inc;
+    lin->env = nte->env_level;
+    lin->env_inc = nte->env_inc;
+}
+
+static inline void wm_lin_next_c(struct wm_lin_c *lin) {
+    lin->pos += lin->inc;
+    lin->env += lin->env_inc;
+}
+
+static inline void wm_lin_end_c(struct _note *nte, uint32_t done) {
+    wm_lin_done(nte, done);
+}
+
+static inline int32_t wm_lin_int_c(const struct wm_lin_c *lin, const int16_t *data) {
+    uint32_t data_pos = lin->pos >> FPBITS;
+
+    return (((data[data_pos] + (((data[data_pos + 1] - data[data_pos]) * (int32_t)(lin->pos & FPMASK)) / 1024))
+             * (lin->env >> 12)) / 1024);
+}
+
+static inline float wm_lin_float_c(const struct wm_lin_c *lin, const int16_t *data) {
+    uint32_t data_pos = lin->pos >> FPBITS;
+
+    return (((float)data[data_pos] + (float)(data[data_pos + 1] - data[data_pos])
+             * ((float)(lin->pos & FPMASK) * (1.0f / 1024.0f))) * (float)lin->env);
+}
+
+static inline void *wm_lin_add_c(void *out, int32_t premix, const struct wm_lin_vol *vol) {
+    int32_t *buffer = (int32_t *) out;
+
+    *buffer++ += (premix * vol->left) / 1024;
+    *buffer++ += (premix * vol->right) / 1024;
+    return (buffer);
+}
+
+static inline void *wm_lin_add_mono_c(void *out, int32_t premix, const struct wm_lin_vol *vol) {
+    int32_t *buffer = (int32_t *) out;
+
+    *buffer++ += (premix * vol->mono) / 1024;
+    return (buffer);
+}
+
+static inline void *wm_lin_add_float_c(void *out, float premix, const struct wm_lin_vol *vol) {
+    float *buffer = (float *) out;
+
+    *buffer++ += premix * vol->left_gain;
+    *buffer++ += premix * vol->right_gain;
+    return (buffer);
+}
+
+static inline void *wm_lin_add_float_mono_c(void *out, float premix, const struct wm_lin_vol *vol) {
+    float *buffer = (float *) out;
+
+    *buffer++ += premix * vol->mono_gain;
+    return (buffer);
+}
+
+WM_LINEAR_KERNELS(c, , )
+
+#if defined(WM_SIMD_X86)
+
+#define WM_LIN_WIDTH_sse2 4
+
+/* pos is kept for the sample reads as well, sse2 has no gather */
+struct wm_lin_sse2 {
+    uint32_t pos;
+    uint32_t inc;
+    __m128i vpos;
+    __m128i vpos_inc;
+    __m128i venv;
+    __m128i venv_inc;
+};
+
+static inline WM_TARGET_SSE2 void wm_lin_start_sse2(struct wm_lin_sse2 *lin, const struct _note *nte) {
+    uint32_t sample_pos = nte->sample_pos;
+    uint32_t sample_inc = nte->sample_inc;
+    int32_t env_level = nte->env_level;
+    int32_t env_inc = nte->env_inc;
+
+    lin->pos = sample_pos;
+    lin->inc = sample_inc;
+    lin->vpos = _mm_set_epi32((int32_t)(sample_pos + sample_inc * 3), (int32_t)(sample_pos + sample_inc * 2),
+                              (int32_t)(sample_pos + sample_inc), (int32_t)sample_pos);
+    lin->vpos_inc = _mm_set1_epi32((int32_t)(sample_inc * 4));
+    lin->venv = _mm_set_epi32(env_level + env_inc * 3, env_level + env_inc * 2,
+                              env_level + env_inc, env_level);
+    lin->venv_inc = _mm_set1_epi32(env_inc * 4);
+}
+
+static inline WM_TARGET_SSE2 void wm_lin_next_sse2(struct wm_lin_sse2 *lin) {
+    lin->pos += lin->inc * 4;
+    lin->vpos = _mm_add_epi32(lin->vpos, lin->vpos_inc);
+    lin->venv = _mm_add_epi32(lin->venv, lin->venv_inc);
+}
+
+static inline void wm_lin_end_sse2(struct _note *nte, uint32_t done) {
+    wm_lin_done(nte, done);
+}
+
+static inline WM_TARGET_SSE2 void wm_lin_fetch_sse2(const struct wm_lin_sse2 *lin, const int16_t *data,
+                                                     __m128i *vd0, __m128i *vd1) {
+    uint32_t p0 = lin->pos >> FPBITS;
+    uint32_t p1 = (lin->pos + lin->inc) >> FPBITS;
+    uint32_t p2 = (lin->pos + lin->inc * 2) >> FPBITS;
+    uint32_t p3 = (lin->pos + lin->inc * 3) >> FPBITS;
+
+    *vd0 = _mm_set_epi32(data[p3], data[p2], data[p1], data[p0]);
+    *vd1 = _mm_set_epi32(data[p3 + 1], data[p2 + 1], data[p1 + 1], data[p0 + 1]);
+}
+
+static inline WM_TARGET_SSE2 __m128i wm_lin_int_sse2(const struct wm_lin_sse2 *lin, const int16_t *data) {
+    __m128i vd0, vd1, vpremix;
+
+    wm_lin_fetch_sse2(lin, data, &vd0, &vd1);
+    vpremix = _mm_add_epi32(vd0, wm_div1024_sse2(wm_mullo_sse2(_mm_sub_epi32(vd1, vd0),
+                            _mm_and_si128(lin->vpos, _mm_set1_epi32(FPMASK)))));
+    return (wm_div1024_sse2(wm_mullo_sse2(vpremix, _mm_srai_epi32(lin->venv, 12))));
+}
+
+static inline WM_TARGET_SSE2 __m128 wm_lin_float_sse2(const struct wm_lin_sse2 *lin, const int16_t *data) {
+    __m128i vd0, vd1;
+    __m128 vf0, vpremix;
+
+    wm_lin_fetch_sse2(lin, data, &vd0, &vd1);
+    vf0 = _mm_cvtepi32_ps(vd0);
+    vpremix = _mm_add_ps(vf0, _mm_mul_ps(_mm_sub_ps(_mm_cvtepi32_ps(vd1), vf0),
+                         _mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(lin->vpos, _mm_set1_epi32(FPMASK))),
+                                    _mm_set1_ps(1.0f / 1024.0f))));
+    return (_mm_mul_ps(vpremix, _mm_cvtepi32_ps(lin->venv)));
+}
+
+static inline WM_TARGET_SSE2 void *wm_lin_add_sse2(void *out, __m128i vpremix, const struct wm_lin_vol *vol) {
+    int32_t *buffer = (int32_t *) out;
+    __m128i vleft = wm_div1024_sse2(wm_mullo_sse2(vpremix, _mm_set1_epi32(vol->left)));
+    __m128i vright = wm_div1024_sse2(wm_mullo_sse2(vpremix, _mm_set1_epi32(vol->right)));
+
+    _mm_storeu_si128((__m128i *)buffer, _mm_add_epi32(_mm_loadu_si128((__m128i *)buffer),
+                     _mm_unpacklo_epi32(vleft, vright)));
+    _mm_storeu_si128((__m128i *)(buffer + 4), _mm_add_epi32(_mm_loadu_si128((__m128i *)(buffer + 4)),
+                     _mm_unpackhi_epi32(vleft, vright)));
+    return (buffer + 8);
+}
+
+static inline WM_TARGET_SSE2 void *wm_lin_add_mono_sse2(void *out, __m128i vpremix, const struct wm_lin_vol *vol) {
+    int32_t *buffer = (int32_t *) out;
+
+    _mm_storeu_si128((__m128i *)buffer, _mm_add_epi32(_mm_loadu_si128((__m128i *)buffer),
+                     wm_div1024_sse2(wm_mullo_sse2(vpremix, _mm_set1_epi32(vol->mono)))));
+    return (buffer + 4);
+}
+
+static inline WM_TARGET_SSE2 void *wm_lin_add_float_sse2(void *out, __m128 vpremix, const struct wm_lin_vol *vol) {
+    float *buffer = (float *) out;
+    __m128 vleft = _mm_mul_ps(vpremix, _mm_set1_ps(vol->left_gain));
+    __m128 vright = _mm_mul_ps(vpremix, _mm_set1_ps(vol->right_gain));
+
+    _mm_storeu_ps(buffer, _mm_add_ps(_mm_loadu_ps(buffer), _mm_unpacklo_ps(vleft, vright)));
+    _mm_storeu_ps(buffer + 4, _mm_add_ps(_mm_loadu_ps(buffer + 4), _mm_unpackhi_ps(vleft, vright)));
+    return (buffer + 8);
+}
+
+static inline WM_TARGET_SSE2 void *wm_lin_add_float_mono_sse2(void *out, __m128 vpremix, const struct wm_lin_vol *vol) {
+    float *buffer = (float *) out;
+
+    _mm_storeu_ps(buffer, _mm_add_ps(_mm_loadu_ps(buffer), _mm_mul_ps(vpremix, _mm_set1_ps(vol->mono_gain))));
+    return (buffer + 4);
+}
+
+WM_LINEAR_KERNELS(sse2, static WM_TARGET_SSE2, static WM_TARGET_SSE2)
+
+#define WM_LIN_WIDTH_avx2 8
+
+struct wm_lin_avx2 {
+    __m256i vpos;
+    __m256i vpos_inc;
+    __m256i venv;
+    __m256i venv_inc;
+};
+
+static inline WM_TARGET_AVX2 void wm_lin_start_avx2(struct wm_lin_avx2 *lin, const struct _note *nte) {
+    __m256i vstep = _mm256_set_epi32(7, 6, 5, 4, 3, 2, 1, 0);
+
+    lin->vpos = _mm256_add_epi32(_mm256_set1_epi32((int32_t)nte->sample_pos),
+                                 _mm256_mullo_epi32(vstep, _mm256_set1_epi32((int32_t)nte->sample_inc)));
+    lin->vpos_inc = _mm256_set1_epi32((int32_t)(nte->sample_inc * 8));
+    lin->venv = _mm256_add_epi32(_mm256_set1_epi32(nte->env_level),
+                                 _mm256_mullo_epi32(vstep, _mm256_set1_epi32(nte->env_inc)));
+    lin->venv_inc = _mm256_set1_epi32(nte->env_inc * 8);
+}
+
+static inline WM_TARGET_AVX2 void wm_lin_next_avx2(struct wm_lin_avx2 *lin) {
+    lin->vpos = _mm256_add_epi32(lin->vpos, lin->vpos_inc);
+    lin->venv = _mm256_add_epi32(lin->venv, lin->venv_inc);
+}
+
+static inline WM_TARGET_AVX2 void wm_lin_end_avx2(struct _note *nte, uint32_t done) {
+    wm_lin_done(nte, done);
+    /*
+     gcc leaves out the vzeroupper on the tail call to the C kernel, and
+     without it every sse instruction that follows runs several times slower
+     */
+    _mm256_zeroupper();
+}
+
+static inline WM_TARGET_AVX2 void wm_lin_fetch_avx2(const struct wm_lin_avx2 *lin, const int16_t *data,
+                                                     __m256i *vd0, __m256i *vd1) {
+    /* each 32bit gather picks up data[pos] and data[pos + 1] together */
+    __m256i vpair = _mm256_i32gather_epi32((const int *)data, _mm256_srli_epi32(lin->vpos, FPBITS), 2);
+
+    *vd0 = _mm256_srai_epi32(_mm256_slli_epi32(vpair, 16), 16);
+    *vd1 = _mm256_srai_epi32(vpair, 16);
+}
+
+static inline WM_TARGET_AVX2 __m256i wm_lin_int_avx2(const struct wm_lin_avx2 *lin, const int16_t *data) {
+    __m256i vd0, vd1, vpremix;
+
+    wm_lin_fetch_avx2(lin, data, &vd0, &vd1);
+    vpremix = _mm256_add_epi32(vd0, wm_div1024_avx2(_mm256_mullo_epi32(_mm256_sub_epi32(vd1, vd0),
+                               _mm256_and_si256(lin->vpos, _mm256_set1_epi32(FPMASK)))));
+    return (wm_div1024_avx2(_mm256_mullo_epi32(vpremix, _mm256_srai_epi32(lin->venv, 12))));
+}
+
+static inline WM_TARGET_AVX2_FMA __m256 wm_lin_float_avx2(const struct wm_lin_avx2 *lin, const int16_t *data) {
+    __m256i vd0, vd1;
+    __m256 vf0, vpremix;
+
+    wm_lin_fetch_avx2(lin, data, &vd0, &vd1);
+    vf0 = _mm256_cvtepi32_ps(vd0);
+    vpremix = _mm256_fmadd_ps(_mm256_sub_ps(_mm256_cvtepi32_ps(vd1), vf0),
+                              _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_and_si256(lin->vpos, _mm256_set1_epi32(FPMASK))),
+                                            _mm256_set1_ps(1.0f / 1024.0f)),
+                              vf0);
+    return (_mm256_mul_ps(vpremix, _mm256_cvtepi32_ps(lin->venv)));
+}
+
+static inline WM_TARGET_AVX2 void *wm_lin_add_avx2(void *out, __m256i vpremix, const struct wm_lin_vol *vol) {
+    int32_t *buffer = (int32_t *) out;
+    __m256i vleft = wm_div1024_avx2(_mm256_mullo_epi32(vpremix, _mm256_set1_epi32(vol->left)));
+    __m256i vright = wm_div1024_avx2(_mm256_mullo_epi32(vpremix, _mm256_set1_epi32(vol->right)));
+    /* unpack works within 128bit lanes, so swap the middle halves back */
+    __m256i vlo = _mm256_unpacklo_epi32(vleft, vright);
+    __m256i vhi = _mm256_unpackhi_epi32(vleft, vright);
+
+    _mm256_storeu_si256((__m256i *)buffer, _mm256_add_epi32(_mm256_loadu_si256((__m256i *)buffer),
+                        _mm256_permute2x128_si256(vlo, vhi, 0x20)));
+    _mm256_storeu_si256((__m256i *)(buffer + 8), _mm256_add_epi32(_mm256_loadu_si256((__m256i *)(buffer + 8)),
+                        _mm256_permute2x128_si256(vlo, vhi, 0x31)));
+    return (buffer + 16);
+}
+
+static inline WM_TARGET_AVX2 void *wm_lin_add_mono_avx2(void *out, __m256i vpremix, const struct wm_lin_vol *vol) {
+    int32_t *buffer = (int32_t *) out;
+
+    _mm256_storeu_si256((__m256i *)buffer, _mm256_add_epi32(_mm256_loadu_si256((__m256i *)buffer),
+                        wm_div1024_avx2(_mm256_mullo_epi32(vpremix, _mm256_set1_epi32(vol->mono)))));
+    return (buffer + 8);
+}
+
+static inline WM_TARGET_AVX2_FMA void *wm_lin_add_float_avx2(void *out, __m256 vpremix, const struct wm_lin_vol *vol) {
+    float *buffer = (float *) out;
+    /* left and right gain for every frame, as the output is interleaved */
+    __m256 vgain = _mm256_set_ps(vol->right_gain, vol->left_gain, vol->right_gain, vol->left_gain,
+                                 vol->right_gain, vol->left_gain, vol->right_gain, vol->left_gain);
+    /* every premix twice over, in frame order, then one fma per 4 frames */
+    __m256 vlo = _mm256_unpacklo_ps(vpremix, vpremix);
+    __m256 vhi = _mm256_unpackhi_ps(vpremix, vpremix);
+
+    _mm256_storeu_ps(buffer, _mm256_fmadd_ps(_mm256_permute2f128_ps(vlo, vhi, 0x20), vgain,
+                     _mm256_loadu_ps(buffer)));
+    _mm256_storeu_ps(buffer + 8, _mm256_fmadd_ps(_mm256_permute2f128_ps(vlo, vhi, 0x31), vgain,
+                     _mm256_loadu_ps(buffer + 8)));
+    return (buffer + 16);
+}
+
+static inline WM_TARGET_AVX2_FMA void *wm_lin_add_float_mono_avx2(void *out, __m256 vpremix, const struct wm_lin_vol *vol) {
+    float *buffer = (float *) out;
+
+    _mm256_storeu_ps(buffer, _mm256_fmadd_ps(vpremix, _mm256_set1_ps(vol->mono_gain), _mm256_loadu_ps(buffer)));
+    return (buffer + 8);
+}
+
+WM_LINEAR_KERNELS(avx2, static WM_TARGET_AVX2, static WM_TARGET_AVX2_FMA)
+
+#elif defined(WM_SIMD_NEON)
+
+#define WM_LIN_WIDTH_neon 4
+
+/* pos is kept for the sample reads as well, neon has no gather */
+struct wm_lin_neon {
+    uint32_t pos;
+    uint32_t inc;
+    uint32x4_t vpos;
+    uint32x4_t vpos_inc;
+    int32x4_t venv;
+    int32x4_t venv_inc;
+};
+
+static inline void wm_lin_start_neon(struct wm_lin_neon *lin, const struct _note *nte) {
+    static const uint32_t ustep[4] = { 0, 1, 2, 3 };
+    static const int32_t step[4] = { 0, 1, 2, 3 };
+
+    lin->pos = nte->sample_pos;
+    lin->inc = nte->sample_inc;
+    lin->vpos = vmlaq_n_u32(vdupq_n_u32(nte->sample_pos), vld1q_u32(ustep), nte->sample_inc);
+    lin->vpos_inc = vdupq_n_u32(nte->sample_inc * 4);
+    lin->venv = vmlaq_n_s32(vdupq_n_s32(nte->env_level), vld1q_s32(step), nte->env_inc);
+    lin->venv_inc = vdupq_n_s32(nte->env_inc * 4);
+}
+
+static inline void wm_lin_next_neon(struct wm_lin_neon *lin) {
+    lin->pos += lin->inc * 4;
+    lin->vpos = vaddq_u32(lin->vpos, lin->vpos_inc);
+    lin->venv = vaddq_s32(lin->venv, lin->venv_inc);
+}
+
+static inline void wm_lin_end_neon(struct _note *nte, uint32_t done) {
+    wm_lin_done(nte, done);
+}
+
+static inline void wm_lin_fetch_neon(const struct wm_lin_neon *lin, const int16_t *data,
+                                     int32x4_t *vd0, int32x4_t *vd1) {
+    int32_t d0[4], d1[4];
+    uint32_t p, i;
+
+    for (i = 0; i < 4; i++) {
+        p = (lin->pos + lin->inc * i) >> FPBITS;
+        d0[i] = data[p];
+        d1[i] = data[p + 1];
+    }
+    *vd0 = vld1q_s32(d0);
+    *vd1 = vld1q_s32(d1);
+}
+
+static inline int32x4_t wm_lin_frac_neon(const struct wm_lin_neon *lin) {
+    return (vreinterpretq_s32_u32(vandq_u32(lin->vpos, vdupq_n_u32(FPMASK))));
+}
+
+static inline int32x4_t wm_lin_int_neon(const struct wm_lin_neon *lin, const int16_t *data) {
+    int32x4_t vd0, vd1, vpremix;
+
+    wm_lin_fetch_neon(lin, data, &vd0, &vd1);
+    vpremix = vaddq_s32(vd0, wm_div1024_neon(vmulq_s32(vsubq_s32(vd1, vd0), wm_lin_frac_neon(lin))));
+    return (wm_div1024_neon(vmulq_s32(vpremix, vshrq_n_s32(lin->venv, 12))));
+}
+
+static inline float32x4_t wm_lin_float_neon(const struct wm_lin_neon *lin, const int16_t *data) {
+    int32x4_t vd0, vd1;
+    float32x4_t vf0, vpremix;
+
+    wm_lin_fetch_neon(lin, data, &vd0, &vd1);
+    vf0 = vcvtq_f32_s32(vd0);
+    vpremix = vmlaq_f32(vf0, vsubq_f32(vcvtq_f32_s32(vd1), vf0),
+                        vmulq_n_f32(vcvtq_f32_s32(wm_lin_frac_neon(lin)), 1.0f / 1024.0f));
+    return (vmulq_f32(vpremix, vcvtq_f32_s32(lin->venv)));
+}
+
+static inline void *wm_lin_add_neon(void *out, int32x4_t vpremix, const struct wm_lin_vol *vol) {
+    int32_t *buffer = (int32_t *) out;
+    int32x4x2_t vout = vld2q_s32(buffer);
+
+    vout.val[0] = vaddq_s32(vout.val[0], wm_div1024_neon(vmulq_n_s32(vpremix, vol->left)));
+    vout.val[1] = vaddq_s32(vout.val[1], wm_div1024_neon(vmulq_n_s32(vpremix, vol->right)));
+    vst2q_s32(buffer, vout);
+    return (buffer + 8);
+}
+
+static inline void *wm_lin_add_mono_neon(void *out, int32x4_t vpremix, const struct wm_lin_vol *vol) {
+    int32_t *buffer = (int32_t *) out;
+
+    vst1q_s32(buffer, vaddq_s32(vld1q_s32(buffer), wm_div1024_neon(vmulq_n_s32(vpremix, vol->mono))));
+    return (buffer + 4);
+}
+
+static inline void *wm_lin_add_float_neon(void *out, float32x4_t vpremix, const struct wm_lin_vol *vol) {
+    float *buffer = (float *) out;
+    float32x4x2_t vout = vld2q_f32(buffer);
+
+    vout.val[0] = vmlaq_n_f32(vout.val[0], vpremix, vol->left_gain);
+    vout.val[1] = vmlaq_n_f32(vout.val[1], vpremix, vol->right_gain);
+    vst2q_f32(buffer, vout);
+    return (buffer + 8);
+}
+
+static inline void *wm_lin_add_float_mono_neon(void *out, float32x4_t vpremix, const struct wm_lin_vol *vol) {
+    float *buffer = (float *) out;
+
+    vst1q_f32(buffer, vmlaq_n_f32(vld1q_f32(buffer), vpremix, vol->mono_gain));
+    return (buffer + 4);
+}
+
+WM_LINEAR_KERNELS(neon, static, static)
+
+#endif
+
+static int table_lock;
+
+/* Gauss Interpolation code adapted from code supplied by Eric. A. Welsh */
+
+/*
+ * One float table per supported order, each with 1<<FPBITS rows of
+ * order + 1 coefficients.  Rows are padded with zeros to a multiple of
+ * 4 so the dot product can always take 4 taps at a time.  The sample
+ * guard covers the window hanging over either end of the data.
+ */
+#define GAUSS_ROW(n) (((n) + 4) & ~3)
+#if (SAMPLE_GUARD < (MAX_GAUSS_ORDER >> 1)) || (SAMPLE_GUARD < GAUSS_ROW(MAX_GAUSS_ORDER) - (MAX_GAUSS_ORDER >> 1))
+#error "SAMPLE_GUARD is too small for the gauss window"
+#endif
+static const int gauss_orders[3] = { 8, 16, MAX_GAUSS_ORDER };
+static float *gauss_table[3] = { NULL, NULL, NULL };
+
+static int gauss_index(uint8_t order) {
+    int i;
+
+    for (i = 0; i < 3; i++) {
+        if (gauss_orders[i] == order) return (i);
+    }
+    return (-1);
+}
+
+static int init_gauss(uint8_t order) {
+    /* init gauss table */
+    int idx = gauss_index(order);
+    int n = order;
+    int row = GAUSS_ROW(order);
+    int m, i, k, n_half = (n >> 1);
+    double ck;
+    double x, x_inc, xz;
+    double z[MAX_GAUSS_ORDER + 1];
+    float *gptr, *t;
+
+    if (idx < 0) return (-1);
+    if (_WM_LoadAcquire(gauss_table[idx])) return (0);
+
+    _WM_Lock(&table_lock);
+    if (gauss_table[idx]) {
+        _WM_Unlock(&table_lock);
+        return (0);
+    }
+
+    for (i = 0; i <= n; i++)
+        z[i] = i / (4 * M_PI);
+
+    t = (float *) calloc((1<<FPBITS) * row, sizeof(float));
+    if (t == NULL) {
+        _WM_Unlock(&table_lock);
+        return (-1);
+    }
+    x_inc = 1.0 / (1<<FPBITS);
+    for (m = 0, x = 0.0; m < (1<<FPBITS); m++, x += x_inc) {
+        xz = (x + n_half) / (4 * M_PI);
+        gptr = &t[m * row];
+
+        for (k = 0; k <= n; k++) {
+            ck = 1.0;
+
+            for (i = 0; i <= n; i++) {
+                if (i == k)
+                    continue;
+
+                ck *= (sin(xz - z[i])) / (sin(z[k] - z[i]));
+            }
+            *gptr++ = (float) ck;
+        }
+    }
+
+    _WM_StoreRelease(gauss_table[idx], t);
+    _WM_Unlock(&table_lock);
+    return (0);
+}
+
+/*
+ * Polyphase windowed sinc, SINC_TAPS taps from SINC_CENTER samples before
+ * the current one, with one blackman windowed phase per fractional
+ * position.  The cutoff sits a little below the sample's own nyquist.
+ */
+#define SINC_TAPS 16
+#define SINC_CENTER 7
+#define SINC_CUTOFF 0.9
+#if (SAMPLE_GUARD < SINC_CENTER) || (SAMPLE_GUARD < SINC_TAPS - SINC_CENTER)
+#error "SAMPLE_GUARD is too small for the sinc window"
+#endif
+static float *sinc_table = NULL;
+
+static int init_sinc(void) {
+    int m, k;
+    double x, t, h, sum;
+    double row[SINC_TAPS];
+    float *t_ptr;
+
+    if (_WM_LoadAcquire(sinc_table)) return (0);
+
+    _WM_Lock(&table_lock);
+    if (sinc_table) {
+        _WM_Unlock(&table_lock);
+        return (0);
+    }
+
+    t_ptr = (float *) malloc((1<<FPBITS) * SINC_TAPS * sizeof(float));
+    if (t_ptr == NULL) {
+        _WM_Unlock(&table_lock);
+        return (-1);
+    }
+    for (m = 0; m < (1<<FPBITS); m++) {
+        sum = 0.0;
+        for (k = 0; k < SINC_TAPS; k++) {
+            x = (k - SINC_CENTER) - ((double) m / (1<<FPBITS));
+            h = (x == 0.0) ? SINC_CUTOFF : sin(M_PI * SINC_CUTOFF * x) / (M_PI * x);
+            t = (x / SINC_TAPS) + 0.5;
+            h *= 0.42 - 0.5 * cos(2 * M_PI * t) + 0.08 * cos(4 * M_PI * t);
+            row[k] = h;
+            sum += h;
+        }
+        /* keep unity gain at every phase */
+        for (k = 0; k < SINC_TAPS; k++)
+            t_ptr[m * SINC_TAPS + k] = (float) (row[k] / sum);
+    }
+
+    _WM_StoreRelease(sinc_table, t_ptr);
+    _WM_Unlock(&table_lock);
+    return (0);
+}
+
+/*
+ * 4 point cubic hermite (catmull-rom) interpolation, close to gauss in
+ * quality for a fraction of the work.  The weights for each fractional
+ * position are kept in a table so it can share the FIR mixer below.
+ */
+#define CUBIC_TAPS 4
+#define CUBIC_CENTER 1
+static float *cubic_table = NULL;
+
+static int init_cubic(void) {
+    int m;
+    float x;
+    float *t;
+
+    if (_WM_LoadAcquire(cubic_table)) return (0);
+
+    _WM_Lock(&table_lock);
+    if (cubic_table) {
+        _WM_Unlock(&table_lock);
+        return (0);
+    }
+
+    t = (float *) malloc((1<<FPBITS) * CUBIC_TAPS * sizeof(float));
+    if (t == NULL) {
+        _WM_Unlock(&table_lock);
+        return (-1);
+    }
+    for (m = 0; m < (1<<FPBITS); m++) {
+        x = (float) m / (1<<FPBITS);
+        t[m * CUBIC_TAPS + 0] = 0.5f * x * (-1.0f + x * (2.0f - x));
+        t[m * CUBIC_TAPS + 1] = 1.0f + 0.5f * x * x * (-5.0f + 3.0f * x);
+        t[m * CUBIC_TAPS + 2] = 0.5f * x * (1.0f + x * (4.0f - 3.0f * x));
+        t[m * CUBIC_TAPS + 3] = 0.5f * x * x * (x - 1.0f);
+    }
+
+    _WM_StoreRelease(cubic_table, t);
+    _WM_Unlock(&table_lock);
+    return (0);
+}
+
+void _WM_free_resample(void) {
+    int i;
+
+    _WM_Lock(&table_lock);
+    for (i = 0; i < 3; i++) {
+        free(gauss_table[i]);
+        gauss_table[i] = NULL;
+    }
+    free(sinc_table);
+    sinc_table = NULL;
+    free(cubic_table);
+    cubic_table = NULL;
+    _WM_Unlock(&table_lock);
+}
+
+/*
+ * Shared FIR mixer for the table driven resamplers.  Each of the 1<<FPBITS
+ * table rows holds row coefficients, applied to the samples from center
+ * before the current one.
+ */
+typedef float (*wm_fir_dot)(const int16_t *sptr, const float *gptr, int row);
+
+static inline float wm_fir_dot_c(const int16_t *sptr, const float *gptr, int row) {
+    float y = 0;
+    int i;
+
+    for (i = 0; i < row; i++)
+        y += sptr[i] * gptr[i];
+    return (y);
+}
+
+static inline void wm_fir_mix(struct _note *nte, int32_t *buffer, uint32_t count,
+                              const float *table, int row, int center, wm_fir_dot dot) {
+    int16_t *data = nte->sample->data;
+    uint32_t sample_pos = nte->sample_pos;
+    uint32_t sample_inc = nte->sample_inc;
+    int32_t env_level = nte->env_level;
+    int32_t env_inc = nte->env_inc;
+    int32_t left_vol = (int32_t)nte->left_mix_volume;
+    int32_t right_vol = (int32_t)nte->right_mix_volume;
+    const int16_t *sptr;
+    float y;
+    int32_t premix;
+
+    if (!count) return;
+
+    do {
+        sptr = data + (sample_pos >> FPBITS) - center;
+        y = dot(sptr, &table[(sample_pos & FPMASK) * row], row);
+
+        premix = (int32_t)((y * (env_level >> 12)) / 1024);
+
+        *buffer++ += (premix * left_vol) / 1024;
+        *buffer++ += (premix * right_vol) / 1024;
+
+        sample_pos += sample_inc;
+        env_level += env_inc;
+    } while (--count);
+
+    nte->sample_pos = sample_pos;
+    nte->env_level = env_level;
+}
+
+static inline void wm_fir_mix_float(struct _note *nte, float *buffer, uint32_t count,
+                                    const float *table, int row, int center, wm_fir_dot dot) {
+    int16_t *data = nte->sample->data;
+    uint32_t sample_pos = nte->sample_pos;
+    uint32_t sample_inc = nte->sample_inc;
+    int32_t env_level = nte->env_level;
+    int32_t env_inc = nte->env_inc;
+    float left_gain = nte->left_gain * FLOAT_BUS_SCALE;
+    float right_gain = nte->right_gain * FLOAT_BUS_SCALE;
+    const int16_t *sptr;
+    float premix;
+
+    if (!count) return;
+
+    do {
+        sptr = data + (sample_pos >> FPBITS) - center;
+        premix = dot(sptr, &table[(sample_pos & FPMASK) * row], row) * (float)env_level;
+
+        *buffer++ += premix * left_gain;
+        *buffer++ += premix * right_gain;
+
+        sample_pos += sample_inc;
+        env_level += env_inc;
+    } while (--count);
+
+    nte->sample_pos = sample_pos;
+    nte->env_level = env_level;
+}
+
+static inline void wm_fir_mix_mono(struct _note *nte, int32_t *buffer, uint32_t count,
+                                   const float *table, int row, int center, wm_fir_dot dot) {
+    int16_t *data = nte->sample->data;
+    uint32_t sample_pos = nte->sample_pos;
+    uint32_t sample_inc = nte->sample_inc;
+    int32_t env_level = nte->env_level;
+    int32_t env_inc = nte->env_inc;
+    int32_t vol = (int32_t)nte->mono_mix_volume;
+    const int16_t *sptr;
+    float y;
+    int32_t premix;
+
+    if (!count) return;
+
+    do {
+        sptr = data + (sample_pos >> FPBITS) - center;
+        y = dot(sptr, &table[(sample_pos & FPMASK) * row], row);
+
+        premix = (int32_t)((y * (env_level >> 12)) / 1024);
+
+        *buffer++ += (premix * vol) / 1024;
+
+        sample_pos += sample_inc;
+        env_level += env_inc;
+    } while (--count);
+
+    nte->sample_pos = sample_pos;
+    nte->env_level = env_level;
+}
+
+static inline void wm_fir_mix_float_mono(struct _note *nte, float *buffer, uint32_t count,
+                                         const float *table, int row, int center, wm_fir_dot dot) {
+    int16_t *data = nte->sample->data;
+    uint32_t sample_pos = nte->sample_pos;
+    uint32_t sample_inc = nte->sample_inc;
+    int32_t env_level = nte->env_level;
+    int32_t env_inc = nte->env_inc;
+    float gain = nte->mono_gain * FLOAT_BUS_SCALE;
+    const int16_t *sptr;
+
+    if (!count) return;
+
+    do {
+        sptr = data + (sample_pos >> FPBITS) - center;
+        *buffer++ += dot(sptr, &table[(sample_pos & FPMASK) * row], row) * (float)env_level * gain;
+
+        sample_pos += sample_inc;
+        env_level += env_inc;
+    } while (--count);
+
+    nte->sample_pos = sample_pos;
+    nte->env_level = env_level;
+}
+
+/* name is isa, with float_ in front for the float bus and _mono after for the mono ones */
+#define WM_FIR_KERNELS(name, isa, target, mix) \
+static target void _WM_resample_gauss8_##name(struct _note *nte, void *buffer, uint32_t count) { \
+    mix(nte, buffer, count, _WM_LoadAcquire(gauss_table[0]), GAUSS_ROW(8), 4, wm_fir_dot_##isa); \
+} \
+static target void _WM_resample_gauss16_##name(struct _note *nte, void *buffer, uint32_t count) { \
+    mix(nte, buffer, count, _WM_LoadAcquire(gauss_table[1]), GAUSS_ROW(16), 8, wm_fir_dot_##isa); \
+} \
+static target void _WM_resample_gauss34_##name(struct _note *nte, void *buffer, uint32_t count) { \
+    mix(nte, buffer, count, _WM_LoadAcquire(gauss_table[2]), GAUSS_ROW(MAX_GAUSS_ORDER), \
+        (MAX_GAUSS_ORDER >> 1), wm_fir_dot_##isa); \
+} \
+static target void _WM_resample_cubic_##name(struct _note *nte, void *buffer, uint32_t count) { \
+    mix(nte, buffer, count, _WM_LoadAcquire(cubic_table), CUBIC_TAPS, CUBIC_CENTER, wm_fir_dot_##isa); \
+} \
+static target void _WM_resample_sinc_##name(struct _note *nte, void *buffer, uint32_t count) { \
+    mix(nte, buffer, count, _WM_LoadAcquire(sinc_table), SINC_TAPS, SINC_CENTER, wm_fir_dot_##isa); \
+}
+
+WM_FIR_KERNELS(c, c, , wm_fir_mix)
+WM_FIR_KERNELS(float_c, c, , wm_fir_mix_float)
+WM_FIR_KERNELS(c_mono, c, , wm_fir_mix_mono)
+WM_FIR_KERNELS(float_c_mono, c, , wm_fir_mix_float_mono)
+
+#if defined(WM_SIMD_X86)
+
+static inline WM_TARGET_SSE2 float wm_fir_dot_sse2(const int16_t *sptr, const float *gptr, int row) {
+    __m128 acc = _mm_setzero_ps();
+    __m128i s;
+    int i;
+
+    for (i = 0; i < row; i += 4) {
+        s = _mm_loadl_epi64((const __m128i *)(sptr + i));
+        s = _mm_srai_epi32(_mm_unpacklo_epi16(s, s), 16);
+        acc = _mm_add_ps(acc, _mm_mul_ps(_mm_cvtepi32_ps(s), _mm_loadu_ps(gptr + i)));
+    }
+    acc = _mm_add_ps(acc, _mm_movehl_ps(acc, acc));
+    acc = _mm_add_ss(acc, _mm_shuffle_ps(acc, acc, 1));
+    return (_mm_cvtss_f32(acc));
+}
+
+WM_FIR_KERNELS(sse2, sse2, WM_TARGET_SSE2, wm_fir_mix)
+WM_FIR_KERNELS(float_sse2, sse2, WM_TARGET_SSE2, wm_fir_mix_float)
+WM_FIR_KERNELS(sse2_mono, sse2, WM_TARGET_SSE2, wm_fir_mix_mono)
+WM_FIR_KERNELS(float_sse2_mono, sse2, WM_TARGET_SSE2, wm_fir_mix_float_mono)
+
+#elif defined(WM_SIMD_NEON)
+
+static inline float wm_fir_dot_neon(const int16_t *sptr, const float *gptr, int row) {
+    float32x4_t acc = vdupq_n_f32(0.0f);
+    float32x2_t sum;
+    int i;
+
+    for (i = 0; i < row; i += 4) {
+        acc = vmlaq_f32(acc, vcvtq_f32_s32(vmovl_s16(vld1_s16(sptr + i))), vld1q_f32(gptr + i));
+    }
+    sum = vadd_f32(vget_low_f32(acc), vget_high_f32(acc));
+    return (vget_lane_f32(vpadd_f32(sum, sum), 0));
+}
+
+WM_FIR_KERNELS(neon, neon, , wm_fir_mix)
+WM_FIR_KERNELS(float_neon, neon, , wm_fir_mix_float)
+WM_FIR_KERNELS(neon_mono, neon, , wm_fir_mix_mono)
+WM_FIR_KERNELS(float_neon_mono, neon, , wm_fir_mix_float_mono)
+
+#endif
+
+/* the kernels for each WM_BUS_* combination, filled in by _WM_init_resample() */
+static _WM_Resample resample_linear[WM_BUS_COUNT];
+static _WM_Resample resample_gauss[WM_BUS_COUNT][3];
+static _WM_Resample resample_cubic[WM_BUS_COUNT];
+static _WM_Resample resample_sinc[WM_BUS_COUNT];
+
+_WM_Resample _WM_get_resampler(uint8_t mode, uint8_t gauss_order, uint8_t bus) {
+    int idx;
+
+    if (bus >= WM_BUS_COUNT) return (NULL);
+
+    switch (mode) {
+    case WM_RS_GAUSS:
+        idx = gauss_index(gauss_order);
+        if (idx < 0) return (NULL);
+        if (init_gauss(gauss_order) < 0) return (NULL);
+        return (resample_gauss[bus][idx]);
+    case WM_RS_CUBIC:
+        if (init_cubic() < 0) return (NULL);
+        return (resample_cubic[bus]);
+    case WM_RS_SINC:
+        if (init_sinc() < 0) return (NULL);
+        return (resample_sinc[bus]);
+    default:
+        return (resample_linear[bus]);
+    }
+}
+
+#define WM_SET_FIR_KERNELS(bus, name) do { \
+    resample_gauss[bus][0] = _WM_resample_gauss8_##name; \
+    resample_gauss[bus][1] = _WM_resample_gauss16_##name; \
+    resample_gauss[bus][2] = _WM_resample_gauss34_##name; \
+    resample_cubic[bus] = _WM_resample_cubic_##name; \
+    resample_sinc[bus] = _WM_resample_sinc_##name; \
+} while (0)
+
+void _WM_init_resample(void) {
+    table_lock = 0;
+
+    resample_linear[WM_BUS_INT] = _WM_resample_linear_c;
+    resample_linear[WM_BUS_FLOAT] = _WM_resample_linear_float_c;
+    resample_linear[WM_BUS_INT | WM_BUS_MONO] = _WM_resample_linear_mono_c;
+    resample_linear[WM_BUS_FLOAT | WM_BUS_MONO] = _WM_resample_linear_float_mono_c;
+    WM_SET_FIR_KERNELS(WM_BUS_INT, c);
+    WM_SET_FIR_KERNELS(WM_BUS_FLOAT, float_c);
+    WM_SET_FIR_KERNELS(WM_BUS_INT | WM_BUS_MONO, c_mono);
+    WM_SET_FIR_KERNELS(WM_BUS_FLOAT | WM_BUS_MONO, float_c_mono);
+
+#if defined(WM_SIMD_X86)
+    if (wm_cpu_has_avx2()) {
+        resample_linear[WM_BUS_INT] = _WM_resample_linear_avx2;
+        resample_linear[WM_BUS_INT | WM_BUS_MONO] = _WM_resample_linear_mono_avx2;
+    } else if (wm_cpu_has_sse2()) {
+        resample_linear[WM_BUS_INT] = _WM_resample_linear_sse2;
+        resample_linear[WM_BUS_INT | WM_BUS_MONO] = _WM_resample_linear_mono_sse2;
+    }
+    if (wm_cpu_has_avx2() && wm_cpu_has_fma()) {
+        resample_linear[WM_BUS_FLOAT] = _WM_resample_linear_float_avx2;
+        resample_linear[WM_BUS_FLOAT | WM_BUS_MONO] = _WM_resample_linear_float_mono_avx2;
+    } else if (wm_cpu_has_sse2()) {
+        resample_linear[WM_BUS_FLOAT] = _WM_resample_linear_float_sse2;
+        resample_linear[WM_BUS_FLOAT | WM_BUS_MONO] = _WM_resample_linear_float_mono_sse2;
+    }
+    if (wm_cpu_has_sse2()) {
+        WM_SET_FIR_KERNELS(WM_BUS_INT, sse2);
+        WM_SET_FIR_KERNELS(WM_BUS_FLOAT, float_sse2);
+        WM_SET_FIR_KERNELS(WM_BUS_INT | WM_BUS_MONO, sse2_mono);
+        WM_SET_FIR_KERNELS(WM_BUS_FLOAT | WM_BUS_MONO, float_sse2_mono);
+    }
+#elif defined(WM_SIMD_NEON)
+    resample_linear[WM_BUS_INT] = _WM_resample_linear_neon;
+    resample_linear[WM_BUS_FLOAT] = _WM_resample_linear_float_neon;
+    resample_linear[WM_BUS_INT | WM_BUS_MONO] = _WM_resample_linear_mono_neon;
+    resample_linear[WM_BUS_FLOAT | WM_BUS_MONO] = _WM_resample_linear_float_mono_neon;
+    WM_SET_FIR_KERNELS(WM_BUS_INT, neon);
+    WM_SET_FIR_KERNELS(WM_BUS_FLOAT, float_neon);
+    WM_SET_FIR_KERNELS(WM_BUS_INT | WM_BUS_MONO, neon_mono);
+    WM_SET_FIR_KERNELS(WM_BUS_FLOAT | WM_BUS_MONO, float_neon_mono);
+#endif
+}
+
+/* an isa's linear kernels, indexed by bus */
+#define WM_LINEAR_BUSES(isa) { _WM_resample_linear_##isa, _WM_resample_linear_float_##isa, \
+    _WM_resample_linear_mono_##isa, _WM_resample_linear_float_mono_##isa }
+
+uint32_t _WM_resample_linear_all(uint8_t bus, _WM_Resample *kernels, const char **names) {
+    static const _WM_Resample linear_c[WM_BUS_COUNT] = WM_LINEAR_BUSES(c);
+#if defined(WM_SIMD_X86)
+    static const _WM_Resample linear_sse2[WM_BUS_COUNT] = WM_LINEAR_BUSES(sse2);
+    static const _WM_Resample linear_avx2[WM_BUS_COUNT] = WM_LINEAR_BUSES(avx2);
+#elif defined(WM_SIMD_NEON)
+    static const _WM_Resample linear_neon[WM_BUS_COUNT] = WM_LINEAR_BUSES(neon);
+#endif
+    uint32_t count = 0;
+
+    kernels[count] = linear_c[bus];
+    names[count++] = "c";
+#if defined(WM_SIMD_X86)
+    if (wm_cpu_has_sse2()) {
+        kernels[count] = linear_sse2[bus];
+        names[count++] = "sse2";
+    }
+    if (wm_cpu_has_avx2()) {
+        kernels[count] = linear_avx2[bus];
+        names[count++] = "avx2";
+    }
+#elif defined(WM_SIMD_NEON)
+    kernels[count] = linear_neon[bus];
+    names[count++] = "neon";
+#endif
+    return (count);
+}
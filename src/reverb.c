@@ -28,36 +28,337 @@
 #include <stdlib.h>
 
 #include "common.h"
+#include "wm_error.h"
 #include "reverb.h"
+#include "simd.h"
+#include "wildmidi_lib.h"
 
 /*
  reverb function
  */
-void _WM_reset_reverb(struct _rvb *rvb) {
-    int i, j, k;
-    for (i = 0; i < rvb->l_buf_size; i++) {
+/* frames in a row a room reverb has to be quiet for all its state to be zero */
+static uint32_t rvb_room_settle(struct _rvb *rvb) {
+    uint32_t mask = (rvb->l_buf_mask > rvb->r_buf_mask) ? rvb->l_buf_mask : rvb->r_buf_mask;
+    /* every slot read back as zero, and the filters fed 2 zeros */
+    return (mask + 1 + 2);
+}
+
+static void rvb_reset_room(struct _rvb *rvb) {
+    uint32_t i;
+    int j;
+    for (i = 0; i <= rvb->l_buf_mask; i++) {
         rvb->l_buf[i] = 0;
     }
-    for (i = 0; i < rvb->r_buf_size; i++) {
+    for (i = 0; i <= rvb->r_buf_mask; i++) {
         rvb->r_buf[i] = 0;
     }
-    for (k = 0; k < 8; k++) {
-        for (i = 0; i < 6; i++) {
-            for (j = 0; j < 2; j++) {
-                rvb->l_buf_flt_in[k][i][j] = 0;
-                rvb->l_buf_flt_out[k][i][j] = 0;
-                rvb->r_buf_flt_in[k][i][j] = 0;
-                rvb->r_buf_flt_out[k][i][j] = 0;
-            }
+    for (j = 0; j < 2; j++) {
+        rvb->l_buf_flt_in[j] = 0;
+        rvb->r_buf_flt_in[j] = 0;
+        for (i = 0; i < RVB_FILTERS; i++) {
+            rvb->l_buf_flt_out[j][i] = 0;
+            rvb->r_buf_flt_out[j][i] = 0;
         }
     }
+    rvb->quiet = rvb_room_settle(rvb);
+}
+
+/*
+ rvb_filter
+
+ Runs both reflections through the 48 filters of their side and adds the
+ results to the output frame. Every filter depends only on its own previous
+ output, so the vector versions run one band of several reflection points
+ at a time. They use the same wrapping 32bit math and divide with the same
+ truncation as the C version, so all of them give the same output.
+ */
+static void rvb_filter_c(struct _rvb *rvb, int32_t l_rfl, int32_t r_rfl, int32_t *frame) {
+    int32_t l_in0 = rvb->l_buf_flt_in[0];
+    int32_t l_in1 = rvb->l_buf_flt_in[1];
+    int32_t r_in0 = rvb->r_buf_flt_in[0];
+    int32_t r_in1 = rvb->r_buf_flt_in[1];
+    int32_t l_sum = 0;
+    int32_t r_sum = 0;
+    int32_t flt;
+    int i;
+
+    for (i = 0; i < RVB_FILTERS; i++) {
+        flt = ((l_rfl * rvb->coeff[0][i])
+                + (l_in0 * rvb->coeff[1][i])
+                + (l_in1 * rvb->coeff[2][i])
+                - (rvb->l_buf_flt_out[0][i] * rvb->coeff[3][i])
+                - (rvb->l_buf_flt_out[1][i] * rvb->coeff[4][i]))
+                / 1024;
+        rvb->l_buf_flt_out[1][i] = rvb->l_buf_flt_out[0][i];
+        rvb->l_buf_flt_out[0][i] = flt;
+        l_sum += flt / 8;
+
+        flt = ((r_rfl * rvb->coeff[0][i])
+                + (r_in0 * rvb->coeff[1][i])
+                + (r_in1 * rvb->coeff[2][i])
+                - (rvb->r_buf_flt_out[0][i] * rvb->coeff[3][i])
+                - (rvb->r_buf_flt_out[1][i] * rvb->coeff[4][i]))
+                / 1024;
+        rvb->r_buf_flt_out[1][i] = rvb->r_buf_flt_out[0][i];
+        rvb->r_buf_flt_out[0][i] = flt;
+        r_sum += flt / 8;
+    }
+
+    rvb->l_buf_flt_in[1] = l_in0;
+    rvb->l_buf_flt_in[0] = l_rfl;
+    rvb->r_buf_flt_in[1] = r_in0;
+    rvb->r_buf_flt_in[0] = r_rfl;
+    frame[0] += l_sum;
+    frame[1] += r_sum;
+}
+
+/* the left side's filters alone, for the mono mix */
+static void rvb_filter_mono_c(struct _rvb *rvb, int32_t rfl, int32_t *frame) {
+    int32_t in0 = rvb->l_buf_flt_in[0];
+    int32_t in1 = rvb->l_buf_flt_in[1];
+    int32_t sum = 0;
+    int32_t flt;
+    int i;
+
+    for (i = 0; i < RVB_FILTERS; i++) {
+        flt = ((rfl * rvb->coeff[0][i])
+                + (in0 * rvb->coeff[1][i])
+                + (in1 * rvb->coeff[2][i])
+                - (rvb->l_buf_flt_out[0][i] * rvb->coeff[3][i])
+                - (rvb->l_buf_flt_out[1][i] * rvb->coeff[4][i]))
+                / 1024;
+        rvb->l_buf_flt_out[1][i] = rvb->l_buf_flt_out[0][i];
+        rvb->l_buf_flt_out[0][i] = flt;
+        sum += flt / 8;
+    }
+
+    rvb->l_buf_flt_in[1] = in0;
+    rvb->l_buf_flt_in[0] = rfl;
+    frame[0] += sum;
+}
+
+#if defined(WM_SIMD_X86)
+
+static inline WM_TARGET_SSE2 __m128i rvb_band_sse2(const struct _rvb *rvb, int i,
+        __m128i x0, __m128i x1, __m128i x2, int32_t *out0, int32_t *out1) {
+    __m128i y1 = _mm_loadu_si128((const __m128i *)(out0 + i));
+    __m128i y2 = _mm_loadu_si128((const __m128i *)(out1 + i));
+    __m128i flt;
+
+    flt = wm_mullo_sse2(x0, _mm_loadu_si128((const __m128i *)&rvb->coeff[0][i]));
+    flt = _mm_add_epi32(flt, wm_mullo_sse2(x1, _mm_loadu_si128((const __m128i *)&rvb->coeff[1][i])));
+    flt = _mm_add_epi32(flt, wm_mullo_sse2(x2, _mm_loadu_si128((const __m128i *)&rvb->coeff[2][i])));
+    flt = _mm_sub_epi32(flt, wm_mullo_sse2(y1, _mm_loadu_si128((const __m128i *)&rvb->coeff[3][i])));
+    flt = _mm_sub_epi32(flt, wm_mullo_sse2(y2, _mm_loadu_si128((const __m128i *)&rvb->coeff[4][i])));
+    flt = wm_div1024_sse2(flt);
+
+    _mm_storeu_si128((__m128i *)(out1 + i), y1);
+    _mm_storeu_si128((__m128i *)(out0 + i), flt);
+    return (wm_div8_sse2(flt));
+}
+
+static inline WM_TARGET_SSE2 int32_t rvb_hsum_sse2(__m128i v) {
+    v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+    v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+    return (_mm_cvtsi128_si32(v));
+}
+
+static WM_TARGET_SSE2 void rvb_filter_sse2(struct _rvb *rvb, int32_t l_rfl, int32_t r_rfl, int32_t *frame) {
+    __m128i l_x0 = _mm_set1_epi32(l_rfl);
+    __m128i l_x1 = _mm_set1_epi32(rvb->l_buf_flt_in[0]);
+    __m128i l_x2 = _mm_set1_epi32(rvb->l_buf_flt_in[1]);
+    __m128i r_x0 = _mm_set1_epi32(r_rfl);
+    __m128i r_x1 = _mm_set1_epi32(rvb->r_buf_flt_in[0]);
+    __m128i r_x2 = _mm_set1_epi32(rvb->r_buf_flt_in[1]);
+    __m128i l_sum = _mm_setzero_si128();
+    __m128i r_sum = _mm_setzero_si128();
+    int i;
+
+    for (i = 0; i < RVB_FILTERS; i += 4) {
+        l_sum = _mm_add_epi32(l_sum, rvb_band_sse2(rvb, i, l_x0, l_x1, l_x2,
+                rvb->l_buf_flt_out[0], rvb->l_buf_flt_out[1]));
+        r_sum = _mm_add_epi32(r_sum, rvb_band_sse2(rvb, i, r_x0, r_x1, r_x2,
+                rvb->r_buf_flt_out[0], rvb->r_buf_flt_out[1]));
+    }
+
+    rvb->l_buf_flt_in[1] = rvb->l_buf_flt_in[0];
+    rvb->l_buf_flt_in[0] = l_rfl;
+    rvb->r_buf_flt_in[1] = rvb->r_buf_flt_in[0];
+    rvb->r_buf_flt_in[0] = r_rfl;
+    frame[0] += rvb_hsum_sse2(l_sum);
+    frame[1] += rvb_hsum_sse2(r_sum);
+}
+
+static WM_TARGET_SSE2 void rvb_filter_mono_sse2(struct _rvb *rvb, int32_t rfl, int32_t *frame) {
+    __m128i x0 = _mm_set1_epi32(rfl);
+    __m128i x1 = _mm_set1_epi32(rvb->l_buf_flt_in[0]);
+    __m128i x2 = _mm_set1_epi32(rvb->l_buf_flt_in[1]);
+    __m128i sum = _mm_setzero_si128();
+    int i;
+
+    for (i = 0; i < RVB_FILTERS; i += 4) {
+        sum = _mm_add_epi32(sum, rvb_band_sse2(rvb, i, x0, x1, x2,
+                rvb->l_buf_flt_out[0], rvb->l_buf_flt_out[1]));
+    }
+
+    rvb->l_buf_flt_in[1] = rvb->l_buf_flt_in[0];
+    rvb->l_buf_flt_in[0] = rfl;
+    frame[0] += rvb_hsum_sse2(sum);
+}
+
+static inline WM_TARGET_AVX2 __m256i rvb_band_avx2(const struct _rvb *rvb, int i,
+        __m256i x0, __m256i x1, __m256i x2, int32_t *out0, int32_t *out1) {
+    __m256i y1 = _mm256_loadu_si256((const __m256i *)(out0 + i));
+    __m256i y2 = _mm256_loadu_si256((const __m256i *)(out1 + i));
+    __m256i flt;
+
+    flt = _mm256_mullo_epi32(x0, _mm256_loadu_si256((const __m256i *)&rvb->coeff[0][i]));
+    flt = _mm256_add_epi32(flt, _mm256_mullo_epi32(x1, _mm256_loadu_si256((const __m256i *)&rvb->coeff[1][i])));
+    flt = _mm256_add_epi32(flt, _mm256_mullo_epi32(x2, _mm256_loadu_si256((const __m256i *)&rvb->coeff[2][i])));
+    flt = _mm256_sub_epi32(flt, _mm256_mullo_epi32(y1, _mm256_loadu_si256((const __m256i *)&rvb->coeff[3][i])));
+    flt = _mm256_sub_epi32(flt, _mm256_mullo_epi32(y2, _mm256_loadu_si256((const __m256i *)&rvb->coeff[4][i])));
+    flt = wm_div1024_avx2(flt);
+
+    _mm256_storeu_si256((__m256i *)(out1 + i), y1);
+    _mm256_storeu_si256((__m256i *)(out0 + i), flt);
+    return (wm_div8_avx2(flt));
+}
+
+static inline WM_TARGET_AVX2 int32_t rvb_hsum_avx2(__m256i v) {
+    __m128i h = _mm_add_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+    h = _mm_add_epi32(h, _mm_shuffle_epi32(h, _MM_SHUFFLE(1, 0, 3, 2)));
+    h = _mm_add_epi32(h, _mm_shuffle_epi32(h, _MM_SHUFFLE(2, 3, 0, 1)));
+    return (_mm_cvtsi128_si32(h));
+}
+
+static WM_TARGET_AVX2 void rvb_filter_avx2(struct _rvb *rvb, int32_t l_rfl, int32_t r_rfl, int32_t *frame) {
+    __m256i l_x0 = _mm256_set1_epi32(l_rfl);
+    __m256i l_x1 = _mm256_set1_epi32(rvb->l_buf_flt_in[0]);
+    __m256i l_x2 = _mm256_set1_epi32(rvb->l_buf_flt_in[1]);
+    __m256i r_x0 = _mm256_set1_epi32(r_rfl);
+    __m256i r_x1 = _mm256_set1_epi32(rvb->r_buf_flt_in[0]);
+    __m256i r_x2 = _mm256_set1_epi32(rvb->r_buf_flt_in[1]);
+    __m256i l_sum = _mm256_setzero_si256();
+    __m256i r_sum = _mm256_setzero_si256();
+    int i;
+
+    /* one band of all 8 reflection points per vector */
+    for (i = 0; i < RVB_FILTERS; i += 8) {
+        l_sum = _mm256_add_epi32(l_sum, rvb_band_avx2(rvb, i, l_x0, l_x1, l_x2,
+                rvb->l_buf_flt_out[0], rvb->l_buf_flt_out[1]));
+        r_sum = _mm256_add_epi32(r_sum, rvb_band_avx2(rvb, i, r_x0, r_x1, r_x2,
+                rvb->r_buf_flt_out[0], rvb->r_buf_flt_out[1]));
+    }
+
+    rvb->l_buf_flt_in[1] = rvb->l_buf_flt_in[0];
+    rvb->l_buf_flt_in[0] = l_rfl;
+    rvb->r_buf_flt_in[1] = rvb->r_buf_flt_in[0];
+    rvb->r_buf_flt_in[0] = r_rfl;
+    frame[0] += rvb_hsum_avx2(l_sum);
+    frame[1] += rvb_hsum_avx2(r_sum);
+}
+
+static WM_TARGET_AVX2 void rvb_filter_mono_avx2(struct _rvb *rvb, int32_t rfl, int32_t *frame) {
+    __m256i x0 = _mm256_set1_epi32(rfl);
+    __m256i x1 = _mm256_set1_epi32(rvb->l_buf_flt_in[0]);
+    __m256i x2 = _mm256_set1_epi32(rvb->l_buf_flt_in[1]);
+    __m256i sum = _mm256_setzero_si256();
+    int i;
+
+    for (i = 0; i < RVB_FILTERS; i += 8) {
+        sum = _mm256_add_epi32(sum, rvb_band_avx2(rvb, i, x0, x1, x2,
+                rvb->l_buf_flt_out[0], rvb->l_buf_flt_out[1]));
+    }
+
+    rvb->l_buf_flt_in[1] = rvb->l_buf_flt_in[0];
+    rvb->l_buf_flt_in[0] = rfl;
+    frame[0] += rvb_hsum_avx2(sum);
+}
+
+#elif defined(WM_SIMD_NEON)
+
+static inline int32x4_t rvb_band_neon(const struct _rvb *rvb, int i,
+        int32x4_t x0, int32x4_t x1, int32x4_t x2, int32_t *out0, int32_t *out1) {
+    int32x4_t y1 = vld1q_s32(out0 + i);
+    int32x4_t y2 = vld1q_s32(out1 + i);
+    int32x4_t flt;
+
+    flt = vmulq_s32(x0, vld1q_s32(&rvb->coeff[0][i]));
+    flt = vmlaq_s32(flt, x1, vld1q_s32(&rvb->coeff[1][i]));
+    flt = vmlaq_s32(flt, x2, vld1q_s32(&rvb->coeff[2][i]));
+    flt = vmlsq_s32(flt, y1, vld1q_s32(&rvb->coeff[3][i]));
+    flt = vmlsq_s32(flt, y2, vld1q_s32(&rvb->coeff[4][i]));
+    flt = wm_div1024_neon(flt);
+
+    vst1q_s32(out1 + i, y1);
+    vst1q_s32(out0 + i, flt);
+    return (wm_div8_neon(flt));
+}
+
+static void rvb_filter_neon(struct _rvb *rvb, int32_t l_rfl, int32_t r_rfl, int32_t *frame) {
+    int32x4_t l_x0 = vdupq_n_s32(l_rfl);
+    int32x4_t l_x1 = vdupq_n_s32(rvb->l_buf_flt_in[0]);
+    int32x4_t l_x2 = vdupq_n_s32(rvb->l_buf_flt_in[1]);
+    int32x4_t r_x0 = vdupq_n_s32(r_rfl);
+    int32x4_t r_x1 = vdupq_n_s32(rvb->r_buf_flt_in[0]);
+    int32x4_t r_x2 = vdupq_n_s32(rvb->r_buf_flt_in[1]);
+    int32x4_t l_sum = vdupq_n_s32(0);
+    int32x4_t r_sum = vdupq_n_s32(0);
+    int32x2_t sum;
+    int i;
+
+    for (i = 0; i < RVB_FILTERS; i += 4) {
+        l_sum = vaddq_s32(l_sum, rvb_band_neon(rvb, i, l_x0, l_x1, l_x2,
+                rvb->l_buf_flt_out[0], rvb->l_buf_flt_out[1]));
+        r_sum = vaddq_s32(r_sum, rvb_band_neon(rvb, i, r_x0, r_x1, r_x2,
+                rvb->r_buf_flt_out[0], rvb->r_buf_flt_out[1]));
+    }
+
+    rvb->l_buf_flt_in[1] = rvb->l_buf_flt_in[0];
+    rvb->l_buf_flt_in[0] = l_rfl;
+    rvb->r_buf_flt_in[1] = rvb->r_buf_flt_in[0];
+    rvb->r_buf_flt_in[0] = r_rfl;
+    sum = vpadd_s32(vadd_s32(vget_low_s32(l_sum), vget_high_s32(l_sum)),
+                    vadd_s32(vget_low_s32(r_sum), vget_high_s32(r_sum)));
+    frame[0] += vget_lane_s32(sum, 0);
+    frame[1] += vget_lane_s32(sum, 1);
+}
+
+static void rvb_filter_mono_neon(struct _rvb *rvb, int32_t rfl, int32_t *frame) {
+    int32x4_t x0 = vdupq_n_s32(rfl);
+    int32x4_t x1 = vdupq_n_s32(rvb->l_buf_flt_in[0]);
+    int32x4_t x2 = vdupq_n_s32(rvb->l_buf_flt_in[1]);
+    int32x4_t sum = vdupq_n_s32(0);
+    int32x2_t half;
+    int i;
+
+    for (i = 0; i < RVB_FILTERS; i += 4) {
+        sum = vaddq_s32(sum, rvb_band_neon(rvb, i, x0, x1, x2,
+                rvb->l_buf_flt_out[0], rvb->l_buf_flt_out[1]));
+    }
+
+    rvb->l_buf_flt_in[1] = rvb->l_buf_flt_in[0];
+    rvb->l_buf_flt_in[0] = rfl;
+    half = vadd_s32(vget_low_s32(sum), vget_high_s32(sum));
+    frame[0] += vget_lane_s32(vpadd_s32(half, half), 0);
+}
+
+#endif
+
+/* the next power of two from size, so ring positions can be masked */
+static uint32_t rvb_ring_size(uint32_t size) {
+    uint32_t ring = 1;
+    while (ring < size) {
+        ring <<= 1;
+    }
+    return (ring);
 }
 
 /*
- _WM_init_reverb
+ rvb_init_room
 
  =========================
- Engine Description
+ Engine Description (WM_RE_ROOM)
 
  8 reflective points around the room
  2 speaker positions
@@ -69,8 +370,8 @@ void _WM_reset_reverb(struct _rvb *rvb) {
  The combined sounds are also sent to the reflective points on the opposite side.
 
  */
-struct _rvb *
-_WM_init_reverb(int rate, float room_x, float room_y, float listen_x,
+static struct _rvb *
+rvb_init_room(int rate, float room_x, float room_y, float listen_x,
         float listen_y) {
 
     /* filters set at 125Hz, 250Hz, 500Hz, 1000Hz, 2000Hz, 4000Hz */
@@ -121,6 +422,8 @@ _WM_init_reverb(int rate, float room_x, float room_y, float listen_x,
     double SPR_LSN_DST = 0.0;
 
     struct _rvb *rtn_rvb = (struct _rvb *) malloc(sizeof(struct _rvb));
+    uint32_t l_buf_size;
+    uint32_t r_buf_size;
     int j = 0;
     int i = 0;
 
@@ -173,6 +476,8 @@ _WM_init_reverb(int rate, float room_x, float room_y, float listen_x,
     if (rtn_rvb == NULL) {
         return NULL;
     }
+    rtn_rvb->engine = WM_RE_ROOM;
+    rtn_rvb->fdn_buf = NULL;
 
     for (j = 0; j < 8; j++) {
         double SPL_RFL_XOFS = 0;
@@ -250,37 +555,67 @@ _WM_init_reverb(int rate, float room_x, float room_y, float listen_x,
             double a1 = -2 * cs;
             double a2 = 1 - (alpha / A);
 
-            rtn_rvb->coeff[j][i][0] = (int32_t) ((b0 / a0) * 1024.0);
-            rtn_rvb->coeff[j][i][1] = (int32_t) ((b1 / a0) * 1024.0);
-            rtn_rvb->coeff[j][i][2] = (int32_t) ((b2 / a0) * 1024.0);
-            rtn_rvb->coeff[j][i][3] = (int32_t) ((a1 / a0) * 1024.0);
-            rtn_rvb->coeff[j][i][4] = (int32_t) ((a2 / a0) * 1024.0);
+            rtn_rvb->coeff[0][i * 8 + j] = (int32_t) ((b0 / a0) * 1024.0);
+            rtn_rvb->coeff[1][i * 8 + j] = (int32_t) ((b1 / a0) * 1024.0);
+            rtn_rvb->coeff[2][i * 8 + j] = (int32_t) ((b2 / a0) * 1024.0);
+            rtn_rvb->coeff[3][i * 8 + j] = (int32_t) ((a1 / a0) * 1024.0);
+            rtn_rvb->coeff[4][i * 8 + j] = (int32_t) ((a2 / a0) * 1024.0);
         }
     }
 
     /* init the reverb buffers */
-    rtn_rvb->l_buf_size = (int) ((float) rate * (MAXL_DST / 340.29));
-    rtn_rvb->l_buf = (int32_t *) malloc(sizeof(int32_t) * (rtn_rvb->l_buf_size + 1));
-    rtn_rvb->l_out = 0;
-
-    rtn_rvb->r_buf_size = (int) ((float) rate * (MAXR_DST / 340.29));
-    rtn_rvb->r_buf = (int32_t *) malloc(sizeof(int32_t) * (rtn_rvb->r_buf_size + 1));
-    rtn_rvb->r_out = 0;
-
+    l_buf_size = (uint32_t) ((float) rate * (MAXL_DST / 340.29));
+    r_buf_size = (uint32_t) ((float) rate * (MAXR_DST / 340.29));
+    if (!l_buf_size) l_buf_size = 1;
+    if (!r_buf_size) r_buf_size = 1;
+    rtn_rvb->l_buf_mask = rvb_ring_size(l_buf_size) - 1;
+    rtn_rvb->r_buf_mask = rvb_ring_size(r_buf_size) - 1;
+    rtn_rvb->l_buf = (int32_t *) malloc(sizeof(int32_t) * (rtn_rvb->l_buf_mask + 1));
+    rtn_rvb->r_buf = (int32_t *) malloc(sizeof(int32_t) * (rtn_rvb->r_buf_mask + 1));
+    if ((rtn_rvb->l_buf == NULL) || (rtn_rvb->r_buf == NULL)) {
+        _WM_free_reverb(rtn_rvb);
+        return NULL;
+    }
+    rtn_rvb->pos = 0;
+
+    /*
+     The delays used to wrap round buffers of exactly l_buf_size and
+     r_buf_size, which turned the longest path into no delay at all for the
+     speaker inputs and a full buffer's worth for the filtered feedback, as
+     that is added after the read. Keep those delays so the sound stays the
+     same with the larger buffers.
+     */
     for (i = 0; i < 4; i++) {
-        rtn_rvb->l_sp_in[i] = (int) ((float) rate * (SPL_DST[i] / 340.29));
-        rtn_rvb->l_sp_in[i + 4] = (int) ((float) rate
-                * (SPL_DST[i + 4] / 340.29));
-        rtn_rvb->r_sp_in[i] = (int) ((float) rate * (SPR_DST[i] / 340.29));
-        rtn_rvb->r_sp_in[i + 4] = (int) ((float) rate
-                * (SPR_DST[i + 4] / 340.29));
-        rtn_rvb->l_in[i] = (int) ((float) rate * (RFN_DST[i] / 340.29));
-        rtn_rvb->r_in[i] = (int) ((float) rate * (RFN_DST[i + 4] / 340.29));
+        rtn_rvb->l_sp_in[i] = (uint32_t) ((float) rate * (SPL_DST[i] / 340.29)) % l_buf_size;
+        rtn_rvb->l_sp_in[i + 4] = (uint32_t) ((float) rate
+                * (SPL_DST[i + 4] / 340.29)) % r_buf_size;
+        rtn_rvb->r_sp_in[i] = (uint32_t) ((float) rate * (SPR_DST[i] / 340.29)) % l_buf_size;
+        rtn_rvb->r_sp_in[i + 4] = (uint32_t) ((float) rate
+                * (SPR_DST[i + 4] / 340.29)) % r_buf_size;
+        rtn_rvb->l_in[i] = ((uint32_t) ((float) rate * (RFN_DST[i] / 340.29)) + l_buf_size - 1)
+                % l_buf_size + 1;
+        rtn_rvb->r_in[i] = ((uint32_t) ((float) rate * (RFN_DST[i + 4] / 340.29)) + r_buf_size - 1)
+                % r_buf_size + 1;
     }
 
     rtn_rvb->gain = 4;
 
-    _WM_reset_reverb(rtn_rvb);
+    rtn_rvb->filter = rvb_filter_c;
+    rtn_rvb->filter_mono = rvb_filter_mono_c;
+#if defined(WM_SIMD_X86)
+    if (wm_cpu_has_avx2()) {
+        rtn_rvb->filter = rvb_filter_avx2;
+        rtn_rvb->filter_mono = rvb_filter_mono_avx2;
+    } else if (wm_cpu_has_sse2()) {
+        rtn_rvb->filter = rvb_filter_sse2;
+        rtn_rvb->filter_mono = rvb_filter_mono_sse2;
+    }
+#elif defined(WM_SIMD_NEON)
+    rtn_rvb->filter = rvb_filter_neon;
+    rtn_rvb->filter_mono = rvb_filter_mono_neon;
+#endif
+
+    rvb_reset_room(rtn_rvb);
     return rtn_rvb;
 }
 
@@ -289,13 +624,18 @@ void _WM_free_reverb(struct _rvb *rvb) {
     if (!rvb) return;
     free(rvb->l_buf);
     free(rvb->r_buf);
+    free(rvb->fdn_buf);
     free(rvb);
 }
 
-void _WM_do_reverb(struct _rvb *rvb, int32_t *buffer, int size) {
-    int i, j, k;
-    int32_t l_buf_flt = 0;
-    int32_t r_buf_flt = 0;
+static void rvb_do_room(struct _rvb *rvb, int32_t *buffer, int size) {
+    int i, j;
+    int32_t *l_buf = rvb->l_buf;
+    int32_t *r_buf = rvb->r_buf;
+    uint32_t l_mask = rvb->l_buf_mask;
+    uint32_t r_mask = rvb->r_buf_mask;
+    uint32_t pos = rvb->pos;
+    uint32_t quiet = rvb->quiet;
     int32_t l_rfl = 0;
     int32_t r_rfl = 0;
     int vol_div = 64;
@@ -303,6 +643,7 @@ void _WM_do_reverb(struct _rvb *rvb, int32_t *buffer, int size) {
     for (i = 0; i < size; i += 2) {
         int32_t tmp_l_val = 0;
         int32_t tmp_r_val = 0;
+        int32_t active;
         /*
          add the initial reflections
          from each speaker, 4 to go the left, 4 go to the right buffers
@@ -310,55 +651,22 @@ void _WM_do_reverb(struct _rvb *rvb, int32_t *buffer, int size) {
         tmp_l_val = buffer[i] / vol_div;
         tmp_r_val = buffer[i + 1] / vol_div;
         for (j = 0; j < 4; j++) {
-            rvb->l_buf[rvb->l_sp_in[j]] += tmp_l_val;
-            rvb->l_sp_in[j] = (rvb->l_sp_in[j] + 1) % rvb->l_buf_size;
-            rvb->l_buf[rvb->r_sp_in[j]] += tmp_r_val;
-            rvb->r_sp_in[j] = (rvb->r_sp_in[j] + 1) % rvb->l_buf_size;
-
-            rvb->r_buf[rvb->l_sp_in[j + 4]] += tmp_l_val;
-            rvb->l_sp_in[j + 4] = (rvb->l_sp_in[j + 4] + 1) % rvb->r_buf_size;
-            rvb->r_buf[rvb->r_sp_in[j + 4]] += tmp_r_val;
-            rvb->r_sp_in[j + 4] = (rvb->r_sp_in[j + 4] + 1) % rvb->r_buf_size;
+            l_buf[(pos + rvb->l_sp_in[j]) & l_mask] += tmp_l_val;
+            l_buf[(pos + rvb->r_sp_in[j]) & l_mask] += tmp_r_val;
+            r_buf[(pos + rvb->l_sp_in[j + 4]) & r_mask] += tmp_l_val;
+            r_buf[(pos + rvb->r_sp_in[j + 4]) & r_mask] += tmp_r_val;
         }
 
         /*
          filter the reverb output and add to buffer
          */
-        l_rfl = rvb->l_buf[rvb->l_out];
-        rvb->l_buf[rvb->l_out] = 0;
-        rvb->l_out = (rvb->l_out + 1) % rvb->l_buf_size;
-
-        r_rfl = rvb->r_buf[rvb->r_out];
-        rvb->r_buf[rvb->r_out] = 0;
-        rvb->r_out = (rvb->r_out + 1) % rvb->r_buf_size;
-
-        for (k = 0; k < 8; k++) {
-            for (j = 0; j < 6; j++) {
-                l_buf_flt = ((l_rfl * rvb->coeff[k][j][0])
-                        + (rvb->l_buf_flt_in[k][j][0] * rvb->coeff[k][j][1])
-                        + (rvb->l_buf_flt_in[k][j][1] * rvb->coeff[k][j][2])
-                        - (rvb->l_buf_flt_out[k][j][0] * rvb->coeff[k][j][3])
-                        - (rvb->l_buf_flt_out[k][j][1] * rvb->coeff[k][j][4]))
-                        / 1024;
-                rvb->l_buf_flt_in[k][j][1] = rvb->l_buf_flt_in[k][j][0];
-                rvb->l_buf_flt_in[k][j][0] = l_rfl;
-                rvb->l_buf_flt_out[k][j][1] = rvb->l_buf_flt_out[k][j][0];
-                rvb->l_buf_flt_out[k][j][0] = l_buf_flt;
-                buffer[i] += l_buf_flt / 8;
-
-                r_buf_flt = ((r_rfl * rvb->coeff[k][j][0])
-                        + (rvb->r_buf_flt_in[k][j][0] * rvb->coeff[k][j][1])
-                        + (rvb->r_buf_flt_in[k][j][1] * rvb->coeff[k][j][2])
-                        - (rvb->r_buf_flt_out[k][j][0] * rvb->coeff[k][j][3])
-                        - (rvb->r_buf_flt_out[k][j][1] * rvb->coeff[k][j][4]))
-                        / 1024;
-                rvb->r_buf_flt_in[k][j][1] = rvb->r_buf_flt_in[k][j][0];
-                rvb->r_buf_flt_in[k][j][0] = r_rfl;
-                rvb->r_buf_flt_out[k][j][1] = rvb->r_buf_flt_out[k][j][0];
-                rvb->r_buf_flt_out[k][j][0] = r_buf_flt;
-                buffer[i + 1] += r_buf_flt / 8;
-            }
-        }
+        l_rfl = l_buf[pos & l_mask];
+        l_buf[pos & l_mask] = 0;
+        r_rfl = r_buf[pos & r_mask];
+        r_buf[pos & r_mask] = 0;
+        active = tmp_l_val | tmp_r_val | l_rfl | r_rfl;
+
+        rvb->filter(rvb, l_rfl, r_rfl, &buffer[i]);
 
         /*
          add filtered result back into the buffers but on the opposite side
@@ -366,12 +674,324 @@ void _WM_do_reverb(struct _rvb *rvb, int32_t *buffer, int size) {
         tmp_l_val = buffer[i + 1] / vol_div;
         tmp_r_val = buffer[i] / vol_div;
         for (j = 0; j < 4; j++) {
-            rvb->l_buf[rvb->l_in[j]] += tmp_l_val;
-            rvb->l_in[j] = (rvb->l_in[j] + 1) % rvb->l_buf_size;
+            l_buf[(pos + rvb->l_in[j]) & l_mask] += tmp_l_val;
+            r_buf[(pos + rvb->r_in[j]) & r_mask] += tmp_r_val;
+        }
+        active |= tmp_l_val | tmp_r_val;
+        quiet = active ? 0 : quiet + 1;
+        pos++;
+    }
+    rvb->pos = pos;
+    /* no need to count any further, and it must not wrap */
+    if (quiet > rvb_room_settle(rvb)) quiet = rvb_room_settle(rvb);
+    rvb->quiet = quiet;
+}
 
-            rvb->r_buf[rvb->r_in[j]] += tmp_r_val;
-            rvb->r_in[j] = (rvb->r_in[j] + 1) % rvb->r_buf_size;
+/*
+ The mono room is the left half of the stereo one: both speakers play the
+ one channel into the left ring buffer, its reflections come back through
+ the left filters and are fed back into it. That halves the work and gives
+ about what the stereo room gives each side for a centred sound.
+ */
+static void rvb_do_room_mono(struct _rvb *rvb, int32_t *buffer, int size) {
+    int i, j;
+    int32_t *l_buf = rvb->l_buf;
+    uint32_t l_mask = rvb->l_buf_mask;
+    uint32_t pos = rvb->pos;
+    uint32_t quiet = rvb->quiet;
+    int32_t rfl;
+    int32_t tmp_val;
+    int32_t active;
+    int vol_div = 64;
+
+    for (i = 0; i < size; i++) {
+        tmp_val = buffer[i] / vol_div;
+        for (j = 0; j < 4; j++) {
+            l_buf[(pos + rvb->l_sp_in[j]) & l_mask] += tmp_val;
+            l_buf[(pos + rvb->r_sp_in[j]) & l_mask] += tmp_val;
+        }
+
+        rfl = l_buf[pos & l_mask];
+        l_buf[pos & l_mask] = 0;
+        active = tmp_val | rfl;
+
+        rvb->filter_mono(rvb, rfl, &buffer[i]);
+
+        tmp_val = buffer[i] / vol_div;
+        for (j = 0; j < 4; j++) {
+            l_buf[(pos + rvb->l_in[j]) & l_mask] += tmp_val;
+        }
+        active |= tmp_val;
+        quiet = active ? 0 : quiet + 1;
+        pos++;
+    }
+    rvb->pos = pos;
+    if (quiet > rvb_room_settle(rvb)) quiet = rvb_room_settle(rvb);
+    rvb->quiet = quiet;
+}
+
+/*
+ rvb_init_fdn
+
+ =========================
+ Engine Description (WM_RE_FDN)
+
+ 4 delay lines, the left speaker feeding 2 of them and the right speaker
+ the other 2. Each line goes through a low pass that mimics surface
+ absorbtion and is fed back into all of the lines through a householder
+ matrix, which mixes them without adding or losing energy. The line gains
+ are set so everything dies down by 60dB in the room's reverb time.
+
+ Only a few dozen operations per frame, meant for when throughput counts
+ more than the placement of the reflections.
+ */
+
+/* Schroeder's comb delays in ms, used as is for the default 16.875m x 22.5m room */
+static const double fdn_ms[4] = {29.7, 37.1, 41.1, 43.7};
+
+static struct _rvb *
+rvb_init_fdn(int rate, float room_x, float room_y) {
+    struct _rvb *rtn_rvb = (struct _rvb *) malloc(sizeof(struct _rvb));
+    double scale = sqrt(((double) room_x * room_y) / (16.875 * 22.5));
+    /* the default room rings for about 0.8 seconds */
+    double rt60 = 0.1 + sqrt(((double) room_x * room_x) + ((double) room_y * room_y)) / 40.0;
+    uint32_t max_len = 0;
+    int i;
+
+    if (rtn_rvb == NULL) {
+        return NULL;
+    }
+    rtn_rvb->engine = WM_RE_FDN;
+    rtn_rvb->l_buf = NULL;
+    rtn_rvb->r_buf = NULL;
+    rtn_rvb->l_buf_mask = 0;
+    rtn_rvb->r_buf_mask = 0;
+    rtn_rvb->pos = 0;
+    rtn_rvb->gain = 4;
+
+    for (i = 0; i < 4; i++) {
+        rtn_rvb->fdn_len[i] = (uint32_t) ((double) rate * fdn_ms[i] * scale / 1000.0);
+        if (rtn_rvb->fdn_len[i] < 16) {
+            rtn_rvb->fdn_len[i] = 16 + i;
+        }
+        if (rtn_rvb->fdn_len[i] > max_len) {
+            max_len = rtn_rvb->fdn_len[i];
         }
+        rtn_rvb->fdn_gain[i] = (int32_t) (pow(10.0,
+                -3.0 * rtn_rvb->fdn_len[i] / (rt60 * rate)) * 1024.0);
+    }
+    rtn_rvb->fdn_damp = (int32_t) ((1.0 - exp(-2.0 * M_PI * 4000.0 / rate)) * 1024.0);
+
+    /* a line is read fdn_len behind where it is written, so it needs one more */
+    rtn_rvb->fdn_mask = rvb_ring_size(max_len + 1) - 1;
+    rtn_rvb->fdn_buf = (int32_t *) malloc(sizeof(int32_t) * 4 * (rtn_rvb->fdn_mask + 1));
+    if (rtn_rvb->fdn_buf == NULL) {
+        free(rtn_rvb);
+        return NULL;
+    }
+
+    _WM_reset_reverb(rtn_rvb);
+    return rtn_rvb;
+}
+
+static void rvb_reset_fdn(struct _rvb *rvb) {
+    uint32_t i;
+    for (i = 0; i < 4 * (rvb->fdn_mask + 1); i++) {
+        rvb->fdn_buf[i] = 0;
     }
+    for (i = 0; i < 4; i++) {
+        rvb->fdn_lp[i] = 0;
+    }
+    /* once every slot of the lines has been written with zero */
+    rvb->quiet = rvb->fdn_mask + 1;
 }
 
+static void rvb_do_fdn(struct _rvb *rvb, int32_t *buffer, int size) {
+    int32_t *line0 = rvb->fdn_buf;
+    int32_t *line1 = line0 + rvb->fdn_mask + 1;
+    int32_t *line2 = line1 + rvb->fdn_mask + 1;
+    int32_t *line3 = line2 + rvb->fdn_mask + 1;
+    uint32_t mask = rvb->fdn_mask;
+    uint32_t pos = rvb->pos;
+    int32_t damp = rvb->fdn_damp;
+    int32_t lp0 = rvb->fdn_lp[0];
+    int32_t lp1 = rvb->fdn_lp[1];
+    int32_t lp2 = rvb->fdn_lp[2];
+    int32_t lp3 = rvb->fdn_lp[3];
+    uint32_t quiet = rvb->quiet;
+    int32_t half;
+    int32_t tmp_l_val;
+    int32_t tmp_r_val;
+    int32_t w0, w1, w2, w3;
+    int i;
+
+    for (i = 0; i < size; i += 2) {
+        lp0 += ((line0[(pos - rvb->fdn_len[0]) & mask] - lp0) * damp) / 1024;
+        lp1 += ((line1[(pos - rvb->fdn_len[1]) & mask] - lp1) * damp) / 1024;
+        lp2 += ((line2[(pos - rvb->fdn_len[2]) & mask] - lp2) * damp) / 1024;
+        lp3 += ((line3[(pos - rvb->fdn_len[3]) & mask] - lp3) * damp) / 1024;
+
+        /* about as loud as the room model */
+        tmp_l_val = buffer[i] / 4;
+        tmp_r_val = buffer[i + 1] / 4;
+        buffer[i] += (lp0 + lp2) / 3;
+        buffer[i + 1] += (lp1 + lp3) / 3;
+
+        /* householder feedback, each line less half of all of them */
+        half = (lp0 + lp1 + lp2 + lp3) / 2;
+        w0 = tmp_l_val + ((lp0 - half) * rvb->fdn_gain[0]) / 1024;
+        w1 = tmp_l_val + ((lp1 - half) * rvb->fdn_gain[1]) / 1024;
+        w2 = tmp_r_val + ((lp2 - half) * rvb->fdn_gain[2]) / 1024;
+        w3 = tmp_r_val + ((lp3 - half) * rvb->fdn_gain[3]) / 1024;
+        line0[pos & mask] = w0;
+        line1[pos & mask] = w1;
+        line2[pos & mask] = w2;
+        line3[pos & mask] = w3;
+        quiet = (w0 | w1 | w2 | w3) ? 0 : quiet + 1;
+        pos++;
+    }
+
+    rvb->fdn_lp[0] = lp0;
+    rvb->fdn_lp[1] = lp1;
+    rvb->fdn_lp[2] = lp2;
+    rvb->fdn_lp[3] = lp3;
+    rvb->pos = pos;
+    if (quiet > mask + 1) quiet = mask + 1;
+    rvb->quiet = quiet;
+}
+
+/* every line fed the one channel, which gets what both sides would */
+static void rvb_do_fdn_mono(struct _rvb *rvb, int32_t *buffer, int size) {
+    int32_t *line0 = rvb->fdn_buf;
+    int32_t *line1 = line0 + rvb->fdn_mask + 1;
+    int32_t *line2 = line1 + rvb->fdn_mask + 1;
+    int32_t *line3 = line2 + rvb->fdn_mask + 1;
+    uint32_t mask = rvb->fdn_mask;
+    uint32_t pos = rvb->pos;
+    int32_t damp = rvb->fdn_damp;
+    int32_t lp0 = rvb->fdn_lp[0];
+    int32_t lp1 = rvb->fdn_lp[1];
+    int32_t lp2 = rvb->fdn_lp[2];
+    int32_t lp3 = rvb->fdn_lp[3];
+    uint32_t quiet = rvb->quiet;
+    int32_t half;
+    int32_t tmp_val;
+    int32_t w0, w1, w2, w3;
+    int i;
+
+    for (i = 0; i < size; i++) {
+        lp0 += ((line0[(pos - rvb->fdn_len[0]) & mask] - lp0) * damp) / 1024;
+        lp1 += ((line1[(pos - rvb->fdn_len[1]) & mask] - lp1) * damp) / 1024;
+        lp2 += ((line2[(pos - rvb->fdn_len[2]) & mask] - lp2) * damp) / 1024;
+        lp3 += ((line3[(pos - rvb->fdn_len[3]) & mask] - lp3) * damp) / 1024;
+
+        tmp_val = buffer[i] / 4;
+        half = (lp0 + lp1 + lp2 + lp3) / 2;
+        /* the average of the two sides rvb_do_fdn puts out */
+        buffer[i] += half / 3;
+
+        w0 = tmp_val + ((lp0 - half) * rvb->fdn_gain[0]) / 1024;
+        w1 = tmp_val + ((lp1 - half) * rvb->fdn_gain[1]) / 1024;
+        w2 = tmp_val + ((lp2 - half) * rvb->fdn_gain[2]) / 1024;
+        w3 = tmp_val + ((lp3 - half) * rvb->fdn_gain[3]) / 1024;
+        line0[pos & mask] = w0;
+        line1[pos & mask] = w1;
+        line2[pos & mask] = w2;
+        line3[pos & mask] = w3;
+        quiet = (w0 | w1 | w2 | w3) ? 0 : quiet + 1;
+        pos++;
+    }
+
+    rvb->fdn_lp[0] = lp0;
+    rvb->fdn_lp[1] = lp1;
+    rvb->fdn_lp[2] = lp2;
+    rvb->fdn_lp[3] = lp3;
+    rvb->pos = pos;
+    if (quiet > mask + 1) quiet = mask + 1;
+    rvb->quiet = quiet;
+}
+
+void _WM_reset_reverb(struct _rvb *rvb) {
+    if (rvb->engine == WM_RE_FDN) {
+        rvb_reset_fdn(rvb);
+    } else {
+        rvb_reset_room(rvb);
+    }
+}
+
+/*
+ _WM_init_reverb - set up the given engine, listen_x and listen_y only
+ matter to WM_RE_ROOM
+ */
+struct _rvb *
+_WM_init_reverb(uint8_t engine, int rate, float room_x, float room_y,
+        float listen_x, float listen_y) {
+    if (engine == WM_RE_FDN) {
+        return rvb_init_fdn(rate, room_x, room_y);
+    }
+    return rvb_init_room(rate, room_x, room_y, listen_x, listen_y);
+}
+
+void _WM_do_reverb(struct _rvb *rvb, int32_t *buffer, int size, int channels) {
+    if (rvb->engine == WM_RE_FDN) {
+        if (channels == 1) {
+            rvb_do_fdn_mono(rvb, buffer, size);
+        } else {
+            rvb_do_fdn(rvb, buffer, size);
+        }
+    } else {
+        if (channels == 1) {
+            rvb_do_room_mono(rvb, buffer, size);
+        } else {
+            rvb_do_room(rvb, buffer, size);
+        }
+    }
+}
+
+/*
+ The engines work on the integers of the fixed point mix, so the float mix
+ goes through them a chunk at a time: a copy of it at 16bit scale is run
+ through the engine and only what the reverb added to that is put back,
+ leaving the dry signal at full float precision.
+ */
+#define RVB_FLOAT_CHUNK 256
+
+void _WM_do_reverb_float(struct _rvb *rvb, float *buffer, int size, int channels) {
+    int32_t dry[RVB_FLOAT_CHUNK];
+    int32_t wet[RVB_FLOAT_CHUNK];
+    int i, n;
+
+    while (size > 0) {
+        n = (size > RVB_FLOAT_CHUNK) ? RVB_FLOAT_CHUNK : size;
+        for (i = 0; i < n; i++) {
+            dry[i] = (int32_t) (buffer[i] * 32768.0f);
+            wet[i] = dry[i];
+        }
+        _WM_do_reverb(rvb, wet, n, channels);
+        for (i = 0; i < n; i++) {
+            buffer[i] += (float) (wet[i] - dry[i]) * (1.0f / 32768.0f);
+        }
+        buffer += n;
+        size -= n;
+    }
+}
+
+int _WM_reverb_idle(struct _rvb *rvb) {
+    int i;
+
+    if (rvb->engine == WM_RE_FDN) {
+        if (rvb->quiet < rvb->fdn_mask + 1) return 0;
+        for (i = 0; i < 4; i++) {
+            if (rvb->fdn_lp[i]) return 0;
+        }
+        return 1;
+    }
+
+    if (rvb->quiet < rvb_room_settle(rvb)) return 0;
+    /* the filters may still ring with nothing going into the buffers */
+    for (i = 0; i < RVB_FILTERS; i++) {
+        if (rvb->l_buf_flt_out[0][i] | rvb->l_buf_flt_out[1][i]
+                | rvb->r_buf_flt_out[0][i] | rvb->r_buf_flt_out[1][i]) return 0;
+    }
+    return 1;
+}
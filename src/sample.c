@@ -25,9 +25,12 @@
 
 #include <stdio.h>
 #include <stdint.h>
+#include <stdlib.h>
 
 #include "lock.h"
 #include "common.h"
+#include "file_io.h"
+#include "bank.h"
 #include "patches.h"
 #include "gus_pat.h"
 #include "wildmidi_lib.h"
@@ -38,6 +41,34 @@
  FIXME: Need to decide if this stuff needs to be broken up for different formats.
  */
 
+/* allocate zeroed storage for length samples plus the guard samples */
+int16_t *_WM_alloc_sample_data(uint32_t length) {
+    int16_t *data = (int16_t *) calloc((length + (SAMPLE_GUARD * 2)), sizeof(int16_t));
+
+    if (data == NULL) return (NULL);
+    return (data + SAMPLE_GUARD);
+}
+
+void _WM_free_sample_data(int16_t *data) {
+    if (data != NULL) free(data - SAMPLE_GUARD);
+}
+
+/* frees sample and the rest of its list */
+void _WM_free_samples(struct _sample *sample) {
+    struct _sample *next_sample;
+
+    while (sample) {
+        next_sample = sample->next;
+        if (sample->map != NULL) {
+            _WM_UnrefMap(sample->map);
+        } else {
+            _WM_free_sample_data(sample->data);
+        }
+        free(sample);
+        sample = next_sample;
+    }
+}
+
 uint32_t _WM_get_decay_samples(struct _mdi * mdi, uint8_t channel, uint8_t note) {
     struct _patch *patch = NULL;
     struct _sample *sample = NULL;
@@ -77,30 +108,30 @@ uint32_t _WM_get_decay_samples(struct _mdi * mdi, uint8_t channel, uint8_t note)
 }
 
 
+/*
+ * Called for every note on, so this doesn't lock. Samples are only added to
+ * a patch by _WM_load_sample, which publishes the complete list in one go,
+ * and only freed once no midi is using the patch any more.
+ */
 struct _sample *_WM_get_sample_data(struct _patch *sample_patch, uint32_t freq) {
     struct _sample *last_sample = NULL;
     struct _sample *return_sample = NULL;
 
-    _WM_Lock(&_WM_patch_lock);
     if (sample_patch == NULL) {
-        _WM_Unlock(&_WM_patch_lock);
         return (NULL);
     }
-    if (sample_patch->first_sample == NULL) {
-        _WM_Unlock(&_WM_patch_lock);
+    return_sample = _WM_LoadAcquire(sample_patch->first_sample);
+    if (return_sample == NULL) {
         return (NULL);
     }
     if (freq == 0) {
-        _WM_Unlock(&_WM_patch_lock);
-        return (sample_patch->first_sample);
+        return (return_sample);
     }
 
-    return_sample = sample_patch->first_sample;
-    last_sample = sample_patch->first_sample;
+    last_sample = return_sample;
     while (last_sample) {
         if (freq > last_sample->freq_low) {
             if (freq < last_sample->freq_high) {
-                _WM_Unlock(&_WM_patch_lock);
                 return (last_sample);
             } else {
                 return_sample = last_sample;
@@ -108,26 +139,28 @@ struct _sample *_WM_get_sample_data(struct _patch *sample_patch, uint32_t freq)
         }
         last_sample = last_sample->next;
     }
-    _WM_Unlock(&_WM_patch_lock);
     return (return_sample);
 }
 
 /* sample loading */
 
 int
-_WM_load_sample(struct _patch *sample_patch) {
+_WM_load_sample(struct _WM_Context *ctx, struct _patch *sample_patch) {
     struct _sample *guspat = NULL;
+    struct _sample *first_sample = NULL;
     struct _sample *tmp_sample = NULL;
     uint32_t i = 0;
 
-    /* we only want to try loading the guspat once. */
-    sample_patch->loaded = 1;
+    if ((first_sample = _WM_get_bank_samples(ctx, sample_patch)) != NULL) {
+        _WM_StoreRelease(sample_patch->first_sample, first_sample);
+        return (0);
+    }
 
-    if ((guspat = _WM_load_gus_pat(sample_patch->filename, _WM_fix_release)) == NULL) {
+    if ((guspat = _WM_load_gus_pat(sample_patch->filename, ctx->fix_release, ctx->sample_rate)) == NULL) {
         return (-1);
     }
 
-    if (_WM_auto_amp) {
+    if (ctx->auto_amp) {
         int16_t tmp_max = 0;
         int16_t tmp_min = 0;
         int16_t samp_max = 0;
@@ -148,7 +181,7 @@ _WM_load_sample(struct _patch *sample_patch) {
                 tmp_min = samp_min;
             tmp_sample = tmp_sample->next;
         } while (tmp_sample);
-        if (_WM_auto_amp_with_amp) {
+        if (ctx->auto_amp_with_amp) {
             if (tmp_max >= -tmp_min) {
                 sample_patch->amp = (sample_patch->amp
                                      * ((32767 << 10) / tmp_max)) >> 10;
@@ -165,7 +198,7 @@ _WM_load_sample(struct _patch *sample_patch) {
         }
     }
 
-    sample_patch->first_sample = guspat;
+    first_sample = guspat;
 
     if (sample_patch->patchid & 0x0080) {
         if (!(sample_patch->keep & SAMPLE_LOOP)) {
@@ -174,14 +207,14 @@ _WM_load_sample(struct _patch *sample_patch) {
                 guspat = guspat->next;
             } while (guspat);
         }
-        guspat = sample_patch->first_sample;
+        guspat = first_sample;
         if (!(sample_patch->keep & SAMPLE_ENVELOPE)) {
             do {
                 guspat->modes &= 0xBF;
                 guspat = guspat->next;
             } while (guspat);
         }
-        guspat = sample_patch->first_sample;
+        guspat = first_sample;
     }
 
     if (sample_patch->patchid == 47) {
@@ -194,7 +227,7 @@ _WM_load_sample(struct _patch *sample_patch) {
             }
             guspat = guspat->next;
         } while (guspat);
-        guspat = sample_patch->first_sample;
+        guspat = first_sample;
     }
 
     do {
@@ -218,17 +251,20 @@ _WM_load_sample(struct _patch *sample_patch) {
                 }
                 if (sample_patch->env[i].set & 0x01) {
                     guspat->env_rate[i] = (int32_t) (4194303.0f
-                                                     / ((float) _WM_SampleRate
+                                                     / ((float) ctx->sample_rate
                                                         * (sample_patch->env[i].time / 1000.0f)));
                 }
             } else {
                 guspat->env_target[i] = 4194303;
                 guspat->env_rate[i] = (int32_t) (4194303.0f
-                                                 / ((float) _WM_SampleRate * env_time_table[63]));
+                                                 / ((float) ctx->sample_rate * env_time_table[63]));
             }
         }
 
         guspat = guspat->next;
     } while (guspat);
+
+    /* note ons read this without locking, so only show them the finished list */
+    _WM_StoreRelease(sample_patch->first_sample, first_sample);
     return (0);
 }
@@ -0,0 +1,531 @@
+/*
+ * threadpool.c -- Midi Wavetable Processing library
+ *
+ * Copyright (C) WildMIDI Developers 2001-2024
+ *
+ * This file is part of WildMIDI.
+ *
+ * WildMIDI is free software: you can redistribute and/or modify the player
+ * under the terms of the GNU General Public License and you can redistribute
+ * and/or modify the library under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either version 3 of
+ * the licenses, or(at your option) any later version.
+ *
+ * WildMIDI is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License and
+ * the GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License and the
+ * GNU Lesser General Public License along with WildMIDI.  If not,  see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#if !defined(WM_NO_THREADS) && !defined(WM_NO_LOCK)
+#if defined(_WIN32)
+#define WM_THREADS_WIN32 1
+#elif defined(HAVE_PTHREAD_H)
+#define WM_THREADS_PTHREAD 1
+#endif
+#endif
+
+#if defined(WM_THREADS_WIN32)
+#include <windows.h>
+#include <process.h>
+#elif defined(WM_THREADS_PTHREAD)
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+#endif
+
+#include "lock.h"
+#include "wm_error.h"
+#include "threadpool.h"
+
+/* threads plus the calling one */
+#define POOL_MAX_WORKERS 64
+
+static struct _pool_scratch {
+    void *data;
+    uint32_t size;
+} pool_scratch[POOL_MAX_WORKERS];
+
+/* one batch at a time, also guards starting and stopping the threads */
+static int pool_run_lock = 0;
+
+void *_WM_pool_scratch(uint32_t worker, uint32_t size) {
+    struct _pool_scratch *scratch = &pool_scratch[worker];
+
+    if (size > scratch->size) {
+        void *data = realloc(scratch->data, size);
+        if (data == NULL) {
+            return (NULL);
+        }
+        scratch->data = data;
+        scratch->size = size;
+    }
+    return (scratch->data);
+}
+
+static void pool_free_scratch(void) {
+    uint32_t i;
+
+    for (i = 0; i < POOL_MAX_WORKERS; i++) {
+        free(pool_scratch[i].data);
+        pool_scratch[i].data = NULL;
+        pool_scratch[i].size = 0;
+    }
+}
+
+#if defined(WM_THREADS_WIN32) || defined(WM_THREADS_PTHREAD)
+
+/*
+ * The batch being run, guarded by pool_mutex. Idle threads wait for a
+ * ticket, the caller hands out one per thread it wants to help and waits
+ * until pool_pending says all of them have been handed back. A quick thread
+ * may take two tickets of the same batch, which is harmless as it then
+ * simply finds nothing left to do, and the slow one sleeps on until the
+ * next batch.
+ */
+static _WM_PoolJob pool_job;
+static void *pool_data;
+static uint32_t pool_count;
+static uint32_t pool_next;
+static uint32_t pool_tickets;
+static uint32_t pool_pending;
+static int pool_quit;
+
+/*
+ * Work queued by _WM_pool_post, also guarded by pool_mutex. Threads only
+ * take from it while there is no ticket for them, one item at a time, and
+ * pool_busy counts those that are running one so that batches don't wait
+ * for them.
+ */
+struct _pool_post {
+    _WM_PoolJob job;
+    void *data;
+    uint32_t count;
+    uint32_t next;
+    struct _pool_post *link;
+};
+
+static struct _pool_post *pool_posted;
+static struct _pool_post *pool_posted_last;
+static uint32_t pool_busy;
+
+static uint32_t pool_threads;
+static int pool_started;
+
+#if defined(WM_THREADS_WIN32)
+
+static CRITICAL_SECTION pool_mutex;
+static HANDLE pool_wake;
+static HANDLE pool_idle;
+static HANDLE pool_thread[POOL_MAX_WORKERS - 1];
+
+#define pool_lock() EnterCriticalSection(&pool_mutex)
+#define pool_unlock() LeaveCriticalSection(&pool_mutex)
+
+#else
+
+static pthread_mutex_t pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pool_wake = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t pool_idle = PTHREAD_COND_INITIALIZER;
+static pthread_t pool_thread[POOL_MAX_WORKERS - 1];
+
+#define pool_lock() pthread_mutex_lock(&pool_mutex)
+#define pool_unlock() pthread_mutex_unlock(&pool_mutex)
+
+#endif
+
+/* runs batch items until there are none left, with pool_mutex held */
+static void pool_work(uint32_t worker) {
+    uint32_t index;
+
+    while (pool_next < pool_count) {
+        index = pool_next++;
+        pool_unlock();
+        pool_job(pool_data, index, worker);
+        pool_lock();
+    }
+}
+
+/* runs one posted item, with pool_mutex held */
+static void pool_work_posted(uint32_t worker) {
+    struct _pool_post *post = pool_posted;
+    _WM_PoolJob job = post->job;
+    void *data = post->data;
+    uint32_t index = post->next++;
+
+    if (post->next == post->count) {
+        pool_posted = post->link;
+        if (pool_posted == NULL) {
+            pool_posted_last = NULL;
+        }
+        free(post);
+    }
+    pool_busy++;
+    pool_unlock();
+    job(data, index, worker);
+    pool_lock();
+    pool_busy--;
+}
+
+#if defined(WM_THREADS_WIN32)
+
+static unsigned __stdcall pool_main(void *arg) {
+    uint32_t worker = (uint32_t) (uintptr_t) arg;
+
+    pool_lock();
+    for (;;) {
+        /* wakes may be left over, so look before going back to sleep */
+        while (!pool_tickets && !pool_posted && !pool_quit) {
+            pool_unlock();
+            WaitForSingleObject(pool_wake, INFINITE);
+            pool_lock();
+        }
+        if (pool_tickets) {
+            pool_tickets--;
+            pool_work(worker);
+            if (--pool_pending == 0) {
+                SetEvent(pool_idle);
+            }
+        } else if (pool_posted) {
+            pool_work_posted(worker);
+        } else {
+            /* quitting, with nothing left that was posted */
+            break;
+        }
+    }
+    pool_unlock();
+    return (0);
+}
+
+static uint32_t pool_cpus(void) {
+    SYSTEM_INFO info;
+
+    GetSystemInfo(&info);
+    return (info.dwNumberOfProcessors);
+}
+
+static int pool_create(void) {
+    InitializeCriticalSection(&pool_mutex);
+    pool_wake = CreateSemaphore(NULL, 0, POOL_MAX_WORKERS, NULL);
+    pool_idle = CreateEvent(NULL, FALSE, FALSE, NULL);
+    if ((pool_wake == NULL) || (pool_idle == NULL)) {
+        if (pool_wake) CloseHandle(pool_wake);
+        if (pool_idle) CloseHandle(pool_idle);
+        DeleteCriticalSection(&pool_mutex);
+        return (-1);
+    }
+    return (0);
+}
+
+static int pool_spawn(uint32_t i) {
+    pool_thread[i] = (HANDLE) _beginthreadex(NULL, 0, pool_main,
+                                             (void *) (uintptr_t) (i + 1), 0, NULL);
+    return ((pool_thread[i] == NULL) ? -1 : 0);
+}
+
+static void pool_destroy(void) {
+    uint32_t i;
+
+    pool_lock();
+    pool_quit = 1;
+    pool_unlock();
+    ReleaseSemaphore(pool_wake, pool_threads, NULL);
+    for (i = 0; i < pool_threads; i++) {
+        WaitForSingleObject(pool_thread[i], INFINITE);
+        CloseHandle(pool_thread[i]);
+    }
+    CloseHandle(pool_wake);
+    CloseHandle(pool_idle);
+    DeleteCriticalSection(&pool_mutex);
+}
+
+/* with pool_mutex held */
+static void pool_notify(uint32_t wake) {
+    ReleaseSemaphore(pool_wake, wake, NULL);
+}
+
+/* hands the tickets out and takes items until all of them are done */
+static void pool_dispatch(uint32_t tickets) {
+    pool_lock();
+    pool_tickets = tickets;
+    pool_unlock();
+    ReleaseSemaphore(pool_wake, tickets, NULL);
+    pool_lock();
+    pool_work(0);
+    pool_unlock();
+    /* set by whichever thread hands the last ticket back */
+    WaitForSingleObject(pool_idle, INFINITE);
+}
+
+#else /* WM_THREADS_PTHREAD */
+
+static void *pool_main(void *arg) {
+    uint32_t worker = (uint32_t) (uintptr_t) arg;
+
+    pool_lock();
+    for (;;) {
+        while (!pool_tickets && !pool_posted && !pool_quit) {
+            pthread_cond_wait(&pool_wake, &pool_mutex);
+        }
+        if (pool_tickets) {
+            pool_tickets--;
+            pool_work(worker);
+            if (--pool_pending == 0) {
+                pthread_cond_signal(&pool_idle);
+            }
+        } else if (pool_posted) {
+            pool_work_posted(worker);
+        } else {
+            /* quitting, with nothing left that was posted */
+            break;
+        }
+    }
+    pool_unlock();
+    return (NULL);
+}
+
+static uint32_t pool_cpus(void) {
+#if defined(_SC_NPROCESSORS_ONLN)
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpus > 0) {
+        return ((uint32_t) cpus);
+    }
+#endif
+    return (1);
+}
+
+static int pool_create(void) {
+    return (0);
+}
+
+static int pool_spawn(uint32_t i) {
+    sigset_t all, old;
+    int ret;
+
+    /* signals are for the program's own threads to handle */
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    ret = pthread_create(&pool_thread[i], NULL, pool_main, (void *) (uintptr_t) (i + 1));
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    return ((ret != 0) ? -1 : 0);
+}
+
+static void pool_destroy(void) {
+    uint32_t i;
+
+    pool_lock();
+    pool_quit = 1;
+    pthread_cond_broadcast(&pool_wake);
+    pool_unlock();
+    for (i = 0; i < pool_threads; i++) {
+        pthread_join(pool_thread[i], NULL);
+    }
+}
+
+/* with pool_mutex held */
+static void pool_notify(uint32_t wake) {
+    (void) wake;
+    pthread_cond_broadcast(&pool_wake);
+}
+
+static void pool_dispatch(uint32_t tickets) {
+    pool_lock();
+    pool_tickets = tickets;
+    pthread_cond_broadcast(&pool_wake);
+    pool_work(0);
+    while (pool_pending) {
+        pthread_cond_wait(&pool_idle, &pool_mutex);
+    }
+    pool_unlock();
+}
+
+#endif
+
+static void pool_start(void) {
+    uint32_t cpus = pool_cpus();
+    uint32_t wanted = (cpus > 1) ? cpus - 1 : 0;
+
+    pool_started = 1;
+    if (wanted > POOL_MAX_WORKERS - 1) {
+        wanted = POOL_MAX_WORKERS - 1;
+    }
+    if (!wanted || (pool_create() != 0)) {
+        return;
+    }
+    pool_quit = 0;
+    /* make do with whatever we manage to start */
+    while ((pool_threads < wanted) && (pool_spawn(pool_threads) == 0)) {
+        pool_threads++;
+    }
+    if (!pool_threads) {
+        pool_destroy();
+    }
+}
+
+/* runs a batch, with pool_run_lock held */
+static void pool_run(_WM_PoolJob job, void *data, uint32_t count) {
+    uint32_t i;
+    uint32_t tickets;
+
+    if (!pool_started) {
+        pool_start();
+    }
+    if ((pool_threads == 0) || (count < 2)) {
+        for (i = 0; i < count; i++) {
+            job(data, i, 0);
+        }
+        return;
+    }
+
+    pool_lock();
+    /*
+     * no point in waking more threads than there are items for them, nor
+     * in waiting for those busy with something posted
+     */
+    tickets = pool_threads - pool_busy;
+    if (count - 1 < tickets) {
+        tickets = count - 1;
+    }
+    if (tickets == 0) {
+        pool_unlock();
+        for (i = 0; i < count; i++) {
+            job(data, i, 0);
+        }
+        return;
+    }
+    pool_job = job;
+    pool_data = data;
+    pool_count = count;
+    pool_next = 0;
+    pool_pending = tickets;
+    pool_unlock();
+
+    pool_dispatch(tickets);
+}
+
+void _WM_pool_run(_WM_PoolJob job, void *data, uint32_t count) {
+    _WM_Lock(&pool_run_lock);
+    pool_run(job, data, count);
+    _WM_Unlock(&pool_run_lock);
+}
+
+int _WM_pool_try_run(_WM_PoolJob job, void *data, uint32_t count) {
+    if (_WM_TryLock(&pool_run_lock) != 0) {
+        return (-1);
+    }
+    if (!pool_started) {
+        pool_start();
+    }
+    if (pool_threads == 0) {
+        _WM_Unlock(&pool_run_lock);
+        return (-1);
+    }
+    pool_run(job, data, count);
+    _WM_Unlock(&pool_run_lock);
+    return (0);
+}
+
+int _WM_pool_post(_WM_PoolJob job, void *data, uint32_t count) {
+    struct _pool_post *post;
+
+    if (count == 0) {
+        return (0);
+    }
+    _WM_Lock(&pool_run_lock);
+    if (!pool_started) {
+        pool_start();
+    }
+    if ((pool_threads == 0)
+            || ((post = (struct _pool_post *) malloc(sizeof(struct _pool_post))) == NULL)) {
+        _WM_Unlock(&pool_run_lock);
+        return (-1);
+    }
+    post->job = job;
+    post->data = data;
+    post->count = count;
+    post->next = 0;
+    post->link = NULL;
+
+    pool_lock();
+    if (pool_posted_last) {
+        pool_posted_last->link = post;
+    } else {
+        pool_posted = post;
+    }
+    pool_posted_last = post;
+    pool_notify((count < pool_threads) ? count : pool_threads);
+    pool_unlock();
+    _WM_Unlock(&pool_run_lock);
+    return (0);
+}
+
+uint32_t _WM_pool_workers(void) {
+    uint32_t workers = 1;
+
+    if (_WM_TryLock(&pool_run_lock) == 0) {
+        if (!pool_started) {
+            pool_start();
+        }
+        workers = pool_threads + 1;
+        _WM_Unlock(&pool_run_lock);
+    }
+    return (workers);
+}
+
+void _WM_free_pool(void) {
+    _WM_Lock(&pool_run_lock);
+    if (pool_threads) {
+        pool_destroy();
+    }
+    pool_threads = 0;
+    pool_started = 0;
+    pool_free_scratch();
+    _WM_Unlock(&pool_run_lock);
+}
+
+#else /* no threads */
+
+void _WM_pool_run(_WM_PoolJob job, void *data, uint32_t count) {
+    uint32_t i;
+
+    _WM_Lock(&pool_run_lock);
+    for (i = 0; i < count; i++) {
+        job(data, i, 0);
+    }
+    _WM_Unlock(&pool_run_lock);
+}
+
+int _WM_pool_try_run(_WM_PoolJob job, void *data, uint32_t count) {
+    (void) job;
+    (void) data;
+    (void) count;
+    return (-1);
+}
+
+int _WM_pool_post(_WM_PoolJob job, void *data, uint32_t count) {
+    (void) job;
+    (void) data;
+    (void) count;
+    return (-1);
+}
+
+uint32_t _WM_pool_workers(void) {
+    return (1);
+}
+
+void _WM_free_pool(void) {
+    _WM_Lock(&pool_run_lock);
+    pool_free_scratch();
+    _WM_Unlock(&pool_run_lock);
+}
+
+#endif
@@ -49,8 +49,12 @@
 #include "f_xmidi.h"
 #include "patches.h"
 #include "sample.h"
+#include "bank.h"
 #include "mus2mid.h"
 #include "xmi2mid.h"
+#include "resample.h"
+#include "convert.h"
+#include "threadpool.h"
 
 /*
  * =========================
@@ -59,10 +63,13 @@
  */
 
 static int WM_Initialized = 0;
-uint16_t _WM_MixerOptions = 0;
 
-uint16_t _WM_SampleRate;
-int16_t _WM_MasterVolume;
+/* the context used by WildMidi_Init, WildMidi_Open and friends */
+static struct _WM_Context *WM_DefaultContext = NULL;
+
+/* number of contexts, the resampling tables are shared by all of them */
+static int WM_ContextLock = 0;
+static uint32_t WM_ContextCount = 0;
 
 /* when converting files to midi */
 typedef struct _cvt_options {
@@ -74,16 +81,6 @@ typedef struct _cvt_options {
 static _cvt_options WM_ConvertOptions = {0, 0, 0};
 
 
-float _WM_reverb_room_width = 16.875f;
-float _WM_reverb_room_length = 22.5f;
-
-float _WM_reverb_listen_posx = 8.4375f;
-float _WM_reverb_listen_posy = 16.875f;
-
-int _WM_fix_release = 0;
-int _WM_auto_amp = 0;
-int _WM_auto_amp_with_amp = 0;
-
 struct _miditrack {
     uint32_t length;
     uint32_t ptr;
@@ -97,86 +94,6 @@ struct _mdi_patches {
     struct _mdi_patch *next;
 };
 
-#define FPBITS 10
-#define FPMASK ((1L<<FPBITS)-1L)
-
-
-/* Gauss Interpolation code adapted from code supplied by Eric. A. Welsh */
-static double newt_coeffs[58][58];  /* for start/end of samples */
-#define MAX_GAUSS_ORDER 34          /* 34 is as high as we can go before errors crop up */
-static double *gauss_table = NULL;  /* *gauss_table[1<<FPBITS] */
-static int gauss_n = MAX_GAUSS_ORDER;
-static int gauss_lock;
-
-static void init_gauss(void) {
-    /* init gauss table */
-    int n = gauss_n;
-    int m, i, k, n_half = (n >> 1);
-    int j;
-    int sign;
-    double ck;
-    double x, x_inc, xz;
-    double z[35];
-    double *gptr, *t;
-
-    _WM_Lock(&gauss_lock);
-    if (gauss_table) {
-        _WM_Unlock(&gauss_lock);
-        return;
-    }
-
-    newt_coeffs[0][0] = 1;
-    for (i = 0; i <= n; i++) {
-        newt_coeffs[i][0] = 1;
-        newt_coeffs[i][i] = 1;
-
-        if (i > 1) {
-            newt_coeffs[i][0] = newt_coeffs[i - 1][0] / i;
-            newt_coeffs[i][i] = newt_coeffs[i - 1][0] / i;
-        }
-
-        for (j = 1; j < i; j++) {
-            newt_coeffs[i][j] = newt_coeffs[i - 1][j - 1]
-                    + newt_coeffs[i - 1][j];
-            if (i > 1)
-                newt_coeffs[i][j] /= i;
-        }
-        z[i] = i / (4 * M_PI);
-    }
-
-    for (i = 0; i <= n; i++)
-        for (j = 0, sign = (int) pow(-1, i); j <= i; j++, sign *= -1)
-            newt_coeffs[i][j] *= sign;
-
-    t = (double *) malloc((1<<FPBITS) * (n + 1) * sizeof(double));
-    x_inc = 1.0 / (1<<FPBITS);
-    for (m = 0, x = 0.0; m < (1<<FPBITS); m++, x += x_inc) {
-        xz = (x + n_half) / (4 * M_PI);
-        gptr = &t[m * (n + 1)];
-
-        for (k = 0; k <= n; k++) {
-            ck = 1.0;
-
-            for (i = 0; i <= n; i++) {
-                if (i == k)
-                    continue;
-
-                ck *= (sin(xz - z[i])) / (sin(z[k] - z[i]));
-            }
-            *gptr++ = ck;
-        }
-    }
-
-    gauss_table = t;
-    _WM_Unlock(&gauss_lock);
-}
-
-static void free_gauss(void) {
-    _WM_Lock(&gauss_lock);
-    free(gauss_table);
-    gauss_table = NULL;
-    _WM_Unlock(&gauss_lock);
-}
 
 struct _hndl {
     void * handle;
@@ -184,8 +101,6 @@ struct _hndl {
     struct _hndl *prev;
 };
 
-static struct _hndl * first_handle = NULL;
-
 #define MAX_AUTO_AMP 2.0
 
 /*
@@ -212,34 +127,22 @@ uint16_t _cvt_get_option (uint16_t tag) {
     return r;
 }
 
-static void WM_InitPatches(void) {
-    int i;
-    for (i = 0; i < 128; i++) {
-        _WM_patch[i] = NULL;
-    }
-}
-
-static void WM_FreePatches(void) {
+static void WM_FreePatches(struct _WM_Context *ctx) {
     int i;
     struct _patch * tmp_patch;
-    struct _sample * tmp_sample;
 
-    _WM_Lock(&_WM_patch_lock);
+    _WM_wait_patch_loads(ctx);
+    _WM_Lock(&ctx->patch_lock);
     for (i = 0; i < 128; i++) {
-        while (_WM_patch[i]) {
-            while (_WM_patch[i]->first_sample) {
-                tmp_sample = _WM_patch[i]->first_sample->next;
-                free(_WM_patch[i]->first_sample->data);
-                free(_WM_patch[i]->first_sample);
-                _WM_patch[i]->first_sample = tmp_sample;
-            }
-            free(_WM_patch[i]->filename);
-            tmp_patch = _WM_patch[i]->next;
-            free(_WM_patch[i]);
-            _WM_patch[i] = tmp_patch;
+        while (ctx->patch[i]) {
+            _WM_free_samples(ctx->patch[i]->first_sample);
+            free(ctx->patch[i]->filename);
+            tmp_patch = ctx->patch[i]->next;
+            free(ctx->patch[i]);
+            ctx->patch[i] = tmp_patch;
         }
     }
-    _WM_Unlock(&_WM_patch_lock);
+    _WM_Unlock(&ctx->patch_lock);
 }
 
 /* wm_strdup -- adds extra space for appending up to 4 chars */
@@ -353,7 +256,7 @@ static char** WM_LC_Tokenize_Line(char *line_data) {
     return (token_data);
 }
 
-static int load_config(const char *config_file, const char *conf_dir) {
+static int load_config(struct _WM_Context *ctx, const char *config_file, const char *conf_dir) {
     uint32_t config_size = 0;
     char *config_buffer = NULL;
     const char *dir_end = NULL;
@@ -368,14 +271,14 @@ static int load_config(const char *config_file, const char *conf_dir) {
 
     config_buffer = (char *) _WM_BufferFile(config_file, &config_size);
     if (!config_buffer) {
-        WM_FreePatches();
+        WM_FreePatches(ctx);
         return (-1);
     }
 
     if (conf_dir) {
         if ((config_dir = wm_strdup(conf_dir)) == NULL) {
             _WM_GLOBAL_ERROR(WM_ERR_MEM, NULL, errno);
-            WM_FreePatches();
+            WM_FreePatches(ctx);
             _WM_FreeBufferFile(config_buffer);
             return (-1);
         }
@@ -385,8 +288,8 @@ static int load_config(const char *config_file, const char *conf_dir) {
             config_dir = (char *) malloc((dir_end - config_file + 2));
             if (config_dir == NULL) {
                 _WM_GLOBAL_ERROR(WM_ERR_MEM, NULL, errno);
-                WM_FreePatches();
-                free(config_buffer);
+                WM_FreePatches(ctx);
+                _WM_FreeBufferFile(config_buffer);
                 return (-1);
             }
             strncpy(config_dir, config_file, (dir_end - config_file + 1));
@@ -415,13 +318,13 @@ static int load_config(const char *config_file, const char *conf_dir) {
                         free(config_dir);
                         if (!line_tokens[1]) {
                             _WM_GLOBAL_ERROR(WM_ERR_INVALID_ARG, "(missing name in dir line)", 0);
-                            WM_FreePatches();
+                            WM_FreePatches(ctx);
                             free(line_tokens);
                             _WM_FreeBufferFile(config_buffer);
                             return (-1);
                         } else if ((config_dir = wm_strdup(line_tokens[1])) == NULL) {
                             _WM_GLOBAL_ERROR(WM_ERR_MEM, NULL, errno);
-                            WM_FreePatches();
+                            WM_FreePatches(ctx);
                             free(line_tokens);
                             _WM_FreeBufferFile(config_buffer);
                             return (-1);
@@ -434,7 +337,7 @@ static int load_config(const char *config_file, const char *conf_dir) {
                         char *new_config = NULL;
                         if (!line_tokens[1]) {
                             _WM_GLOBAL_ERROR(WM_ERR_INVALID_ARG, "(missing name in source line)", 0);
-                            WM_FreePatches();
+                            WM_FreePatches(ctx);
                             free(line_tokens);
                             _WM_FreeBufferFile(config_buffer);
                             return (-1);
@@ -442,7 +345,7 @@ static int load_config(const char *config_file, const char *conf_dir) {
                             new_config = (char *) malloc(strlen(config_dir) + strlen(line_tokens[1]) + 1);
                             if (new_config == NULL) {
                                 _WM_GLOBAL_ERROR(WM_ERR_MEM, NULL, errno);
-                                WM_FreePatches();
+                                WM_FreePatches(ctx);
                                 free(config_dir);
                                 free(line_tokens);
                                 _WM_FreeBufferFile(config_buffer);
@@ -453,13 +356,13 @@ static int load_config(const char *config_file, const char *conf_dir) {
                         } else {
                             if ((new_config = wm_strdup(line_tokens[1])) == NULL) {
                                 _WM_GLOBAL_ERROR(WM_ERR_MEM, NULL, errno);
-                                WM_FreePatches();
+                                WM_FreePatches(ctx);
                                 free(line_tokens);
                                 _WM_FreeBufferFile(config_buffer);
                                 return (-1);
                             }
                         }
-                        if (load_config(new_config, config_dir) == -1) {
+                        if (load_config(ctx, new_config, config_dir) == -1) {
                             free(new_config);
                             free(line_tokens);
                             _WM_FreeBufferFile(config_buffer);
@@ -470,7 +373,7 @@ static int load_config(const char *config_file, const char *conf_dir) {
                     } else if (wm_strcasecmp(line_tokens[0], "bank") == 0) {
                         if (!line_tokens[1] || !wm_isdigit(line_tokens[1][0])) {
                             _WM_GLOBAL_ERROR(WM_ERR_INVALID_ARG, "(syntax error in bank line)", 0);
-                            WM_FreePatches();
+                            WM_FreePatches(ctx);
                             free(config_dir);
                             free(line_tokens);
                             _WM_FreeBufferFile(config_buffer);
@@ -480,7 +383,7 @@ static int load_config(const char *config_file, const char *conf_dir) {
                     } else if (wm_strcasecmp(line_tokens[0], "drumset") == 0) {
                         if (!line_tokens[1] || !wm_isdigit(line_tokens[1][0])) {
                             _WM_GLOBAL_ERROR(WM_ERR_INVALID_ARG, "(syntax error in drumset line)", 0);
-                            WM_FreePatches();
+                            WM_FreePatches(ctx);
                             free(config_dir);
                             free(line_tokens);
                             _WM_FreeBufferFile(config_buffer);
@@ -490,99 +393,116 @@ static int load_config(const char *config_file, const char *conf_dir) {
                     } else if (wm_strcasecmp(line_tokens[0], "reverb_room_width") == 0) {
                         if (!line_tokens[1] || !wm_isdigit(line_tokens[1][0])) {
                             _WM_GLOBAL_ERROR(WM_ERR_INVALID_ARG, "(syntax error in reverb_room_width line)", 0);
-                            WM_FreePatches();
+                            WM_FreePatches(ctx);
                             free(config_dir);
                             free(line_tokens);
                             _WM_FreeBufferFile(config_buffer);
                             return (-1);
                         }
-                        _WM_reverb_room_width = (float) atof(line_tokens[1]);
-                        if (_WM_reverb_room_width < 1.0f) {
+                        ctx->reverb_room_width = (float) atof(line_tokens[1]);
+                        if (ctx->reverb_room_width < 1.0f) {
                             _WM_DEBUG_MSG("%s: reverb_room_width < 1m, setting to 1m", config_file);
-                            _WM_reverb_room_width = 1.0f;
-                        } else if (_WM_reverb_room_width > 100.0f) {
+                            ctx->reverb_room_width = 1.0f;
+                        } else if (ctx->reverb_room_width > 100.0f) {
                             _WM_DEBUG_MSG("%s: reverb_room_width > 100m, setting to 100m", config_file);
-                            _WM_reverb_room_width = 100.0f;
+                            ctx->reverb_room_width = 100.0f;
                         }
                     } else if (wm_strcasecmp(line_tokens[0], "reverb_room_length") == 0) {
                         if (!line_tokens[1] || !wm_isdigit(line_tokens[1][0])) {
                             _WM_GLOBAL_ERROR(WM_ERR_INVALID_ARG, "(syntax error in reverb_room_length line)", 0);
-                            WM_FreePatches();
+                            WM_FreePatches(ctx);
                             free(config_dir);
                             free(line_tokens);
                             _WM_FreeBufferFile(config_buffer);
                             return (-1);
                         }
-                        _WM_reverb_room_length = (float) atof(line_tokens[1]);
-                        if (_WM_reverb_room_length < 1.0f) {
+                        ctx->reverb_room_length = (float) atof(line_tokens[1]);
+                        if (ctx->reverb_room_length < 1.0f) {
                             _WM_DEBUG_MSG("%s: reverb_room_length < 1m, setting to 1m", config_file);
-                            _WM_reverb_room_length = 1.0f;
-                        } else if (_WM_reverb_room_length > 100.0f) {
+                            ctx->reverb_room_length = 1.0f;
+                        } else if (ctx->reverb_room_length > 100.0f) {
                             _WM_DEBUG_MSG("%s: reverb_room_length > 100m, setting to 100m", config_file);
-                            _WM_reverb_room_length = 100.0f;
+                            ctx->reverb_room_length = 100.0f;
                         }
                     } else if (wm_strcasecmp(line_tokens[0], "reverb_listener_posx") == 0) {
                         if (!line_tokens[1] || !wm_isdigit(line_tokens[1][0])) {
                             _WM_GLOBAL_ERROR(WM_ERR_INVALID_ARG, "(syntax error in reverb_listen_posx line)", 0);
-                            WM_FreePatches();
+                            WM_FreePatches(ctx);
                             free(config_dir);
                             free(line_tokens);
                             _WM_FreeBufferFile(config_buffer);
                             return (-1);
                         }
-                        _WM_reverb_listen_posx = (float) atof(line_tokens[1]);
-                        if ((_WM_reverb_listen_posx > _WM_reverb_room_width)
-                                || (_WM_reverb_listen_posx < 0.0f)) {
+                        ctx->reverb_listen_posx = (float) atof(line_tokens[1]);
+                        if ((ctx->reverb_listen_posx > ctx->reverb_room_width)
+                                || (ctx->reverb_listen_posx < 0.0f)) {
                             _WM_DEBUG_MSG("%s: reverb_listen_posx set outside of room", config_file);
-                            _WM_reverb_listen_posx = _WM_reverb_room_width / 2.0f;
+                            ctx->reverb_listen_posx = ctx->reverb_room_width / 2.0f;
                         }
                     } else if (wm_strcasecmp(line_tokens[0],
                             "reverb_listener_posy") == 0) {
                         if (!line_tokens[1] || !wm_isdigit(line_tokens[1][0])) {
                             _WM_GLOBAL_ERROR(WM_ERR_INVALID_ARG, "(syntax error in reverb_listen_posy line)", 0);
-                            WM_FreePatches();
+                            WM_FreePatches(ctx);
                             free(config_dir);
                             free(line_tokens);
                             _WM_FreeBufferFile(config_buffer);
                             return (-1);
                         }
-                        _WM_reverb_listen_posy = (float) atof(line_tokens[1]);
-                        if ((_WM_reverb_listen_posy > _WM_reverb_room_width)
-                                || (_WM_reverb_listen_posy < 0.0f)) {
+                        ctx->reverb_listen_posy = (float) atof(line_tokens[1]);
+                        if ((ctx->reverb_listen_posy > ctx->reverb_room_width)
+                                || (ctx->reverb_listen_posy < 0.0f)) {
                             _WM_DEBUG_MSG("%s: reverb_listen_posy set outside of room", config_file);
-                            _WM_reverb_listen_posy = _WM_reverb_room_length * 0.75f;
+                            ctx->reverb_listen_posy = ctx->reverb_room_length * 0.75f;
+                        }
+                    } else if (wm_strcasecmp(line_tokens[0], "reverb_engine") == 0) {
+                        if (line_tokens[1] && wm_strcasecmp(line_tokens[1], "room") == 0) {
+                            ctx->reverb_engine = WM_RE_ROOM;
+                        } else if (line_tokens[1] && wm_strcasecmp(line_tokens[1], "fdn") == 0) {
+                            ctx->reverb_engine = WM_RE_FDN;
+                        } else {
+                            _WM_GLOBAL_ERROR(WM_ERR_INVALID_ARG, "(syntax error in reverb_engine line)", 0);
+                            WM_FreePatches(ctx);
+                            free(config_dir);
+                            free(line_tokens);
+                            _WM_FreeBufferFile(config_buffer);
+                            return (-1);
                         }
                     } else if (wm_strcasecmp(line_tokens[0], "guspat_editor_author_cant_read_so_fix_release_time_for_me") == 0) {
-                        _WM_fix_release = 1;
+                        ctx->fix_release = 1;
                     } else if (wm_strcasecmp(line_tokens[0], "auto_amp") == 0) {
-                        _WM_auto_amp = 1;
+                        ctx->auto_amp = 1;
                     } else if (wm_strcasecmp(line_tokens[0], "auto_amp_with_amp") == 0) {
-                        _WM_auto_amp = 1;
-                        _WM_auto_amp_with_amp = 1;
+                        ctx->auto_amp = 1;
+                        ctx->auto_amp_with_amp = 1;
                     } else if (wm_isdigit(line_tokens[0][0])) {
                         patchid = (patchid & 0xFF80)
                                 | (atoi(line_tokens[0]) & 0x7F);
-                        if (_WM_patch[(patchid & 0x7F)] == NULL) {
-                            _WM_patch[(patchid & 0x7F)] = (struct _patch *) malloc(sizeof(struct _patch));
-                            if (_WM_patch[(patchid & 0x7F)] == NULL) {
+                        if (ctx->patch[(patchid & 0x7F)] == NULL) {
+                            ctx->patch[(patchid & 0x7F)] = (struct _patch *) malloc(sizeof(struct _patch));
+                            if (ctx->patch[(patchid & 0x7F)] == NULL) {
                                 _WM_GLOBAL_ERROR(WM_ERR_MEM, NULL, errno);
-                                WM_FreePatches();
+                                WM_FreePatches(ctx);
                                 free(config_dir);
                                 free(line_tokens);
                                 _WM_FreeBufferFile(config_buffer);
                                 return (-1);
                             }
-                            tmp_patch = _WM_patch[(patchid & 0x7F)];
+                            tmp_patch = ctx->patch[(patchid & 0x7F)];
                             tmp_patch->patchid = patchid;
                             tmp_patch->filename = NULL;
                             tmp_patch->amp = 1024;
                             tmp_patch->note = 0;
                             tmp_patch->next = NULL;
                             tmp_patch->first_sample = NULL;
-                            tmp_patch->loaded = 0;
+                            _WM_StoreRelease8(tmp_patch->loaded, WM_PATCH_UNLOADED);
+                            tmp_patch->load_lock = 0;
                             tmp_patch->inuse_count = 0;
+                            tmp_patch->bytes = 0;
+                            tmp_patch->lru_prev = NULL;
+                            tmp_patch->lru_next = NULL;
                         } else {
-                            tmp_patch = _WM_patch[(patchid & 0x7F)];
+                            tmp_patch = ctx->patch[(patchid & 0x7F)];
                             if (tmp_patch->patchid == patchid) {
                                 free(tmp_patch->filename);
                                 tmp_patch->filename = NULL;
@@ -598,7 +518,7 @@ static int load_config(const char *config_file, const char *conf_dir) {
                                     if (tmp_patch->next == NULL) {
                                         if ((tmp_patch->next = (struct _patch *) malloc(sizeof(struct _patch))) == NULL) {
                                             _WM_GLOBAL_ERROR(WM_ERR_MEM, NULL, 0);
-                                            WM_FreePatches();
+                                            WM_FreePatches(ctx);
                                             free(config_dir);
                                             free(line_tokens);
                                             _WM_FreeBufferFile(config_buffer);
@@ -611,8 +531,12 @@ static int load_config(const char *config_file, const char *conf_dir) {
                                         tmp_patch->note = 0;
                                         tmp_patch->next = NULL;
                                         tmp_patch->first_sample = NULL;
-                                        tmp_patch->loaded = 0;
+                                        _WM_StoreRelease8(tmp_patch->loaded, WM_PATCH_UNLOADED);
+                                        tmp_patch->load_lock = 0;
                                         tmp_patch->inuse_count = 0;
+                                        tmp_patch->bytes = 0;
+                                        tmp_patch->lru_prev = NULL;
+                                        tmp_patch->lru_next = NULL;
                                     } else {
                                         tmp_patch = tmp_patch->next;
                                         free(tmp_patch->filename);
@@ -624,7 +548,7 @@ static int load_config(const char *config_file, const char *conf_dir) {
                                     tmp_patch->next = (struct _patch *) malloc(sizeof(struct _patch));
                                     if (tmp_patch->next == NULL) {
                                         _WM_GLOBAL_ERROR(WM_ERR_MEM, NULL, errno);
-                                        WM_FreePatches();
+                                        WM_FreePatches(ctx);
                                         free(config_dir);
                                         free(line_tokens);
                                         _WM_FreeBufferFile(config_buffer);
@@ -637,14 +561,18 @@ static int load_config(const char *config_file, const char *conf_dir) {
                                     tmp_patch->note = 0;
                                     tmp_patch->next = NULL;
                                     tmp_patch->first_sample = NULL;
-                                    tmp_patch->loaded = 0;
+                                    _WM_StoreRelease8(tmp_patch->loaded, WM_PATCH_UNLOADED);
+                                    tmp_patch->load_lock = 0;
                                     tmp_patch->inuse_count = 0;
+                                    tmp_patch->bytes = 0;
+                                    tmp_patch->lru_prev = NULL;
+                                    tmp_patch->lru_next = NULL;
                                 }
                             }
                         }
                         if (!line_tokens[1]) {
                             _WM_GLOBAL_ERROR(WM_ERR_INVALID_ARG, "(missing name in patch line)", 0);
-                            WM_FreePatches();
+                            WM_FreePatches(ctx);
                             free(config_dir);
                             free(line_tokens);
                             _WM_FreeBufferFile(config_buffer);
@@ -653,7 +581,7 @@ static int load_config(const char *config_file, const char *conf_dir) {
                             tmp_patch->filename = (char *) malloc(strlen(config_dir) + strlen(line_tokens[1]) + 5);
                             if (tmp_patch->filename == NULL) {
                                 _WM_GLOBAL_ERROR(WM_ERR_MEM, NULL, 0);
-                                WM_FreePatches();
+                                WM_FreePatches(ctx);
                                 free(config_dir);
                                 free(line_tokens);
                                 _WM_FreeBufferFile(config_buffer);
@@ -664,7 +592,7 @@ static int load_config(const char *config_file, const char *conf_dir) {
                         } else {
                             if ((tmp_patch->filename = wm_strdup(line_tokens[1])) == NULL) {
                                 _WM_GLOBAL_ERROR(WM_ERR_MEM, NULL, 0);
-                                WM_FreePatches();
+                                WM_FreePatches(ctx);
                                 free(config_dir);
                                 free(line_tokens);
                                 _WM_FreeBufferFile(config_buffer);
@@ -752,7 +680,7 @@ static int load_config(const char *config_file, const char *conf_dir) {
                     }
                 }
                 else if (_WM_Global_ErrorI) { /* malloc() failure in WM_LC_Tokenize_Line() */
-                    WM_FreePatches();
+                    WM_FreePatches(ctx);
                     free(line_tokens);
                     _WM_FreeBufferFile(config_buffer);
                     return (-1);
@@ -771,24 +699,26 @@ static int load_config(const char *config_file, const char *conf_dir) {
     return (0);
 }
 
-static int WM_LoadConfig(const char *config_file) {
-    return load_config(config_file, NULL);
+static int WM_LoadConfig(struct _WM_Context *ctx, const char *config_file) {
+    return load_config(ctx, config_file, NULL);
 }
 
-static int add_handle(void * handle) {
+static int add_handle(struct _WM_Context *ctx, void * handle) {
     struct _hndl *tmp_handle = NULL;
 
-    if (first_handle == NULL) {
-        first_handle = (struct _hndl *) malloc(sizeof(struct _hndl));
-        if (first_handle == NULL) {
+    _WM_Lock(&ctx->handle_lock);
+    if (ctx->first_handle == NULL) {
+        ctx->first_handle = (struct _hndl *) malloc(sizeof(struct _hndl));
+        if (ctx->first_handle == NULL) {
             _WM_GLOBAL_ERROR(WM_ERR_MEM, NULL, errno);
+            _WM_Unlock(&ctx->handle_lock);
             return (-1);
         }
-        first_handle->handle = handle;
-        first_handle->prev = NULL;
-        first_handle->next = NULL;
+        ctx->first_handle->handle = handle;
+        ctx->first_handle->prev = NULL;
+        ctx->first_handle->next = NULL;
     } else {
-        tmp_handle = first_handle;
+        tmp_handle = ctx->first_handle;
         if (tmp_handle->next) {
             while (tmp_handle->next)
                 tmp_handle = tmp_handle->next;
@@ -796,6 +726,7 @@ static int add_handle(void * handle) {
         tmp_handle->next = (struct _hndl *) malloc(sizeof(struct _hndl));
         if (tmp_handle->next == NULL) {
             _WM_GLOBAL_ERROR(WM_ERR_MEM, NULL, errno);
+            _WM_Unlock(&ctx->handle_lock);
             return (-1);
         }
         tmp_handle->next->prev = tmp_handle;
@@ -803,6 +734,7 @@ static int add_handle(void * handle) {
         tmp_handle->next = NULL;
         tmp_handle->handle = handle;
     }
+    _WM_Unlock(&ctx->handle_lock);
     return (0);
 }
 
@@ -818,356 +750,394 @@ static int add_handle(void * handle) {
 #endif
 
 
-static int WM_GetOutput_Linear(midi * handle, int8_t *buffer, uint32_t size) {
-    uint32_t buffer_used = 0;
-    uint32_t i, env_ptr;
-    struct _mdi *mdi = (struct _mdi *) handle;
-    uint32_t real_samples_to_mix = 0;
-    uint32_t data_pos;
-    int32_t premix, left_mix, right_mix;
-/*  int32_t vol_mul; */
-    struct _note *note_data = NULL;
-    uint32_t count;
-    struct _event *event = mdi->current_event;
-    int32_t *tmp_buffer;
-    int32_t *out_buffer;
-
-    _WM_Lock(&mdi->lock);
-
-    buffer_used = 0;
-    memset(buffer, 0, size);
+/*
+ * How many more steps a note can take before it runs into a loop end,
+ * the end of its sample or its next envelope target.
+ */
+static uint32_t WM_NoteRunLength(struct _note *nte) {
+    uint32_t run = 0xFFFFFFFF;
+    uint32_t pos_run;
+    int32_t env_dist;
+
+    if (nte->sample_inc) {
+        if (nte->modes & SAMPLE_LOOP) {
+            pos_run = (nte->sample_pos <= nte->sample->loop_end) ?
+                    (nte->sample->loop_end - nte->sample_pos) / nte->sample_inc : 0;
+        } else {
+            pos_run = (nte->sample_pos < nte->sample->data_length) ?
+                    (nte->sample->data_length - 1 - nte->sample_pos) / nte->sample_inc : 0;
+        }
+        if (pos_run < run) run = pos_run;
+    }
 
-    if ( (size / 2) > mdi->mix_buffer_size) {
-        if ( (size / 2) <= ( mdi->mix_buffer_size * 2 )) {
-            mdi->mix_buffer_size += MEM_CHUNK;
+    if (nte->env_inc) {
+        if (nte->env_inc > 0) {
+            env_dist = nte->sample->env_target[nte->env] - nte->env_level;
         } else {
-            mdi->mix_buffer_size = size / 2;
+            env_dist = nte->env_level - nte->sample->env_target[nte->env];
+        }
+        if (env_dist <= 0) {
+            run = 0;
+        } else if ((uint32_t)((env_dist - 1) / abs(nte->env_inc)) < run) {
+            run = (uint32_t)((env_dist - 1) / abs(nte->env_inc));
         }
-        mdi->mix_buffer = (int32_t *) realloc(mdi->mix_buffer, mdi->mix_buffer_size * sizeof(int32_t));
     }
 
-    tmp_buffer = mdi->mix_buffer;
+    return (run);
+}
 
-    memset(tmp_buffer, 0, ((size / 2) * sizeof(int32_t)));
-    out_buffer = tmp_buffer;
+/*
+ * Deal with whatever the last mixed step of a note ran into.
+ *
+ * returns 0 when the note carries on, 1 when the current frame has to be
+ * mixed again because the note has just left its sustain stage and 2 when
+ * the note has ended.
+ */
+static int WM_NoteAdvance(struct _note *note_data) {
+    uint32_t env_ptr;
+
+    if (__builtin_expect((note_data->modes & SAMPLE_LOOP), 1)) {
+        if (__builtin_expect((note_data->sample_pos > note_data->sample->loop_end), 0)) {
+            note_data->sample_pos = note_data->sample->loop_start
+                + ((note_data->sample_pos - note_data->sample->loop_start)
+                % note_data->sample->loop_size);
+        }
+    } else if (__builtin_expect((note_data->sample_pos >= note_data->sample->data_length), 0)) {
+        goto _END_THIS_NOTE;
+    }
 
-    do {
-        if (__builtin_expect((!mdi->samples_to_mix), 0)) {
-            while ((!mdi->samples_to_mix) && (event->do_event)) {
-                event->do_event(mdi, &event->event_data);
-                if ((mdi->extra_info.mixer_options & WM_MO_LOOP) && (event[0].evtype == ev_meta_endoftrack)) {
-                    _WM_ResetToStart(mdi);
-                    event = mdi->current_event;
-                } else {
-                    mdi->samples_to_mix = event->samples_to_next;
-                    event++;
-                    mdi->current_event = event;
-                }
-            }
+    if (__builtin_expect((note_data->env_inc == 0), 0)) {
+        return (0);
+    }
 
-            if (__builtin_expect((!mdi->samples_to_mix), 0)) {
-                if (mdi->extra_info.current_sample >= mdi->extra_info.approx_total_samples) {
-                    break;
-                } else if ((mdi->extra_info.approx_total_samples
-                             - mdi->extra_info.current_sample) > (size >> 2)) {
-                    mdi->samples_to_mix = size >> 2;
-                } else {
-                    mdi->samples_to_mix = mdi->extra_info.approx_total_samples
-                                           - mdi->extra_info.current_sample;
-                }
-            }
+    if (note_data->env_inc < 0) {
+        if (__builtin_expect((note_data->env_level
+            > note_data->sample->env_target[note_data->env]), 1)) {
+            return (0);
         }
-        if (__builtin_expect((mdi->samples_to_mix > (size >> 2)), 1)) {
-            real_samples_to_mix = size >> 2;
-        } else {
-            real_samples_to_mix = mdi->samples_to_mix;
-            if (real_samples_to_mix == 0) {
-                continue;
-            }
+    } else {
+        if (__builtin_expect((note_data->env_level
+            < note_data->sample->env_target[note_data->env]), 1)) {
+            return (0);
         }
+    }
 
-        /* do mixing here */
-        count = real_samples_to_mix;
-
-        do {
-            note_data = mdi->note;
-            left_mix = right_mix = 0;
-            RESAMPLE_DEBUGI("SAMPLES_TO_MIX",count);
-            if (__builtin_expect((note_data != NULL), 1)) {
-                RESAMPLE_DEBUGS("Processing Notes");
-                while (note_data) {
-                    /*
-                     * ===================
-                     * resample the sample
-                     * ===================
-                     */
-                    data_pos = note_data->sample_pos >> FPBITS;
-                    premix = ((note_data->sample->data[data_pos] + (((note_data->sample->data[data_pos + 1] - note_data->sample->data[data_pos]) * (int32_t)(note_data->sample_pos & FPMASK)) / 1024)) * (note_data->env_level >> 12)) / 1024;
-
-                    left_mix += (premix * (int32_t)note_data->left_mix_volume) / 1024;
-                    right_mix += (premix * (int32_t)note_data->right_mix_volume) / 1024;
-
-                    /*
-                     * ========================
-                     * sample position checking
-                     * ========================
-                     */
-#ifdef DEBUG_RESAMPLE
-                    fprintf(stderr,"\r\n%d -> INC %i, ENV %i, LEVEL %i, TARGET %d, RATE %i, SAMPLE POS %i, SAMPLE LENGTH %i, PREMIX %i (%i:%i)",
-                            (uint32_t)note_data,
-                            note_data->env_inc,
-                            note_data->env, note_data->env_level,
-                            note_data->sample->env_target[note_data->env],
-                            note_data->sample->env_rate[note_data->env],
-                            note_data->sample_pos,
-                            note_data->sample->data_length,
-                            premix, left_mix, right_mix);
-                    if (note_data->modes & SAMPLE_LOOP)
-                        fprintf(stderr,", LOOP %i + %i",
-                                note_data->sample->loop_start,
-                                note_data->sample->loop_size);
-                    fprintf(stderr,"\r\n");
-#endif
+    note_data->env_level = note_data->sample->env_target[note_data->env];
+    switch (note_data->env) {
+    case 0:
+        if (!(note_data->modes & SAMPLE_ENVELOPE)) {
+            note_data->env_inc = 0;
+            RESAMPLE_DEBUGS("Next Note: No Envelope");
+            return (0);
+        }
+        break;
+    case 2:
+        if (note_data->modes & SAMPLE_SUSTAIN /*|| note_data->hold*/) {
+            note_data->env_inc = 0;
+            RESAMPLE_DEBUGS("Next Note: SAMPLE_SUSTAIN");
+            return (0);
+        }
+        env_ptr = (note_data->modes & SAMPLE_CLAMPED)? 5 : 4;
+        note_data->env = env_ptr;
+        if (note_data->env_level > note_data->sample->env_target[env_ptr]) {
+            note_data->env_inc = -note_data->sample->env_rate[env_ptr];
+        } else {
+            note_data->env_inc = note_data->sample->env_rate[env_ptr];
+        }
+        /* the note gets mixed into this frame a second time */
+        return (1);
+    case 5:
+        if (__builtin_expect((note_data->env_level == 0), 1)) {
+            goto _END_THIS_NOTE;
+        }
+        /* sample release */
+        if (note_data->modes & SAMPLE_LOOP)
+            note_data->modes ^= SAMPLE_LOOP;
+        note_data->env_inc = 0;
+        RESAMPLE_DEBUGS("Next Note: Sample Release");
+        return (0);
+    case 6:
+        goto _END_THIS_NOTE;
+    }
 
-                    note_data->sample_pos += note_data->sample_inc;
+    note_data->env++;
 
-                    if (__builtin_expect((note_data->modes & SAMPLE_LOOP), 1)) {
-                        if (__builtin_expect(
-                                             (note_data->sample_pos > note_data->sample->loop_end),
-                                             0)) {
-                            note_data->sample_pos = note_data->sample->loop_start
-                                + ((note_data->sample_pos
-                                    - note_data->sample->loop_start)
-                                % note_data->sample->loop_size);
-                        }
+    if (note_data->is_off == 1) {
+        _WM_do_note_off_extra(note_data);
+    } else if (note_data->env_level
+               >= note_data->sample->env_target[note_data->env]) {
+        note_data->env_inc = -note_data->sample->env_rate[note_data->env];
+    } else {
+        note_data->env_inc = note_data->sample->env_rate[note_data->env];
+    }
+    return (0);
 
-                    } else if (__builtin_expect(
-                                                  (note_data->sample_pos
-                                                   >= note_data->sample->data_length),
-                                                  0)) {
-                        goto _END_THIS_NOTE;
-                    }
+_END_THIS_NOTE:
+    RESAMPLE_DEBUGS("Next Note: Killed Off Note");
+    return (2);
+}
 
-                    if (__builtin_expect((note_data->env_inc == 0), 0)) {
-                        note_data = note_data->next;
-                        RESAMPLE_DEBUGS("Next Note: 0 env_inc");
-                        continue;
-                    }
+/*
+ * WM_NoteAdvance for the note in voice slot i.
+ *
+ * returns 0 when the note carries on, 1 when the current frame has to be
+ * mixed again from voice slot i (the note was replaced by its replay note or
+ * has just left its sustain stage) and -1 if the note has been removed, in
+ * which case slot i now holds a note that still has to be mixed.
+ */
+static int WM_NoteCheck(struct _mdi *mdi, uint32_t i) {
+    struct _note *note_data = mdi->voices.note[i];
+    int ret = WM_NoteAdvance(note_data);
 
-                    note_data->env_level += note_data->env_inc;
+    if (__builtin_expect((ret != 2), 1)) {
+        return (ret);
+    }
+    if (__builtin_expect((note_data->replay != NULL), 1)) {
+        _WM_ReplaceVoice(mdi, note_data);
+        return (1);
+    }
+    _WM_RemoveVoice(mdi, note_data);
+    return (-1);
+}
 
-                    if (note_data->env_inc < 0) {
-                        if (__builtin_expect((note_data->env_level
-                            > note_data->sample->env_target[note_data->env]), 0)) {
-                            note_data = note_data->next;
-                            RESAMPLE_DEBUGS("Next Note: env_lvl > env_target");
-                            continue;
-                        }
-                    } else if (note_data->env_inc > 0) {
-                        if (__builtin_expect((note_data->env_level
-                            < note_data->sample->env_target[note_data->env]), 0)) {
-                            note_data = note_data->next;
-                            RESAMPLE_DEBUGS("Next Note: env_lvl < env_target");
-                            continue;
-                        }
-                    }
+/* don't bother the pool with less work than this many note frames */
+#define MIX_PARTS_MIN_WORK 32768
 
-                    /* Yes could have a condition here but
-                       it would create another bottleneck */
-                    note_data->env_level =
-                            note_data->sample->env_target[note_data->env];
-                    switch (note_data->env) {
-                    case 0:
-                        if (!(note_data->modes & SAMPLE_ENVELOPE)) {
-                            note_data->env_inc = 0;
-                            note_data = note_data->next;
-                            RESAMPLE_DEBUGS("Next Note: No Envelope");
-                            continue;
-                        }
-                        break;
-                    case 2:
-                        if (note_data->modes & SAMPLE_SUSTAIN /*|| note_data->hold*/) {
-                            note_data->env_inc = 0;
-                            note_data = note_data->next;
-                            RESAMPLE_DEBUGS("Next Note: SAMPLE_SUSTAIN");
-                        } else {
-                            env_ptr = (note_data->modes & SAMPLE_CLAMPED)? 5 : 4;
-                            note_data->env = env_ptr;
-                            if (note_data->env_level
-                                    > note_data->sample->env_target[env_ptr]) {
-                                note_data->env_inc =
-                                        -note_data->sample->env_rate[env_ptr];
-                            } else {
-                                note_data->env_inc =
-                                        note_data->sample->env_rate[env_ptr];
-                            }
-                        }
-                        continue;
-                    case 5:
-                        if (__builtin_expect((note_data->env_level == 0), 1)) {
-                            goto _END_THIS_NOTE;
-                        }
-                        /* sample release */
-                        if (note_data->modes & SAMPLE_LOOP)
-                            note_data->modes ^= SAMPLE_LOOP;
-                        note_data->env_inc = 0;
-                        note_data = note_data->next;
-                        RESAMPLE_DEBUGS("Next Note: Sample Release");
-
-                        continue;
-                    case 6:
-                        _END_THIS_NOTE:
-                        if (__builtin_expect((note_data->replay != NULL), 1)) {
-                            note_data->active = 0;
-                            {
-                                struct _note *prev_note = NULL;
-                                struct _note *nte_array = mdi->note;
-
-                                if (nte_array != note_data) {
-                                    do {
-                                        prev_note = nte_array;
-                                        nte_array = nte_array->next;
-                                    } while (nte_array != note_data);
-                                }
-                                if (prev_note) {
-                                    prev_note->next = note_data->replay;
-                                } else {
-                                    mdi->note = note_data->replay;
-                                }
-                                note_data->replay->next = note_data->next;
-                                note_data = note_data->replay;
-                                note_data->active = 1;
-                            }
-                        } else {
-                            note_data->active = 0;
-                            {
-                                struct _note *prev_note = NULL;
-                                struct _note *nte_array = mdi->note;
-
-                                if (nte_array != note_data) {
-                                    do {
-                                        prev_note = nte_array;
-                                        nte_array = nte_array->next;
-                                    } while ((nte_array != note_data)
-                                            && (nte_array));
-                                }
-                                if (prev_note) {
-                                    prev_note->next = note_data->next;
-                                } else {
-                                    mdi->note = note_data->next;
-                                }
-                                note_data = note_data->next;
-                            }
-                        }
-                        RESAMPLE_DEBUGS("Next Note: Killed Off Note");
-                        continue;
-                    }
-                    note_data->env++;
+struct _mix_parts {
+    struct _mdi *mdi;
+    int8_t *buffer;
+    uint32_t count;
+    uint32_t parts;
+    _WM_Resample resample;
+    uint8_t bus;
+};
 
-                    if (note_data->is_off == 1) {
-                        _WM_do_note_off_extra(note_data);
-                    } else {
+/*
+ * Mixes one part of the voices, run on any of the pool's threads.
+ *
+ * Voices can't be removed or replaced here as that moves other parts'
+ * notes around. Instead notes are marked with how they finished and
+ * replay notes are mixed in place of theirs, WM_MixFinish then sorts the
+ * voices out once all parts are done.
+ */
+static void WM_MixPart(void *data, uint32_t index, uint32_t worker) {
+    struct _mix_parts *mix = (struct _mix_parts *) data;
+    struct _mdi *mdi = mix->mdi;
+    uint32_t first = (uint32_t) (((uint64_t) mdi->voices.count * index) / mix->parts);
+    uint32_t last = (uint32_t) (((uint64_t) mdi->voices.count * (index + 1)) / mix->parts);
+    struct _note *note_data;
+    int8_t *buffer = mix->buffer;
+    int8_t *ptr;
+    uint32_t i;
+    uint32_t left, run;
+    int ret;
 
-                        if (note_data->env_level
-                            >= note_data->sample->env_target[note_data->env]) {
-                            note_data->env_inc =
-                                -note_data->sample->env_rate[note_data->env];
-                        } else {
-                            note_data->env_inc =
-                                note_data->sample->env_rate[note_data->env];
-                        }
-                    }
-                    note_data = note_data->next;
-#ifdef DEBUG_RESAMPLE
-                    if (note_data != NULL)
-                        RESAMPLE_DEBUGI("Next Note: Next ENV ", note_data->env);
-                    else
-                        RESAMPLE_DEBUGS("Next Note: Next ENV");
-#endif
-                    continue;
+    (void) worker;
+    /* the first part goes straight into the output */
+    if (index) {
+        buffer = (int8_t *) mdi->part_buffer + (index - 1) * mix->count * WM_BUS_FRAME(mix->bus);
+        memset(buffer, 0, mix->count * WM_BUS_FRAME(mix->bus));
+    }
+
+    for (i = first; i < last; i++) {
+        note_data = mdi->voices.note[i];
+        ptr = buffer;
+        left = mix->count;
+        while (left) {
+            run = WM_NoteRunLength(note_data);
+            if (run >= left) {
+                mix->resample(note_data, ptr, left);
+                break;
+            }
+            run++;
+            mix->resample(note_data, ptr, run);
+            ptr += run * WM_BUS_FRAME(mix->bus);
+            left -= run;
+
+            ret = WM_NoteAdvance(note_data);
+            if (ret == 2) {
+                if (note_data->replay == NULL) {
+                    note_data->finished = NOTE_ENDED;
+                    break;
                 }
+                note_data->finished = NOTE_REPLACED;
+                note_data = note_data->replay;
+                ret = 1;
             }
-            *tmp_buffer++ = left_mix;
-            *tmp_buffer++ = right_mix;
-        } while (--count);
-
-        buffer_used += real_samples_to_mix * 4;
-        size -= (real_samples_to_mix << 2);
-        mdi->extra_info.current_sample += real_samples_to_mix;
-        mdi->samples_to_mix -= real_samples_to_mix;
-    } while (size);
+            if (ret) {
+                ptr -= WM_BUS_FRAME(mix->bus);
+                left++;
+            }
+        }
+    }
+}
 
-    tmp_buffer = out_buffer;
+/*
+ * Removes and replaces the notes WM_MixPart marked, visiting them in the
+ * very order WM_MixNotes would have, so the voices end up just the same.
+ */
+static void WM_MixFinish(struct _mdi *mdi) {
+    struct _note *note_data;
+    uint32_t i = 0;
+
+    while (i < mdi->voices.count) {
+        note_data = mdi->voices.note[i];
+        if (note_data->finished == NOTE_REPLACED) {
+            note_data->finished = 0;
+            _WM_ReplaceVoice(mdi, note_data);
+        } else if (note_data->finished == NOTE_ENDED) {
+            note_data->finished = 0;
+            _WM_RemoveVoice(mdi, note_data);
+        } else {
+            i++;
+        }
+    }
+}
 
-    if (mdi->extra_info.mixer_options & WM_MO_REVERB) {
-        _WM_do_reverb(mdi->reverb, tmp_buffer, (buffer_used / 2));
+/*
+ * Mix count frames of every playing note into buffer, splitting the voices
+ * over the thread pool. Each part is mixed into a buffer of its own and
+ * the parts are then added up. On the int bus that gives the same result
+ * as WM_MixNotes, on the float bus it may differ by rounding. Returns -1
+ * if the pool or the memory for the part buffers isn't available, leaving
+ * the mixing to WM_MixNotes.
+ */
+static int WM_MixParts(struct _mdi *mdi, void *buffer, uint32_t count, _WM_Resample resample, uint8_t bus) {
+    struct _mix_parts mix;
+    uint32_t parts = _WM_pool_workers();
+    uint32_t samples = count * WM_BUS_CHANNELS(bus);
+    uint32_t size;
+    uint32_t i, j;
+    int32_t *part;
+
+    if (parts > mdi->voices.count) {
+        parts = mdi->voices.count;
+    }
+    if (parts < 2) {
+        return (-1);
     }
 
-    /* _WM_DynamicVolumeAdjust(mdi, tmp_buffer, (buffer_used/2)); */
+    size = (parts - 1) * samples;
+    if (size > mdi->part_buffer_size) {
+        /* WildMidi_Prime sized it for as many threads as there are */
+        if (mdi->primed_frames) {
+            return (-1);
+        }
+        part = (int32_t *) realloc(mdi->part_buffer, size * sizeof(int32_t));
+        if (part == NULL) {
+            return (-1);
+        }
+        mdi->part_buffer = part;
+        mdi->part_buffer_size = size;
+    }
 
-    for (i = 0; i < buffer_used; i += 4) {
-        left_mix = *tmp_buffer++;
-        right_mix = *tmp_buffer++;
+    mix.mdi = mdi;
+    mix.buffer = (int8_t *) buffer;
+    mix.count = count;
+    mix.parts = parts;
+    mix.resample = resample;
+    mix.bus = bus;
+    if (_WM_pool_try_run(WM_MixPart, &mix, parts) != 0) {
+        return (-1);
+    }
 
-        /*
-         * ===================
-         * Write to the buffer
-         * ===================
-         */
-#ifdef WORDS_BIGENDIAN
-        (*buffer++) = ((left_mix >> 8) & 0x7f) | ((left_mix >> 24) & 0x80);
-        (*buffer++) = left_mix & 0xff;
-        (*buffer++) = ((right_mix >> 8) & 0x7f) | ((right_mix >> 24) & 0x80);
-        (*buffer++) = right_mix & 0xff;
-#else
-        (*buffer++) = left_mix & 0xff;
-        (*buffer++) = ((left_mix >> 8) & 0x7f) | ((left_mix >> 24) & 0x80);
-        (*buffer++) = right_mix & 0xff;
-        (*buffer++) = ((right_mix >> 8) & 0x7f) | ((right_mix >> 24) & 0x80);
-#endif
+    part = mdi->part_buffer;
+    for (i = 1; i < parts; i++) {
+        if (bus & WM_BUS_FLOAT) {
+            for (j = 0; j < samples; j++) {
+                ((float *) buffer)[j] += ((float *) part)[j];
+            }
+        } else {
+            for (j = 0; j < samples; j++) {
+                ((int32_t *) buffer)[j] += part[j];
+            }
+        }
+        part += samples;
     }
 
-    _WM_Unlock(&mdi->lock);
-    return (buffer_used);
+    WM_MixFinish(mdi);
+    return (0);
 }
 
-static int WM_GetOutput_Gauss(midi * handle, int8_t *buffer, uint32_t size) {
-    uint32_t buffer_used = 0;
-    uint32_t i, env_ptr;
-    struct _mdi *mdi = (struct _mdi *) handle;
-    uint32_t real_samples_to_mix = 0;
-    uint32_t data_pos;
-    int32_t premix, left_mix, right_mix;
-    struct _note *note_data = NULL;
-    uint32_t count;
-    int16_t *sptr;
-    double y, xd;
-    double *gptr, *gend;
-    int left, right, temp_n;
-    int ii, jj;
-    struct _event *event = mdi->current_event;
-    int32_t *tmp_buffer;
-    int32_t *out_buffer;
-
-    _WM_Lock(&mdi->lock);
+/*
+ * Mix count frames of every playing note into buffer, one note at a time.
+ *
+ * Each note is handed to the resampler in runs that stop on the step where
+ * something needs looking at, which keeps the checks out of the inner loop.
+ * On the int bus the per note results are summed as integers so this gives
+ * the very same output as mixing all notes one frame at a time.
+ */
+static void WM_MixNotes(struct _mdi *mdi, void *buffer, uint32_t count, _WM_Resample resample, uint8_t bus) {
+    struct _note *note_data;
+    int8_t *ptr;
+    uint32_t i = 0;
+    uint32_t left, run;
+    int ret;
 
-    buffer_used = 0;
-    memset(buffer, 0, size);
+    RESAMPLE_DEBUGI("SAMPLES_TO_MIX", count);
+    if (__builtin_expect((mdi->parallel_voices != 0), 0)
+        && (mdi->voices.count >= mdi->parallel_voices)
+        && (((uint64_t) count * mdi->voices.count) >= MIX_PARTS_MIN_WORK)
+        && (WM_MixParts(mdi, buffer, count, resample, bus) == 0)) {
+        return;
+    }
 
-    if ( (size / 2) > mdi->mix_buffer_size) {
-        if ( (size / 2) <= ( mdi->mix_buffer_size * 2 )) {
-            mdi->mix_buffer_size += MEM_CHUNK;
-        } else {
-            mdi->mix_buffer_size = size / 2;
+    while (i < mdi->voices.count) {
+        note_data = mdi->voices.note[i];
+        ptr = (int8_t *) buffer;
+        left = count;
+        ret = 0;
+        while (left) {
+            run = WM_NoteRunLength(note_data);
+            if (run >= left) {
+                /* nothing happens within this block */
+                resample(note_data, ptr, left);
+                break;
+            }
+            run++;
+            resample(note_data, ptr, run);
+            ptr += run * WM_BUS_FRAME(bus);
+            left -= run;
+
+            ret = WM_NoteCheck(mdi, i);
+            if (ret < 0) break;
+            if (ret > 0) {
+                ptr -= WM_BUS_FRAME(bus);
+                left++;
+                note_data = mdi->voices.note[i];
+            }
         }
-        mdi->mix_buffer = (int32_t *) realloc(mdi->mix_buffer, mdi->mix_buffer_size * sizeof(int32_t));
+        if (ret >= 0) i++;
     }
+}
 
-    tmp_buffer = mdi->mix_buffer;
+/*
+ * Bytes per frame in sample_size byte samples at mdi's channel count.
+ * WildMidi_SetOption can change the channel count and output format while
+ * the lock isn't held, so a size checked against this is only good for
+ * as long as the lock is kept.
+ */
+static inline uint32_t WM_FrameSize(const struct _mdi *mdi, uint32_t sample_size) {
+    return (sample_size * mdi->channels);
+}
 
-    memset(tmp_buffer, 0, ((size / 2) * sizeof(int32_t)));
-    out_buffer = tmp_buffer;
+/*
+ * Plays the events of mdi for up to frames frames, mixing the notes into
+ * buffer, a mix bus of the kind resample writes to. Returns the number of
+ * frames played, less than frames only at the end of the song.
+ *
+ * Nothing is mixed while no notes are playing. buffer is only cleared, all
+ * frames of it, once there is a note to mix, so *silent is left set and
+ * buffer untouched if none played at all.
+ */
+static uint32_t WM_MixEvents(struct _mdi *mdi, void *buffer, uint32_t frames,
+                             _WM_Resample resample, uint8_t bus, int *silent) {
+    int8_t *ptr = (int8_t *) buffer;
+    uint32_t frames_used = 0;
+    uint32_t real_samples_to_mix = 0;
+    struct _event *event = mdi->current_event;
 
+    *silent = 1;
     do {
         if (__builtin_expect((!mdi->samples_to_mix), 0)) {
             while ((!mdi->samples_to_mix) && (event->do_event)) {
@@ -1182,21 +1152,20 @@ static int WM_GetOutput_Gauss(midi * handle, int8_t *buffer, uint32_t size) {
                 }
             }
 
-            if (!mdi->samples_to_mix) {
-                if (mdi->extra_info.current_sample
-                    >= mdi->extra_info.approx_total_samples) {
+            if (__builtin_expect((!mdi->samples_to_mix), 0)) {
+                if (mdi->extra_info.current_sample >= mdi->extra_info.approx_total_samples) {
                     break;
                 } else if ((mdi->extra_info.approx_total_samples
-                            - mdi->extra_info.current_sample) > (size >> 2)) {
-                    mdi->samples_to_mix = size >> 2;
+                             - mdi->extra_info.current_sample) > (frames - frames_used)) {
+                    mdi->samples_to_mix = frames - frames_used;
                 } else {
                     mdi->samples_to_mix = mdi->extra_info.approx_total_samples
-                    - mdi->extra_info.current_sample;
+                                           - mdi->extra_info.current_sample;
                 }
             }
         }
-        if (__builtin_expect((mdi->samples_to_mix > (size >> 2)), 1)) {
-            real_samples_to_mix = size >> 2;
+        if (__builtin_expect((mdi->samples_to_mix > (frames - frames_used)), 1)) {
+            real_samples_to_mix = frames - frames_used;
         } else {
             real_samples_to_mix = mdi->samples_to_mix;
             if (real_samples_to_mix == 0) {
@@ -1205,266 +1174,190 @@ static int WM_GetOutput_Gauss(midi * handle, int8_t *buffer, uint32_t size) {
         }
 
         /* do mixing here */
-        count = real_samples_to_mix;
-        do {
-            note_data = mdi->note;
-            left_mix = right_mix = 0;
-            if (__builtin_expect((note_data != NULL), 1)) {
-                while (note_data) {
-                    /*
-                     * ===================
-                     * resample the sample
-                     * ===================
-                     */
-                    data_pos = note_data->sample_pos >> FPBITS;
-
-                    /* check to see if we're near one of the ends */
-                    left = data_pos;
-                    right = (note_data->sample->data_length >> FPBITS) - left
-                            - 1;
-                    temp_n = (right << 1) - 1;
-                    if (temp_n <= 0)
-                        temp_n = 1;
-                    if (temp_n > (left << 1) + 1)
-                        temp_n = (left << 1) + 1;
-
-                    /* use Newton if we can't fill the window */
-                    if (temp_n < gauss_n) {
-                        xd = note_data->sample_pos & FPMASK;
-                        xd /= (1L << FPBITS);
-                        xd += temp_n >> 1;
-                        y = 0;
-                        sptr = note_data->sample->data
-                                + (note_data->sample_pos >> FPBITS)
-                                - (temp_n >> 1);
-                        for (ii = temp_n; ii;) {
-                            for (jj = 0; jj <= ii; jj++)
-                                y += sptr[jj] * newt_coeffs[ii][jj];
-                            y *= xd - --ii;
-                        }
-                        y += *sptr;
-                    } else { /* otherwise, use Gauss as usual */
-                        y = 0;
-                        gptr = &gauss_table[(note_data->sample_pos & FPMASK) *
-                                     (gauss_n + 1)];
-                        gend = gptr + gauss_n;
-                        sptr = note_data->sample->data
-                                + (note_data->sample_pos >> FPBITS)
-                                - (gauss_n >> 1);
-                        do {
-                            y += *(sptr++) * *(gptr++);
-                        } while (gptr <= gend);
-                    }
-
-                    premix = (int32_t)((y * (note_data->env_level >> 12)) / 1024);
-
-                    left_mix += (premix * (int32_t)note_data->left_mix_volume) / 1024;
-                    right_mix += (premix * (int32_t)note_data->right_mix_volume) / 1024;
-
-                    /*
-                     * ========================
-                     * sample position checking
-                     * ========================
-                     */
-                    note_data->sample_pos += note_data->sample_inc;
-                    if (__builtin_expect(
-                                         (note_data->sample_pos > note_data->sample->loop_end),
-                                         0)) {
-                        if (note_data->modes & SAMPLE_LOOP) {
-                            note_data->sample_pos =
-                            note_data->sample->loop_start
-                            + ((note_data->sample_pos
-                                - note_data->sample->loop_start)
-                               % note_data->sample->loop_size);
-                        } else if (__builtin_expect(
-                                                    (note_data->sample_pos
-                                                     >= note_data->sample->data_length),
-                                                    0)) {
-                            goto _END_THIS_NOTE;
-                        }
-                    }
-
-                    if (__builtin_expect((note_data->env_inc == 0), 0)) {
-                        /*
-                         fprintf(stderr,"\r\nINC = 0, ENV %i, LEVEL %i, TARGET %d, RATE %i\r\n",
-                                 note_data->env, note_data->env_level,
-                                 note_data->sample->env_target[note_data->env],
-                                 note_data->sample->env_rate[note_data->env]);
-                         */
-                        note_data = note_data->next;
-                        continue;
-                    }
-
-                    note_data->env_level += note_data->env_inc;
-                    /*
-                     fprintf(stderr,"\r\nENV %i, LEVEL %i, TARGET %d, RATE %i, INC %i\r\n",
-                             note_data->env, note_data->env_level,
-                             note_data->sample->env_target[note_data->env],
-                             note_data->sample->env_rate[note_data->env],
-                             note_data->env_inc);
-                     */
-                    if (note_data->env_inc < 0) {
-                        if (note_data->env_level
-                            > note_data->sample->env_target[note_data->env]) {
-                            note_data = note_data->next;
-                            continue;
-                        }
-                    } else if (note_data->env_inc > 0) {
-                        if (note_data->env_level
-                            < note_data->sample->env_target[note_data->env]) {
-                            note_data = note_data->next;
-                            continue;
-                        }
-                    }
-
-                    /* Yes could have a condition here but
-                       it would create another bottleneck */
-
-                    note_data->env_level =
-                    note_data->sample->env_target[note_data->env];
-                    switch (note_data->env) {
-                        case 0:
-                            if (!(note_data->modes & SAMPLE_ENVELOPE)) {
-                                note_data->env_inc = 0;
-                                note_data = note_data->next;
-                                continue;
-                            }
-                            break;
-                        case 2:
-                            if (note_data->modes & SAMPLE_SUSTAIN /*|| note_data->hold*/) {
-                                note_data->env_inc = 0;
-                                note_data = note_data->next;
-                            } else {
-                                env_ptr = (note_data->modes & SAMPLE_CLAMPED)? 5 : 4;
-                                note_data->env = env_ptr;
-                                if (note_data->env_level
-                                        > note_data->sample->env_target[env_ptr]) {
-                                    note_data->env_inc =
-                                        -note_data->sample->env_rate[env_ptr];
-                                } else {
-                                    note_data->env_inc =
-                                        note_data->sample->env_rate[env_ptr];
-                                }
-                            }
-                            continue;
-                        case 5:
-                            if (__builtin_expect((note_data->env_level == 0), 1)) {
-                                goto _END_THIS_NOTE;
-                            }
-                            /* sample release */
-                            if (note_data->modes & SAMPLE_LOOP)
-                                note_data->modes ^= SAMPLE_LOOP;
-                            note_data->env_inc = 0;
-                            note_data = note_data->next;
-                            continue;
-                        case 6:
-                        _END_THIS_NOTE:
-                            if (__builtin_expect((note_data->replay != NULL), 1)) {
-                                note_data->active = 0;
-                                {
-                                    struct _note *prev_note = NULL;
-                                    struct _note *nte_array = mdi->note;
-
-                                    if (nte_array != note_data) {
-                                        do {
-                                            prev_note = nte_array;
-                                            nte_array = nte_array->next;
-                                        } while (nte_array != note_data);
-                                    }
-                                    if (prev_note) {
-                                        prev_note->next = note_data->replay;
-                                    } else {
-                                        mdi->note = note_data->replay;
-                                    }
-                                    note_data->replay->next = note_data->next;
-                                    note_data = note_data->replay;
-                                    note_data->active = 1;
-                                }
-                            } else {
-                                note_data->active = 0;
-                                {
-                                    struct _note *prev_note = NULL;
-                                    struct _note *nte_array = mdi->note;
-
-                                    if (nte_array != note_data) {
-                                        do {
-                                            prev_note = nte_array;
-                                            nte_array = nte_array->next;
-                                        } while ((nte_array != note_data)
-                                                 && (nte_array));
-                                    }
-                                    if (prev_note) {
-                                        prev_note->next = note_data->next;
-                                    } else {
-                                        mdi->note = note_data->next;
-                                    }
-                                    note_data = note_data->next;
-                                }
-                            }
-                            continue;
-                    }
-                    note_data->env++;
-
-                    if (note_data->is_off == 1) {
-                        _WM_do_note_off_extra(note_data);
-                    } else {
-
-                        if (note_data->env_level
-                            >= note_data->sample->env_target[note_data->env]) {
-                            note_data->env_inc =
-                            -note_data->sample->env_rate[note_data->env];
-                        } else {
-                            note_data->env_inc =
-                            note_data->sample->env_rate[note_data->env];
-                        }
-                    }
-                    note_data = note_data->next;
-                    continue;
-                }
+        if (mdi->voices.count) {
+            if (*silent) {
+                memset(buffer, 0, (frames * WM_BUS_FRAME(bus)));
+                *silent = 0;
             }
-            *tmp_buffer++ = left_mix;
-            *tmp_buffer++ = right_mix;
-        } while (--count);
+            WM_MixNotes(mdi, ptr, real_samples_to_mix, resample, bus);
+        }
+        ptr += real_samples_to_mix * WM_BUS_FRAME(bus);
 
-        buffer_used += real_samples_to_mix * 4;
-        size -= (real_samples_to_mix << 2);
+        frames_used += real_samples_to_mix;
         mdi->extra_info.current_sample += real_samples_to_mix;
         mdi->samples_to_mix -= real_samples_to_mix;
-    } while (size);
-
-    tmp_buffer = out_buffer;
-
-    if (mdi->extra_info.mixer_options & WM_MO_REVERB) {
-        _WM_do_reverb(mdi->reverb, tmp_buffer, (buffer_used / 2));
-    }
+    } while (frames_used < frames);
 
-    /* _WM_DynamicVolumeAdjust(mdi, tmp_buffer, (buffer_used/2)); */
+    return (frames_used);
+}
 
-    for (i = 0; i < buffer_used; i += 4) {
-        left_mix = *tmp_buffer++;
-        right_mix = *tmp_buffer++;
+/*
+ * Makes sure the mix buffer holds frames frames of either channel count.
+ * Returns -1 if it doesn't and can't be made to.
+ */
+static int WM_ReserveMixBuffer(struct _mdi *mdi, uint32_t frames) {
+    int32_t *mix_buffer;
+    uint32_t size;
 
-        /*
-         * ===================
-         * Write to the buffer
-         * ===================
-         */
-#ifdef WORDS_BIGENDIAN
-        (*buffer++) = ((left_mix >> 8) & 0x7f) | ((left_mix >> 24) & 0x80);
-        (*buffer++) = left_mix & 0xff;
-        (*buffer++) = ((right_mix >> 8) & 0x7f) | ((right_mix >> 24) & 0x80);
-        (*buffer++) = right_mix & 0xff;
-#else
-        (*buffer++) = left_mix & 0xff;
-        (*buffer++) = ((left_mix >> 8) & 0x7f) | ((left_mix >> 24) & 0x80);
-        (*buffer++) = right_mix & 0xff;
-        (*buffer++) = ((right_mix >> 8) & 0x7f) | ((right_mix >> 24) & 0x80);
-#endif
+    if ((frames * 2) <= mdi->mix_buffer_size) {
+        return (0);
     }
-    _WM_Unlock(&mdi->lock);
-    return (buffer_used);
+    if ((frames * 2) <= (mdi->mix_buffer_size * 2)) {
+        size = mdi->mix_buffer_size + MEM_CHUNK;
+        if (size < (frames * 2)) size = frames * 2;
+    } else {
+        size = frames * 2;
+    }
+    mix_buffer = (int32_t *) realloc(mdi->mix_buffer, size * sizeof(int32_t));
+    if (mix_buffer == NULL) {
+        return (-1);
+    }
+    mdi->mix_buffer = mix_buffer;
+    mdi->mix_buffer_size = size;
+    return (0);
+}
+
+/* bus, WM_BUS_INT or WM_BUS_FLOAT, in mdi's channel count */
+static inline uint8_t WM_MixBus(const struct _mdi *mdi, uint8_t bus) {
+    return ((mdi->channels == 1) ? (bus | WM_BUS_MONO) : bus);
+}
+
+/*
+ * Renders up to frames frames of mdi into out as the given WM_OF_* format,
+ * mixing on the int bus in tmp_buffer, which has to hold frames int32's for
+ * each channel.
+ * Returns the frames written, nothing past those is touched. The lock must
+ * be held.
+ *
+ * If no notes played at all and the reverb has nothing left to give, the
+ * frames are zeroed and the reverb and conversion are skipped.
+ */
+static uint32_t WM_RenderInt(struct _mdi *mdi, int8_t *out, uint32_t frames, uint8_t format,
+                             _WM_Resample resample, int32_t *tmp_buffer) {
+    uint32_t frames_used;
+    uint32_t samples;
+    int silent;
+
+    frames_used = WM_MixEvents(mdi, tmp_buffer, frames, resample, WM_MixBus(mdi, WM_BUS_INT), &silent);
+    samples = frames_used * mdi->channels;
+
+    if (silent) {
+        if (!(mdi->extra_info.mixer_options & WM_MO_REVERB)
+                || _WM_reverb_idle(mdi->reverb)) {
+            memset(out, 0, samples * _WM_sample_size(format));
+            return (frames_used);
+        }
+        /* the reverb is still dying away */
+        memset(tmp_buffer, 0, (samples * sizeof(int32_t)));
+    }
+
+    if (mdi->extra_info.mixer_options & WM_MO_REVERB) {
+        _WM_do_reverb(mdi->reverb, tmp_buffer, samples, mdi->channels);
+    }
+
+    /* _WM_DynamicVolumeAdjust(mdi, tmp_buffer, samples); */
+
+    _WM_get_converter(format)(tmp_buffer, out, samples);
+    return (frames_used);
 }
 
+/*
+ * Renders up to frames frames of mdi into out on the float bus, which out
+ * is, so nothing needs converting or clipping. Returns the frames written,
+ * though all frames may have been cleared. The lock must be held.
+ */
+static uint32_t WM_RenderFloat(struct _mdi *mdi, float *out, uint32_t frames, _WM_Resample resample) {
+    uint8_t bus = WM_MixBus(mdi, WM_BUS_FLOAT);
+    uint32_t frames_used;
+    int silent;
+
+    frames_used = WM_MixEvents(mdi, out, frames, resample, bus, &silent);
+
+    if (silent) {
+        memset(out, 0, frames_used * WM_BUS_FRAME(bus));
+    }
+
+    if ((mdi->extra_info.mixer_options & WM_MO_REVERB)
+            && !(silent && _WM_reverb_idle(mdi->reverb))) {
+        _WM_do_reverb_float(mdi->reverb, out, (frames_used * mdi->channels), mdi->channels);
+    }
+    return (frames_used);
+}
+
+/*
+ * WM_RenderInt for any number of frames, a piece at a time, each no more
+ * than the tmp_frames frames tmp_buffer has room for.
+ */
+static uint32_t WM_RenderIntChunked(struct _mdi *mdi, int8_t *out, uint32_t frames, uint8_t format,
+                                    _WM_Resample resample, int32_t *tmp_buffer, uint32_t tmp_frames) {
+    uint32_t frame_size = _WM_sample_size(format) * mdi->channels;
+    uint32_t chunk, done, total = 0;
+
+    do {
+        chunk = frames - total;
+        if (chunk > tmp_frames) {
+            chunk = tmp_frames;
+        }
+        done = WM_RenderInt(mdi, out + total * frame_size, chunk, format, resample, tmp_buffer);
+        total += done;
+    } while ((done == chunk) && (total < frames));
+    return (total);
+}
+
+/*
+ * A primed handle is in real-time mode, where rendering and seeking must
+ * not allocate. WM_RTCHECK builds abort if they do. The lock must be held.
+ */
+#define WM_RT_BEGIN(mdi) do { if ((mdi)->primed_frames) WM_RT_ENTER(); } while (0)
+#define WM_RT_END(mdi) do { if ((mdi)->primed_frames) WM_RT_LEAVE(); } while (0)
+
+/*
+ * Renders size bytes of mdi into buffer, in the handle's output format.
+ * The mix is done in tmp_buffer, which has to hold an int32 for each sample
+ * that fits in size, or in the handle's own mix buffer if tmp_buffer
+ * is NULL. What's left of buffer after the end of the song is zeroed.
+ * The lock must be held, and have been since size was checked to be a
+ * multiple of the frame size.
+ */
+static int WM_GetOutput(struct _mdi *mdi, int8_t *buffer, uint32_t size, _WM_Resample resample, int32_t *tmp_buffer) {
+    uint32_t frame_size = WM_FrameSize(mdi, _WM_sample_size(mdi->output_format));
+    uint32_t frames = size / frame_size;
+    uint32_t tmp_frames = frames;
+    uint32_t frames_used;
+
+    if (tmp_buffer == NULL) {
+        /* a primed handle renders in pieces rather than growing its mix buffer */
+        if ((mdi->primed_frames == 0) && (WM_ReserveMixBuffer(mdi, frames) < 0)) {
+            _WM_GLOBAL_ERROR(WM_ERR_MEM, NULL, errno);
+            return (-1);
+        }
+        tmp_buffer = mdi->mix_buffer;
+        tmp_frames = mdi->mix_buffer_size / mdi->channels;
+    }
+
+    WM_RT_BEGIN(mdi);
+    frames_used = WM_RenderIntChunked(mdi, buffer, frames, mdi->output_format, resample,
+                                      tmp_buffer, tmp_frames);
+    memset(buffer + frames_used * frame_size, 0, size - frames_used * frame_size);
+    WM_RT_END(mdi);
+
+    return (frames_used * frame_size);
+}
+
+/* as WM_GetOutput, on the float bus */
+static int WM_GetOutputFloat(struct _mdi *mdi, float *buffer, uint32_t size, _WM_Resample resample) {
+    uint32_t frame_size = WM_FrameSize(mdi, sizeof(float));
+    uint32_t frames_used;
+
+    WM_RT_BEGIN(mdi);
+    frames_used = WM_RenderFloat(mdi, buffer, size / frame_size, resample);
+    memset(buffer + frames_used * mdi->channels, 0, size - frames_used * frame_size);
+    WM_RT_END(mdi);
+
+    return (frames_used * frame_size);
+}
+
+
 /*
  * =========================
  * External Functions
@@ -1532,46 +1425,96 @@ WM_SYMBOL long WildMidi_GetVersion (void) {
     return (LIBWILDMIDI_VERSION);
 }
 
-static int _WM_Init(const struct _WM_VIO *callbacks,
-                    const char *config_file, uint16_t rate, uint16_t mixer_options) {
-    if (WM_Initialized) {
-        _WM_GLOBAL_ERROR(WM_ERR_ALR_INIT, NULL, 0);
-        return (-1);
-    }
+static struct _WM_Context *WM_CreateContext(const char *config_file, uint16_t rate, uint16_t mixer_options) {
+    struct _WM_Context *ctx;
 
     if (config_file == NULL) {
         _WM_GLOBAL_ERROR(WM_ERR_INVALID_ARG,
                 "(NULL config file pointer)", 0);
-        return (-1);
+        return (NULL);
     }
 
-    _WM_BufferFile = callbacks->allocate_file;
-    _WM_FreeBufferFile = callbacks->free_file;
+    ctx = (struct _WM_Context *) calloc(1, sizeof(struct _WM_Context));
+    if (ctx == NULL) {
+        _WM_GLOBAL_ERROR(WM_ERR_MEM, NULL, errno);
+        return (NULL);
+    }
+    ctx->master_volume = 948;
+    ctx->reverb_room_width = 16.875f;
+    ctx->reverb_room_length = 22.5f;
+    ctx->reverb_listen_posx = 8.4375f;
+    ctx->reverb_listen_posy = 16.875f;
 
-    WM_InitPatches();
-    if (WM_LoadConfig(config_file) == -1) {
-        return (-1);
+    if (WM_LoadConfig(ctx, config_file) == -1) {
+        free(ctx);
+        return (NULL);
     }
 
     if (mixer_options & 0x0FF0) {
         _WM_GLOBAL_ERROR(WM_ERR_INVALID_ARG, "(invalid option)",
                 0);
-        WM_FreePatches();
-        return (-1);
+        WM_FreePatches(ctx);
+        free(ctx);
+        return (NULL);
     }
-    _WM_MixerOptions = mixer_options;
+    ctx->mixer_options = mixer_options;
 
     if (rate < 11025) {
         _WM_GLOBAL_ERROR(WM_ERR_INVALID_ARG,
                 "(rate out of bounds, range is 11025 - 65535)", 0);
-        WM_FreePatches();
+        WM_FreePatches(ctx);
+        free(ctx);
+        return (NULL);
+    }
+    ctx->sample_rate = rate;
+
+    _WM_Lock(&WM_ContextLock);
+    if (WM_ContextCount++ == 0) {
+        _WM_init_resample();
+        _WM_init_convert();
+    }
+    _WM_Unlock(&WM_ContextLock);
+
+    return (ctx);
+}
+
+static void WM_FreeContext(struct _WM_Context *ctx) {
+    while (ctx->first_handle) {
+        /* closes open handle and rotates the handles list. */
+        WildMidi_Close((struct _mdi *) ctx->first_handle->handle);
+    }
+    WM_FreePatches(ctx);
+    _WM_free_bank(ctx);
+    free(ctx);
+
+    _WM_Lock(&WM_ContextLock);
+    if (--WM_ContextCount == 0) {
+        _WM_free_pool();
+        _WM_free_resample();
+    }
+    _WM_Unlock(&WM_ContextLock);
+}
+
+static int _WM_Init(const struct _WM_VIO *callbacks,
+                    const char *config_file, uint16_t rate, uint16_t mixer_options) {
+    if (WM_Initialized) {
+        _WM_GLOBAL_ERROR(WM_ERR_ALR_INIT, NULL, 0);
         return (-1);
     }
-    _WM_SampleRate = rate;
 
-    gauss_lock = 0;
-    _WM_patch_lock = 0;
-    _WM_MasterVolume = 948;
+    if (config_file == NULL) {
+        _WM_GLOBAL_ERROR(WM_ERR_INVALID_ARG,
+                "(NULL config file pointer)", 0);
+        return (-1);
+    }
+
+    _WM_BufferFile = callbacks->allocate_file;
+    _WM_FreeBufferFile = callbacks->free_file;
+
+    WM_DefaultContext = WM_CreateContext(config_file, rate, mixer_options);
+    if (WM_DefaultContext == NULL) {
+        return (-1);
+    }
     WM_Initialized = 1;
 
     return (0);
@@ -1582,36 +1525,192 @@ WM_SYMBOL int WildMidi_Init(const char *config_file, uint16_t rate, uint16_t mix
     return _WM_Init(&callbacks_, config_file, rate, mixer_options);
 }
 
+WM_SYMBOL void *WildMidi_MapFile(const char *filename, uint32_t *size) {
+    return (_WM_MapBufferFile(filename, size));
+}
+
+WM_SYMBOL void WildMidi_UnmapFile(void *buffer) {
+    _WM_UnmapBufferFile(buffer);
+}
+
 WM_SYMBOL int WildMidi_InitVIO(struct _WM_VIO *callbacks, const char *config_file, uint16_t rate, uint16_t mixer_options) {
+    struct _WM_VIO mapped_ = { _WM_MapBufferFile, _WM_UnmapBufferFile };
+
     if (!callbacks || !callbacks->allocate_file || !callbacks->free_file) {
         _WM_GLOBAL_ERROR(WM_ERR_INVALID_ARG, "(NULL VIO callbacks)", 0);
         return (-1);
     }
 
+    /* file_io.c has to know it's ours, so it may map files itself too */
+    if ((callbacks->allocate_file == WildMidi_MapFile)
+            && (callbacks->free_file == WildMidi_UnmapFile)) {
+        return _WM_Init(&mapped_, config_file, rate, mixer_options);
+    }
     return _WM_Init(callbacks, config_file, rate, mixer_options);
 }
 
-WM_SYMBOL int WildMidi_MasterVolume(uint8_t master_volume) {
-    if (!WM_Initialized) {
-        _WM_GLOBAL_ERROR(WM_ERR_NOT_INIT, NULL, 0);
+WM_SYMBOL midi_context *WildMidi_CreateContext(const char *config_file, uint16_t rate, uint16_t mixer_options) {
+    return ((midi_context *) WM_CreateContext(config_file, rate, mixer_options));
+}
+
+WM_SYMBOL int WildMidi_DestroyContext(midi_context *context) {
+    if (context == NULL) {
+        _WM_GLOBAL_ERROR(WM_ERR_INVALID_ARG, "(NULL context)", 0);
         return (-1);
     }
+    WM_FreeContext((struct _WM_Context *) context);
+    return (0);
+}
+
+static int WM_MasterVolume(struct _WM_Context *ctx, uint8_t master_volume) {
     if (master_volume > 127) {
         _WM_GLOBAL_ERROR(WM_ERR_INVALID_ARG,
                 "(master volume out of range, range is 0-127)", 0);
         return (-1);
     }
 
-    _WM_MasterVolume = _WM_lin_volume[master_volume];
+    ctx->master_volume = _WM_lin_volume[master_volume];
 
     return (0);
 }
 
+WM_SYMBOL int WildMidi_MasterVolume(uint8_t master_volume) {
+    if (!WM_Initialized) {
+        _WM_GLOBAL_ERROR(WM_ERR_NOT_INIT, NULL, 0);
+        return (-1);
+    }
+    return (WM_MasterVolume(WM_DefaultContext, master_volume));
+}
+
+WM_SYMBOL int WildMidi_ContextMasterVolume(midi_context *context, uint8_t master_volume) {
+    if (context == NULL) {
+        _WM_GLOBAL_ERROR(WM_ERR_INVALID_ARG, "(NULL context)", 0);
+        return (-1);
+    }
+    return (WM_MasterVolume((struct _WM_Context *) context, master_volume));
+}
+
+static int WM_SetPatchCache(struct _WM_Context *ctx, uint64_t budget) {
+    _WM_Lock(&ctx->patch_lock);
+    ctx->cache_budget = budget;
+    _WM_trim_patches(ctx);
+    _WM_Unlock(&ctx->patch_lock);
+    return (0);
+}
+
+WM_SYMBOL int WildMidi_SetPatchCache(uint64_t budget) {
+    if (!WM_Initialized) {
+        _WM_GLOBAL_ERROR(WM_ERR_NOT_INIT, NULL, 0);
+        return (-1);
+    }
+    return (WM_SetPatchCache(WM_DefaultContext, budget));
+}
+
+WM_SYMBOL int WildMidi_ContextSetPatchCache(midi_context *context, uint64_t budget) {
+    if (context == NULL) {
+        _WM_GLOBAL_ERROR(WM_ERR_INVALID_ARG, "(NULL context)", 0);
+        return (-1);
+    }
+    return (WM_SetPatchCache((struct _WM_Context *) context, budget));
+}
+
+static int WM_GetPatchCache(struct _WM_Context *ctx, struct _WM_PatchCache *cache) {
+    if (cache == NULL) {
+        _WM_GLOBAL_ERROR(WM_ERR_INVALID_ARG, "(NULL cache)", 0);
+        return (-1);
+    }
+    _WM_Lock(&ctx->patch_lock);
+    cache->budget = ctx->cache_budget;
+    cache->resident = ctx->cache_resident;
+    cache->hits = ctx->cache_hits;
+    cache->misses = ctx->cache_misses;
+    cache->evictions = ctx->cache_evictions;
+    _WM_Unlock(&ctx->patch_lock);
+    return (0);
+}
+
+WM_SYMBOL int WildMidi_GetPatchCache(struct _WM_PatchCache *cache) {
+    if (!WM_Initialized) {
+        _WM_GLOBAL_ERROR(WM_ERR_NOT_INIT, NULL, 0);
+        return (-1);
+    }
+    return (WM_GetPatchCache(WM_DefaultContext, cache));
+}
+
+WM_SYMBOL int WildMidi_ContextGetPatchCache(midi_context *context, struct _WM_PatchCache *cache) {
+    if (context == NULL) {
+        _WM_GLOBAL_ERROR(WM_ERR_INVALID_ARG, "(NULL context)", 0);
+        return (-1);
+    }
+    return (WM_GetPatchCache((struct _WM_Context *) context, cache));
+}
+
+static int WM_MakeBank(struct _WM_Context *ctx, uint8_t **bank, uint32_t *size) {
+    if ((bank == NULL) || (size == NULL)) {
+        _WM_GLOBAL_ERROR(WM_ERR_INVALID_ARG, "(NULL params)", 0);
+        return (-1);
+    }
+    return (_WM_make_bank(ctx, bank, size));
+}
+
+WM_SYMBOL int WildMidi_MakeBank(uint8_t **bank, uint32_t *size) {
+    if (!WM_Initialized) {
+        _WM_GLOBAL_ERROR(WM_ERR_NOT_INIT, NULL, 0);
+        return (-1);
+    }
+    return (WM_MakeBank(WM_DefaultContext, bank, size));
+}
+
+WM_SYMBOL int WildMidi_ContextMakeBank(midi_context *context, uint8_t **bank, uint32_t *size) {
+    if (context == NULL) {
+        _WM_GLOBAL_ERROR(WM_ERR_INVALID_ARG, "(NULL context)", 0);
+        return (-1);
+    }
+    return (WM_MakeBank((struct _WM_Context *) context, bank, size));
+}
+
+static int WM_LoadBank(struct _WM_Context *ctx, const char *bank_file) {
+    int busy;
+
+    if (bank_file == NULL) {
+        _WM_GLOBAL_ERROR(WM_ERR_INVALID_ARG, "(NULL filename)", 0);
+        return (-1);
+    }
+    _WM_Lock(&ctx->handle_lock);
+    busy = (ctx->first_handle != NULL);
+    _WM_Unlock(&ctx->handle_lock);
+    if (busy) {
+        _WM_GLOBAL_ERROR(WM_ERR_INVALID_ARG, "(midi's open)", 0);
+        return (-1);
+    }
+
+    /* patches closed midis were loading would miss it */
+    _WM_wait_patch_loads(ctx);
+    return (_WM_load_bank(ctx, bank_file));
+}
+
+WM_SYMBOL int WildMidi_LoadBank(const char *bank_file) {
+    if (!WM_Initialized) {
+        _WM_GLOBAL_ERROR(WM_ERR_NOT_INIT, NULL, 0);
+        return (-1);
+    }
+    return (WM_LoadBank(WM_DefaultContext, bank_file));
+}
+
+WM_SYMBOL int WildMidi_ContextLoadBank(midi_context *context, const char *bank_file) {
+    if (context == NULL) {
+        _WM_GLOBAL_ERROR(WM_ERR_INVALID_ARG, "(NULL context)", 0);
+        return (-1);
+    }
+    return (WM_LoadBank((struct _WM_Context *) context, bank_file));
+}
+
 WM_SYMBOL int WildMidi_Close(midi * handle) {
     struct _mdi *mdi = (struct _mdi *) handle;
+    struct _WM_Context *ctx;
     struct _hndl * tmp_handle;
 
-    if (!WM_Initialized) {
+    if (!WM_ContextCount) {
         _WM_GLOBAL_ERROR(WM_ERR_NOT_INIT, NULL, 0);
         return (-1);
     }
@@ -1619,19 +1718,22 @@ WM_SYMBOL int WildMidi_Close(midi * handle) {
         _WM_GLOBAL_ERROR(WM_ERR_INVALID_ARG, "(NULL handle)", 0);
         return (-1);
     }
-    if (first_handle == NULL) {
+    ctx = mdi->ctx;
+    _WM_Lock(&ctx->handle_lock);
+    if (ctx->first_handle == NULL) {
         _WM_GLOBAL_ERROR(WM_ERR_INVALID_ARG, "(no midi's open)", 0);
+        _WM_Unlock(&ctx->handle_lock);
         return (-1);
     }
     _WM_Lock(&mdi->lock);
-    if (first_handle->handle == handle) {
-        tmp_handle = first_handle->next;
-        free(first_handle);
-        first_handle = tmp_handle;
-        if (first_handle)
-            first_handle->prev = NULL;
+    if (ctx->first_handle->handle == handle) {
+        tmp_handle = ctx->first_handle->next;
+        free(ctx->first_handle);
+        ctx->first_handle = tmp_handle;
+        if (ctx->first_handle)
+            ctx->first_handle->prev = NULL;
     } else {
-        tmp_handle = first_handle;
+        tmp_handle = ctx->first_handle;
         while (tmp_handle->handle != handle) {
             tmp_handle = tmp_handle->next;
             if (tmp_handle == NULL) {
@@ -1646,67 +1748,65 @@ WM_SYMBOL int WildMidi_Close(midi * handle) {
             free(tmp_handle);
         }
     }
+    _WM_Unlock(&ctx->handle_lock);
 
     _WM_freeMDI(mdi);
 
     return (0);
 }
 
-WM_SYMBOL midi *WildMidi_Open(const char *midifile) {
-    uint8_t *mididata = NULL;
-    uint32_t midisize = 0;
+static midi *WM_ParseBuffer(struct _WM_Context *ctx, const uint8_t *midibuffer, uint32_t size) {
     uint8_t mus_hdr[] = { 'M', 'U', 'S', 0x1A };
     uint8_t xmi_hdr[] = { 'F', 'O', 'R', 'M' };
     midi * ret = NULL;
 
-    if (!WM_Initialized) {
-        _WM_GLOBAL_ERROR(WM_ERR_NOT_INIT, NULL, 0);
-        return (NULL);
-    }
-    if (midifile == NULL) {
-        _WM_GLOBAL_ERROR(WM_ERR_INVALID_ARG, "(NULL filename)", 0);
-        return (NULL);
-    }
-
-    if ((mididata = (uint8_t *) _WM_BufferFile(midifile, &midisize)) == NULL) {
-        return (NULL);
-    }
-    if (midisize < 18) {
+    if (size < 18) {
         _WM_GLOBAL_ERROR(WM_ERR_CORUPT, "(too short)", 0);
         return (NULL);
     }
-    if (memcmp(mididata,"HMIMIDIP", 8) == 0) {
-        ret = (void *) _WM_ParseNewHmp(mididata, midisize);
-    } else if (memcmp(mididata, "HMI-MIDISONG061595", 18) == 0) {
-        ret = (void *) _WM_ParseNewHmi(mididata, midisize);
-    } else if (memcmp(mididata, mus_hdr, 4) == 0) {
-        ret = (void *) _WM_ParseNewMus(mididata, midisize);
-    } else if (memcmp(mididata, xmi_hdr, 4) == 0) {
-        ret = (void *) _WM_ParseNewXmi(mididata, midisize);
+    if (memcmp(midibuffer,"HMIMIDIP", 8) == 0) {
+        ret = (void *) _WM_ParseNewHmp(ctx, midibuffer, size);
+    } else if (memcmp(midibuffer, "HMI-MIDISONG061595", 18) == 0) {
+        ret = (void *) _WM_ParseNewHmi(ctx, midibuffer, size);
+    } else if (memcmp(midibuffer, mus_hdr, 4) == 0) {
+        ret = (void *) _WM_ParseNewMus(ctx, midibuffer, size);
+    } else if (memcmp(midibuffer, xmi_hdr, 4) == 0) {
+        ret = (void *) _WM_ParseNewXmi(ctx, midibuffer, size);
     } else {
-        ret = (void *) _WM_ParseNewMidi(mididata, midisize);
+        ret = (void *) _WM_ParseNewMidi(ctx, midibuffer, size);
     }
-    _WM_FreeBufferFile(mididata);
 
     if (ret) {
-        if (add_handle(ret) != 0) {
+        if (add_handle(ctx, ret) != 0) {
             WildMidi_Close(ret);
-            ret = NULL;
+            return (NULL);
         }
+        _WM_load_patches((struct _mdi *) ret);
     }
 
     return (ret);
 }
 
-WM_SYMBOL midi *WildMidi_OpenBuffer(const uint8_t *midibuffer, uint32_t size) {
-    uint8_t mus_hdr[] = { 'M', 'U', 'S', 0x1A };
-    uint8_t xmi_hdr[] = { 'F', 'O', 'R', 'M' };
+static midi *WM_Open(struct _WM_Context *ctx, const char *midifile) {
+    uint8_t *mididata = NULL;
+    uint32_t midisize = 0;
     midi * ret = NULL;
 
-    if (!WM_Initialized) {
-        _WM_GLOBAL_ERROR(WM_ERR_NOT_INIT, NULL, 0);
+    if (midifile == NULL) {
+        _WM_GLOBAL_ERROR(WM_ERR_INVALID_ARG, "(NULL filename)", 0);
+        return (NULL);
+    }
+
+    if ((mididata = (uint8_t *) _WM_BufferFile(midifile, &midisize)) == NULL) {
         return (NULL);
     }
+    ret = WM_ParseBuffer(ctx, mididata, midisize);
+    _WM_FreeBufferFile(mididata);
+
+    return (ret);
+}
+
+static midi *WM_OpenBuffer(struct _WM_Context *ctx, const uint8_t *midibuffer, uint32_t size) {
     if (midibuffer == NULL) {
         _WM_GLOBAL_ERROR(WM_ERR_INVALID_ARG, "(NULL midi data buffer)", 0);
         return (NULL);
@@ -1716,38 +1816,46 @@ WM_SYMBOL midi *WildMidi_OpenBuffer(const uint8_t *midibuffer, uint32_t size) {
         _WM_GLOBAL_ERROR(WM_ERR_LONGFIL, NULL, 0);
         return (NULL);
     }
-    if (size < 18) {
-        _WM_GLOBAL_ERROR(WM_ERR_CORUPT, "(too short)", 0);
+    return (WM_ParseBuffer(ctx, midibuffer, size));
+}
+
+WM_SYMBOL midi *WildMidi_Open(const char *midifile) {
+    if (!WM_Initialized) {
+        _WM_GLOBAL_ERROR(WM_ERR_NOT_INIT, NULL, 0);
         return (NULL);
     }
-    if (memcmp(midibuffer,"HMIMIDIP", 8) == 0) {
-        ret = (void *) _WM_ParseNewHmp(midibuffer, size);
-    } else if (memcmp(midibuffer, "HMI-MIDISONG061595", 18) == 0) {
-        ret = (void *) _WM_ParseNewHmi(midibuffer, size);
-    } else if (memcmp(midibuffer, mus_hdr, 4) == 0) {
-        ret = (void *) _WM_ParseNewMus(midibuffer, size);
-    } else if (memcmp(midibuffer, xmi_hdr, 4) == 0) {
-        ret = (void *) _WM_ParseNewXmi(midibuffer, size);
-    } else {
-        ret = (void *) _WM_ParseNewMidi(midibuffer, size);
+    return (WM_Open(WM_DefaultContext, midifile));
+}
+
+WM_SYMBOL midi *WildMidi_OpenBuffer(const uint8_t *midibuffer, uint32_t size) {
+    if (!WM_Initialized) {
+        _WM_GLOBAL_ERROR(WM_ERR_NOT_INIT, NULL, 0);
+        return (NULL);
     }
+    return (WM_OpenBuffer(WM_DefaultContext, midibuffer, size));
+}
 
-    if (ret) {
-        if (add_handle(ret) != 0) {
-            WildMidi_Close(ret);
-            ret = NULL;
-        }
+WM_SYMBOL midi *WildMidi_OpenInContext(midi_context *context, const char *midifile) {
+    if (context == NULL) {
+        _WM_GLOBAL_ERROR(WM_ERR_INVALID_ARG, "(NULL context)", 0);
+        return (NULL);
     }
+    return (WM_Open((struct _WM_Context *) context, midifile));
+}
 
-    return (ret);
+WM_SYMBOL midi *WildMidi_OpenBufferInContext(midi_context *context, const uint8_t *midibuffer, uint32_t size) {
+    if (context == NULL) {
+        _WM_GLOBAL_ERROR(WM_ERR_INVALID_ARG, "(NULL context)", 0);
+        return (NULL);
+    }
+    return (WM_OpenBuffer((struct _WM_Context *) context, midibuffer, size));
 }
 
 WM_SYMBOL int WildMidi_FastSeek(midi * handle, unsigned long int *sample_pos) {
     struct _mdi *mdi;
     struct _event *event;
-    struct _note *note_data;
 
-    if (!WM_Initialized) {
+    if (!WM_ContextCount) {
         _WM_GLOBAL_ERROR(WM_ERR_NOT_INIT, NULL, 0);
         return (-1);
     }
@@ -1762,6 +1870,7 @@ WM_SYMBOL int WildMidi_FastSeek(midi * handle, unsigned long int *sample_pos) {
 
     mdi = (struct _mdi *) handle;
     _WM_Lock(&mdi->lock);
+    WM_RT_BEGIN(mdi);
     event = mdi->current_event;
 
     /* make sure we haven't asked for a positions beyond the end of the song. */
@@ -1773,6 +1882,7 @@ WM_SYMBOL int WildMidi_FastSeek(midi * handle, unsigned long int *sample_pos) {
     /* was end of song requested and are we are there? */
     if (*sample_pos == mdi->extra_info.approx_total_samples) {
         /* yes */
+        WM_RT_END(mdi);
         _WM_Unlock(&mdi->lock);
         return (0);
     }
@@ -1815,21 +1925,12 @@ WM_SYMBOL int WildMidi_FastSeek(midi * handle, unsigned long int *sample_pos) {
      * NOTE: This function is for performance only.
      * Might need a WildMidi_SlowSeek if we need better accuracy.
      */
-    note_data = mdi->note;
-    if (note_data) {
-        do {
-            note_data->active = 0;
-            if (note_data->replay) {
-                note_data->replay = NULL;
-            }
-            note_data = note_data->next;
-        } while (note_data);
-    }
-    mdi->note = NULL;
+    _WM_ClearVoices(mdi);
 
     /* clear the reverb buffers since we not gonna be using them here */
     _WM_reset_reverb(mdi->reverb);
 
+    WM_RT_END(mdi);
     _WM_Unlock(&mdi->lock);
     return (0);
 }
@@ -1838,9 +1939,8 @@ WM_SYMBOL int WildMidi_SongSeek (midi * handle, int8_t nextsong) {
     struct _mdi *mdi;
     struct _event *event;
     struct _event *event_new;
-    struct _note *note_data;
 
-    if (!WM_Initialized) {
+    if (!WM_ContextCount) {
         _WM_GLOBAL_ERROR(WM_ERR_NOT_INIT, NULL, 0);
         return (-1);
     }
@@ -1862,6 +1962,7 @@ WM_SYMBOL int WildMidi_SongSeek (midi * handle, int8_t nextsong) {
         return (-1);
     }
 
+    WM_RT_BEGIN(mdi);
     event = mdi->current_event;
 
     if (nextsong == -1) {
@@ -1927,24 +2028,58 @@ WM_SYMBOL int WildMidi_SongSeek (midi * handle, int8_t nextsong) {
 
     mdi->current_event = event;
 
-    note_data = mdi->note;
-    if (note_data) {
-        do {
-            note_data->active = 0;
-            if (note_data->replay) {
-                note_data->replay = NULL;
-            }
-            note_data = note_data->next;
-        } while (note_data);
-    }
-    mdi->note = NULL;
+    _WM_ClearVoices(mdi);
+    WM_RT_END(mdi);
 
     _WM_Unlock(&mdi->lock);
     return (0);
 }
 
 WM_SYMBOL int WildMidi_GetOutput(midi * handle, int8_t *buffer, uint32_t size) {
-    if (__builtin_expect((!WM_Initialized), 0)) {
+    struct _mdi *mdi;
+    _WM_Resample resample;
+    int ret;
+
+    if (__builtin_expect((!WM_ContextCount), 0)) {
+        _WM_GLOBAL_ERROR(WM_ERR_NOT_INIT, NULL, 0);
+        return (-1);
+    }
+    if (__builtin_expect((handle == NULL), 0)) {
+        _WM_GLOBAL_ERROR(WM_ERR_INVALID_ARG, "(NULL handle)", 0);
+        return (-1);
+    }
+    if (__builtin_expect((buffer == NULL), 0)) {
+        _WM_GLOBAL_ERROR(WM_ERR_INVALID_ARG, "(NULL buffer pointer)", 0);
+        return (-1);
+    }
+    if (__builtin_expect((size == 0), 0)) {
+        return (0);
+    }
+    mdi = (struct _mdi *) handle;
+    _WM_Lock(&mdi->lock);
+    if (__builtin_expect((!!(size % WM_FrameSize(mdi, _WM_sample_size(mdi->output_format)))), 0)) {
+        _WM_GLOBAL_ERROR(WM_ERR_INVALID_ARG, "(size not a multiple of the frame size)", 0);
+        _WM_Unlock(&mdi->lock);
+        return (-1);
+    }
+    /* picked under the lock too, the kernel has to match the channel count */
+    resample = _WM_get_resampler(mdi->resampler, mdi->gauss_order, WM_MixBus(mdi, WM_BUS_INT));
+    if (__builtin_expect((resample == NULL), 0)) {
+        _WM_GLOBAL_ERROR(WM_ERR_MEM, NULL, errno);
+        _WM_Unlock(&mdi->lock);
+        return (-1);
+    }
+    ret = WM_GetOutput(mdi, buffer, size, resample, NULL);
+    _WM_Unlock(&mdi->lock);
+    return (ret);
+}
+
+WM_SYMBOL int WildMidi_GetOutputFloat(midi * handle, float *buffer, uint32_t size) {
+    struct _mdi *mdi;
+    _WM_Resample resample;
+    int ret;
+
+    if (__builtin_expect((!WM_ContextCount), 0)) {
         _WM_GLOBAL_ERROR(WM_ERR_NOT_INIT, NULL, 0);
         return (-1);
     }
@@ -1959,20 +2094,241 @@ WM_SYMBOL int WildMidi_GetOutput(midi * handle, int8_t *buffer, uint32_t size) {
     if (__builtin_expect((size == 0), 0)) {
         return (0);
     }
-    if (__builtin_expect((!!(size % 4)), 0)) {
-        _WM_GLOBAL_ERROR(WM_ERR_INVALID_ARG, "(size not a multiple of 4)", 0);
+    mdi = (struct _mdi *) handle;
+    _WM_Lock(&mdi->lock);
+    if (__builtin_expect((!!(size % WM_FrameSize(mdi, sizeof(float)))), 0)) {
+        _WM_GLOBAL_ERROR(WM_ERR_INVALID_ARG, "(size not a multiple of the frame size)", 0);
+        _WM_Unlock(&mdi->lock);
+        return (-1);
+    }
+    /* picked under the lock too, the kernel has to match the channel count */
+    resample = _WM_get_resampler(mdi->resampler, mdi->gauss_order, WM_MixBus(mdi, WM_BUS_FLOAT));
+    if (__builtin_expect((resample == NULL), 0)) {
+        _WM_GLOBAL_ERROR(WM_ERR_MEM, NULL, errno);
+        _WM_Unlock(&mdi->lock);
+        return (-1);
+    }
+    ret = WM_GetOutputFloat(mdi, buffer, size, resample);
+    _WM_Unlock(&mdi->lock);
+    return (ret);
+}
+
+WM_SYMBOL int WildMidi_Prime(midi * handle, uint32_t max_frames) {
+    struct _mdi *mdi;
+    uint32_t workers;
+    int32_t *part;
+
+    if (!WM_ContextCount) {
+        _WM_GLOBAL_ERROR(WM_ERR_NOT_INIT, NULL, 0);
+        return (-1);
+    }
+    if (handle == NULL) {
+        _WM_GLOBAL_ERROR(WM_ERR_INVALID_ARG, "(NULL handle)", 0);
+        return (-1);
+    }
+    if ((max_frames == 0) || (max_frames > (0xFFFFFFFF / WM_BUS_FRAME(WM_BUS_INT)))) {
+        _WM_GLOBAL_ERROR(WM_ERR_INVALID_ARG, "(invalid max_frames)", 0);
+        return (-1);
+    }
+
+    mdi = (struct _mdi *) handle;
+    _WM_Lock(&mdi->lock);
+    if (_WM_get_resampler(mdi->resampler, mdi->gauss_order, WM_BUS_INT) == NULL) {
+        _WM_GLOBAL_ERROR(WM_ERR_MEM, NULL, errno);
+        _WM_Unlock(&mdi->lock);
+        return (-1);
+    }
+    /* sized for stereo, so WM_MO_CHANNELS can be changed after */
+    if ((WM_ReserveMixBuffer(mdi, max_frames) < 0) || (_WM_ReserveVoices(mdi) < 0)) {
+        _WM_GLOBAL_ERROR(WM_ERR_MEM, NULL, errno);
+        _WM_Unlock(&mdi->lock);
+        return (-1);
+    }
+    /* also starts the pool, a part buffer too large to size means no parallel mixing */
+    workers = _WM_pool_workers();
+    if ((workers > 1) && (((uint64_t) (workers - 1) * max_frames * 2) <= 0xFFFFFFFF)
+            && (((workers - 1) * max_frames * 2) > mdi->part_buffer_size)) {
+        part = (int32_t *) realloc(mdi->part_buffer, (workers - 1) * max_frames * 2 * sizeof(int32_t));
+        if (part == NULL) {
+            _WM_GLOBAL_ERROR(WM_ERR_MEM, NULL, errno);
+            _WM_Unlock(&mdi->lock);
+            return (-1);
+        }
+        mdi->part_buffer = part;
+        mdi->part_buffer_size = (workers - 1) * max_frames * 2;
+    }
+    /* note ons would otherwise load whatever the pool hasn't got to yet */
+    _WM_wait_patches(mdi);
+    mdi->primed_frames = max_frames;
+    _WM_Unlock(&mdi->lock);
+    return (0);
+}
+
+WM_SYMBOL int WildMidi_Render(midi * handle, void *frames, uint32_t frame_count, uint16_t format) {
+    struct _mdi *mdi;
+    _WM_Resample resample;
+    uint32_t total = 0;
+
+    if (__builtin_expect((!WM_ContextCount), 0)) {
+        _WM_GLOBAL_ERROR(WM_ERR_NOT_INIT, NULL, 0);
+        return (-1);
+    }
+    if (__builtin_expect((handle == NULL), 0)) {
+        _WM_GLOBAL_ERROR(WM_ERR_INVALID_ARG, "(NULL handle)", 0);
+        return (-1);
+    }
+    if (__builtin_expect((frames == NULL), 0)) {
+        _WM_GLOBAL_ERROR(WM_ERR_INVALID_ARG, "(NULL buffer pointer)", 0);
+        return (-1);
+    }
+    if (__builtin_expect((format > WM_OF_F32), 0)) {
+        _WM_GLOBAL_ERROR(WM_ERR_INVALID_ARG, "(invalid format)", 0);
+        return (-1);
+    }
+    /* so that sizes in bytes fit a uint32_t */
+    if (__builtin_expect((frame_count > (0xFFFFFFFF / WM_BUS_FRAME(WM_BUS_INT))), 0)) {
+        frame_count = 0xFFFFFFFF / WM_BUS_FRAME(WM_BUS_INT);
+    }
+    if (__builtin_expect((frame_count == 0), 0)) {
+        return (0);
+    }
+
+    mdi = (struct _mdi *) handle;
+    _WM_Lock(&mdi->lock);
+    resample = _WM_get_resampler(mdi->resampler, mdi->gauss_order,
+                                 WM_MixBus(mdi, (format == WM_OF_F32) ? WM_BUS_FLOAT : WM_BUS_INT));
+    if (__builtin_expect((resample == NULL), 0)) {
+        _WM_GLOBAL_ERROR(WM_ERR_MEM, NULL, errno);
+        _WM_Unlock(&mdi->lock);
+        return (-1);
+    }
+
+    if (format == WM_OF_F32) {
+        WM_RT_BEGIN(mdi);
+        total = WM_RenderFloat(mdi, (float *) frames, frame_count, resample);
+        WM_RT_END(mdi);
+        _WM_Unlock(&mdi->lock);
+        return ((int) total);
+    }
+
+    /* a primed handle renders in pieces rather than growing its mix buffer */
+    if ((mdi->primed_frames == 0) && (WM_ReserveMixBuffer(mdi, frame_count) < 0)) {
+        _WM_GLOBAL_ERROR(WM_ERR_MEM, NULL, errno);
+        _WM_Unlock(&mdi->lock);
+        return (-1);
+    }
+    WM_RT_BEGIN(mdi);
+    total = WM_RenderIntChunked(mdi, (int8_t *) frames, frame_count, (uint8_t) format,
+                                resample, mdi->mix_buffer, mdi->mix_buffer_size / mdi->channels);
+    WM_RT_END(mdi);
+    _WM_Unlock(&mdi->lock);
+    return ((int) total);
+}
+
+struct _batch {
+    midi **handles;
+    int8_t **buffers;
+    uint32_t *sizes;
+    int *results;
+};
+
+/* a job's result when its size no longer fits the handle's frame size */
+#define WM_BATCH_BAD_SIZE -2
+
+/* renders one handle of a batch, run on any of the pool's threads */
+static void WM_RenderBatchJob(void *data, uint32_t index, uint32_t worker) {
+    struct _batch *batch = (struct _batch *) data;
+    struct _mdi *mdi = (struct _mdi *) batch->handles[index];
+    uint32_t size = batch->sizes[index];
+    _WM_Resample resample;
+    int32_t *tmp_buffer;
+
+    if (size == 0) {
+        batch->results[index] = 0;
+        return;
+    }
+    _WM_Lock(&mdi->lock);
+    /* the handle's options may have changed since WildMidi_RenderBatch checked them */
+    if (size % WM_FrameSize(mdi, _WM_sample_size(mdi->output_format))) {
+        batch->results[index] = WM_BATCH_BAD_SIZE;
+        _WM_Unlock(&mdi->lock);
+        return;
+    }
+    resample = _WM_get_resampler(mdi->resampler, mdi->gauss_order, WM_MixBus(mdi, WM_BUS_INT));
+    tmp_buffer = (int32_t *) _WM_pool_scratch(worker,
+            (size / _WM_sample_size(mdi->output_format)) * sizeof(int32_t));
+    if ((resample == NULL) || (tmp_buffer == NULL)) {
+        batch->results[index] = -1;
+    } else {
+        batch->results[index] = WM_GetOutput(mdi, batch->buffers[index], size, resample, tmp_buffer);
+    }
+    _WM_Unlock(&mdi->lock);
+}
+
+WM_SYMBOL int WildMidi_RenderBatch(midi **handles, int8_t **buffers, uint32_t *sizes, int *results, uint32_t count) {
+    struct _batch batch;
+    struct _mdi *mdi;
+    uint32_t i;
+    int ret = 0;
+
+    if (!WM_ContextCount) {
+        _WM_GLOBAL_ERROR(WM_ERR_NOT_INIT, NULL, 0);
         return (-1);
     }
+    if ((handles == NULL) || (buffers == NULL) || (sizes == NULL) || (results == NULL)) {
+        _WM_GLOBAL_ERROR(WM_ERR_INVALID_ARG, "(NULL params)", 0);
+        return (-1);
+    }
+    for (i = 0; i < count; i++) {
+        mdi = (struct _mdi *) handles[i];
+        if (mdi == NULL) {
+            _WM_GLOBAL_ERROR(WM_ERR_INVALID_ARG, "(NULL handle)", 0);
+            return (-1);
+        }
+        if (buffers[i] == NULL) {
+            _WM_GLOBAL_ERROR(WM_ERR_INVALID_ARG, "(NULL buffer pointer)", 0);
+            return (-1);
+        }
+        _WM_Lock(&mdi->lock);
+        if (sizes[i] % WM_FrameSize(mdi, _WM_sample_size(mdi->output_format))) {
+            _WM_GLOBAL_ERROR(WM_ERR_INVALID_ARG, "(size not a multiple of the frame size)", 0);
+            _WM_Unlock(&mdi->lock);
+            return (-1);
+        }
+        /* builds any tables it needs here, so the jobs can't fail on them */
+        if (_WM_get_resampler(mdi->resampler, mdi->gauss_order, WM_MixBus(mdi, WM_BUS_INT)) == NULL) {
+            _WM_GLOBAL_ERROR(WM_ERR_MEM, NULL, errno);
+            _WM_Unlock(&mdi->lock);
+            return (-1);
+        }
+        _WM_Unlock(&mdi->lock);
+    }
 
-    if (((struct _mdi *) handle)->extra_info.mixer_options & WM_MO_ENHANCED_RESAMPLING) {
-        if (!gauss_table) init_gauss();
-        return (WM_GetOutput_Gauss(handle, buffer, size));
+    batch.handles = handles;
+    batch.buffers = buffers;
+    batch.sizes = sizes;
+    batch.results = results;
+    _WM_pool_run(WM_RenderBatchJob, &batch, count);
+
+    for (i = 0; i < count; i++) {
+        if (results[i] == WM_BATCH_BAD_SIZE) {
+            results[i] = -1;
+            if (ret == 0) {
+                _WM_GLOBAL_ERROR(WM_ERR_INVALID_ARG, "(size not a multiple of the frame size)", 0);
+            }
+            ret = -1;
+        } else if (results[i] < 0) {
+            if (ret == 0) {
+                _WM_GLOBAL_ERROR(WM_ERR_MEM, NULL, 0);
+            }
+            ret = -1;
+        }
     }
-    return (WM_GetOutput_Linear(handle, buffer, size));
+    return (ret);
 }
 
 WM_SYMBOL int WildMidi_GetMidiOutput(midi * handle, int8_t **buffer, uint32_t *size) {
-    if (__builtin_expect((!WM_Initialized), 0)) {
+    if (__builtin_expect((!WM_ContextCount), 0)) {
         _WM_GLOBAL_ERROR(WM_ERR_NOT_INIT, NULL, 0);
         return (-1);
     }
@@ -1991,7 +2347,7 @@ WM_SYMBOL int WildMidi_GetMidiOutput(midi * handle, int8_t **buffer, uint32_t *s
 WM_SYMBOL int WildMidi_SetOption(midi * handle, uint16_t options, uint16_t setting) {
     struct _mdi *mdi;
 
-    if (!WM_Initialized) {
+    if (!WM_ContextCount) {
         _WM_GLOBAL_ERROR(WM_ERR_NOT_INIT, NULL, 0);
         return (-1);
     }
@@ -2002,6 +2358,95 @@ WM_SYMBOL int WildMidi_SetOption(midi * handle, uint16_t options, uint16_t setti
 
     mdi = (struct _mdi *) handle;
     _WM_Lock(&mdi->lock);
+    switch (options) {
+    case WM_MO_GAUSS_ORDER:
+        if (setting != 8 && setting != 16 && setting != MAX_GAUSS_ORDER) {
+            _WM_GLOBAL_ERROR(WM_ERR_INVALID_ARG, "(invalid setting)", 0);
+            _WM_Unlock(&mdi->lock);
+            return (-1);
+        }
+        /* build the table now rather than in the middle of rendering */
+        if (_WM_get_resampler(mdi->resampler, setting, WM_BUS_INT) == NULL) {
+            _WM_GLOBAL_ERROR(WM_ERR_MEM, NULL, errno);
+            _WM_Unlock(&mdi->lock);
+            return (-1);
+        }
+        mdi->gauss_order = setting;
+        _WM_Unlock(&mdi->lock);
+        return (0);
+    case WM_MO_PARALLEL_VOICES:
+        mdi->parallel_voices = setting;
+        _WM_Unlock(&mdi->lock);
+        return (0);
+    case WM_MO_MAX_VOICES:
+        /* voices over a lowered limit play on, the next note ons steal them */
+        mdi->max_voices = setting;
+        _WM_Unlock(&mdi->lock);
+        return (0);
+    case WM_MO_REVERB_ENGINE:
+        if (setting > WM_RE_FDN) {
+            _WM_GLOBAL_ERROR(WM_ERR_INVALID_ARG, "(invalid setting)", 0);
+            _WM_Unlock(&mdi->lock);
+            return (-1);
+        }
+        if (setting != mdi->reverb->engine) {
+            struct _WM_Context *ctx = mdi->ctx;
+            struct _rvb *reverb = _WM_init_reverb(setting, ctx->sample_rate,
+                    ctx->reverb_room_width, ctx->reverb_room_length,
+                    ctx->reverb_listen_posx, ctx->reverb_listen_posy);
+            if (reverb == NULL) {
+                _WM_GLOBAL_ERROR(WM_ERR_MEM, NULL, 0);
+                _WM_Unlock(&mdi->lock);
+                return (-1);
+            }
+            _WM_free_reverb(mdi->reverb);
+            mdi->reverb = reverb;
+        }
+        _WM_Unlock(&mdi->lock);
+        return (0);
+    case WM_MO_OUTPUT_FORMAT:
+        if (setting > WM_OF_F32) {
+            _WM_GLOBAL_ERROR(WM_ERR_INVALID_ARG, "(invalid setting)", 0);
+            _WM_Unlock(&mdi->lock);
+            return (-1);
+        }
+        mdi->output_format = setting;
+        _WM_Unlock(&mdi->lock);
+        return (0);
+    case WM_MO_CHANNELS:
+        if ((setting != 1) && (setting != 2)) {
+            _WM_GLOBAL_ERROR(WM_ERR_INVALID_ARG, "(invalid setting)", 0);
+            _WM_Unlock(&mdi->lock);
+            return (-1);
+        }
+        if (setting != mdi->channels) {
+            mdi->channels = setting;
+            /* the reverb's state is laid out for the old channel count */
+            _WM_reset_reverb(mdi->reverb);
+        }
+        _WM_Unlock(&mdi->lock);
+        return (0);
+    case WM_MO_RESAMPLER:
+        if (setting > WM_RS_SINC) {
+            _WM_GLOBAL_ERROR(WM_ERR_INVALID_ARG, "(invalid setting)", 0);
+            _WM_Unlock(&mdi->lock);
+            return (-1);
+        }
+        if (_WM_get_resampler(setting, mdi->gauss_order, WM_BUS_INT) == NULL) {
+            _WM_GLOBAL_ERROR(WM_ERR_MEM, NULL, errno);
+            _WM_Unlock(&mdi->lock);
+            return (-1);
+        }
+        mdi->resampler = setting;
+        /* keep WM_MO_ENHANCED_RESAMPLING in step for WildMidi_GetInfo */
+        if (setting == WM_RS_GAUSS) {
+            mdi->extra_info.mixer_options |= WM_MO_ENHANCED_RESAMPLING;
+        } else {
+            mdi->extra_info.mixer_options &= ~WM_MO_ENHANCED_RESAMPLING;
+        }
+        _WM_Unlock(&mdi->lock);
+        return (0);
+    }
     if ((!(options & 0x800F)) || (options & 0x7FF0)) {
         _WM_GLOBAL_ERROR(WM_ERR_INVALID_ARG, "(invalid option)", 0);
         _WM_Unlock(&mdi->lock);
@@ -2016,6 +2461,14 @@ WM_SYMBOL int WildMidi_SetOption(midi * handle, uint16_t options, uint16_t setti
     mdi->extra_info.mixer_options = ((mdi->extra_info.mixer_options & (0x80FF ^ options))
                                     | (options & setting));
 
+    if (options & WM_MO_ENHANCED_RESAMPLING) {
+        if (setting & WM_MO_ENHANCED_RESAMPLING) {
+            mdi->resampler = WM_RS_GAUSS;
+        } else if (mdi->resampler == WM_RS_GAUSS) {
+            mdi->resampler = WM_RS_LINEAR;
+        }
+    }
+
     if (options & WM_MO_LOG_VOLUME) {
             _WM_AdjustChannelVolumes(mdi, 16);  /* Settings greater than 15
                                                    adjusts all channels */
@@ -2048,7 +2501,7 @@ WM_SYMBOL int WildMidi_SetCvtOption(uint16_t tag, uint16_t setting) {
 WM_SYMBOL struct _WM_Info *
 WildMidi_GetInfo(midi * handle) {
     struct _mdi *mdi = (struct _mdi *) handle;
-    if (!WM_Initialized) {
+    if (!WM_ContextCount) {
         _WM_GLOBAL_ERROR(WM_ERR_NOT_INIT, NULL, 0);
         return (NULL);
     }
@@ -2069,7 +2522,7 @@ WildMidi_GetInfo(midi * handle) {
     mdi->tmp_info->current_sample = mdi->extra_info.current_sample;
     mdi->tmp_info->approx_total_samples = mdi->extra_info.approx_total_samples;
     mdi->tmp_info->mixer_options = mdi->extra_info.mixer_options;
-    mdi->tmp_info->total_midi_time = (mdi->tmp_info->approx_total_samples * 1000) / _WM_SampleRate;
+    mdi->tmp_info->total_midi_time = (mdi->tmp_info->approx_total_samples * 1000) / mdi->ctx->sample_rate;
     if (mdi->extra_info.copyright) {
         free(mdi->tmp_info->copyright);
         mdi->tmp_info->copyright = (char *) malloc(strlen(mdi->extra_info.copyright) + 1);
@@ -2094,28 +2547,15 @@ WM_SYMBOL int WildMidi_Shutdown(void) {
         _WM_GLOBAL_ERROR(WM_ERR_NOT_INIT, NULL, 0);
         return (-1);
     }
-    while (first_handle) {
-        /* closes open handle and rotates the handles list. */
-        WildMidi_Close((struct _mdi *) first_handle->handle);
-    }
-    WM_FreePatches();
-    free_gauss();
+    WM_FreeContext(WM_DefaultContext);
+    WM_DefaultContext = NULL;
 
     /* reset the globals */
     _cvt_reset_options ();
-    _WM_MasterVolume = 948;
-    _WM_MixerOptions = 0;
-    _WM_fix_release = 0;
-    _WM_auto_amp = 0;
-    _WM_auto_amp_with_amp = 0;
-    _WM_reverb_room_width = 16.875f;
-    _WM_reverb_room_length = 22.5f;
-    _WM_reverb_listen_posx = 8.4375f;
-    _WM_reverb_listen_posy = 16.875f;
 
     WM_Initialized = 0;
 
-    if (_WM_Global_ErrorS != NULL) free(_WM_Global_ErrorS);
+    _WM_Global_ErrorS = NULL;
 
     _WM_BufferFile = _WM_BufferFileImpl;
     _WM_FreeBufferFile = _WM_FreeBufferFileImpl;
@@ -2144,7 +2584,7 @@ WM_SYMBOL char * WildMidi_GetLyric (midi * handle) {
     struct _mdi *mdi = (struct _mdi *) handle;
     char * lyric = NULL;
 
-    if (!WM_Initialized) {
+    if (!WM_ContextCount) {
         _WM_GLOBAL_ERROR(WM_ERR_NOT_INIT, NULL, 0);
         return (NULL);
     }
@@ -2171,10 +2611,7 @@ WM_SYMBOL char * WildMidi_GetError (void) {
  */
 WM_SYMBOL void WildMidi_ClearError (void) {
     _WM_Global_ErrorI = 0;
-    if (_WM_Global_ErrorS != NULL) {
-        free(_WM_Global_ErrorS);
-        _WM_Global_ErrorS = NULL;
-    }
+    _WM_Global_ErrorS = NULL;
     return;
 }
 
@@ -29,6 +29,52 @@
 #include <stdlib.h>
 #include "wm_error.h"
 
+#if defined(WM_RTCHECK)
+/* the checks below call the real ones */
+#undef malloc
+#undef calloc
+#undef realloc
+
+#if defined(_MSC_VER)
+#define WM_THREAD_LOCAL __declspec(thread)
+#else
+#define WM_THREAD_LOCAL __thread
+#endif
+
+static WM_THREAD_LOCAL int rt_depth = 0;
+
+void _WM_rt_enter(void) {
+    rt_depth++;
+}
+
+void _WM_rt_leave(void) {
+    rt_depth--;
+}
+
+static void rt_check(const char *what, size_t size, const char *func) {
+    if (rt_depth) {
+        fprintf(stderr, "\rWildMIDI: %s(%lu) in %s while rendering\n",
+                what, (unsigned long) size, func);
+        abort();
+    }
+}
+
+void *_WM_rt_malloc(size_t size, const char *func) {
+    rt_check("malloc", size, func);
+    return (malloc(size));
+}
+
+void *_WM_rt_calloc(size_t nmemb, size_t size, const char *func) {
+    rt_check("calloc", nmemb * size, func);
+    return (calloc(nmemb, size));
+}
+
+void *_WM_rt_realloc(void *ptr, size_t size, const char *func) {
+    rt_check("realloc", size, func);
+    return (realloc(ptr, size));
+}
+#endif
+
 void _WM_DEBUG_MSG(const char * wmfmt, ...) {
     va_list args;
     fprintf(stderr, "\r");
@@ -64,22 +110,24 @@ static const char *errors[WM_ERR_MAX+1] = {
 
 #define MAX_ERROR_LEN 255
 
+/*
+ * The message lives in a static buffer, so that setting an error never
+ * allocates, not even while rendering.
+ */
+static char error_buffer[MAX_ERROR_LEN+1];
+
 char * _WM_Global_ErrorS = NULL;
 int _WM_Global_ErrorI = 0;
 
 void _WM_GLOBAL_ERROR_INTERNAL(const char *func, int lne, int wmerno, const char *wmfor, int error) {
 
-    char *errorstring;
+    char *errorstring = error_buffer;
 
     if (wmerno < 0 || wmerno >= WM_ERR_MAX)
          wmerno = WM_ERR_MAX; /* set to invalid error code. */
 
     _WM_Global_ErrorI = wmerno;
 
-    if (_WM_Global_ErrorS != NULL) free(_WM_Global_ErrorS);
-
-    errorstring = (char *) malloc(MAX_ERROR_LEN+1);
-
     if (error == 0) {
         if (wmfor == NULL) {
             sprintf(errorstring,"Error (%s:%i) %s",
@@ -103,10 +151,9 @@ void _WM_GLOBAL_ERROR_INTERNAL(const char *func, int lne, int wmerno, const char
 }
 
 void _WM_ERROR_NEW(const char * wmfmt, ...) {
-    char *errorstring;
+    char *errorstring = error_buffer;
     va_list args;
     va_start(args, wmfmt);
-    errorstring = (char *) malloc(MAX_ERROR_LEN+1);
     vsprintf(errorstring, wmfmt, args);
     va_end(args);
     errorstring[MAX_ERROR_LEN] = 0;
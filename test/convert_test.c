@@ -0,0 +1,132 @@
+/*
+ * convert_test.c -- Midi Wavetable Processing library
+ *
+ * Copyright (C) WildMIDI Developers 2001-2024
+ *
+ * This file is part of WildMIDI.
+ *
+ * WildMIDI is free software: you can redistribute and/or modify the player
+ * under the terms of the GNU General Public License and you can redistribute
+ * and/or modify the library under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either version 3 of
+ * the licenses, or(at your option) any later version.
+ *
+ * WildMIDI is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License and
+ * the GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License and the
+ * GNU Lesser General Public License along with WildMIDI.  If not,  see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Runs every output converter the cpu supports for each WM_OF_* format
+ * and checks it against a plain reference: integer formats saturate at
+ * 16bit and are then scaled up, float is scaled down and not clamped.
+ */
+
+#include "config.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "wildmidi_lib.h"
+#include "convert.h"
+
+#define MAX_SAMPLES 100
+#define GUARD 16    /* bytes past the end that must be left alone */
+
+static const int32_t test_values[] = {
+    0, 1, -1, 255, -256, 32767, 32768, -32768, -32769, 65535, -65536,
+    1000000, -1000000, INT32_MAX, INT32_MIN, INT32_MAX - 1, INT32_MIN + 1
+};
+
+static const char *format_names[] = { "s16", "s24", "s32", "f32" };
+
+static uint32_t test_seed = 1;
+
+static uint32_t test_rand(void) {
+    test_seed = test_seed * 1103515245 + 12345;
+    return (test_seed >> 8);
+}
+
+static void reference(uint8_t format, int32_t in, uint8_t *out) {
+    int32_t clamped = in;
+    int16_t s16;
+    int32_t s32;
+    float f32;
+
+    if (clamped > 32767) clamped = 32767;
+    if (clamped < -32768) clamped = -32768;
+
+    switch (format) {
+    case WM_OF_S16:
+        s16 = (int16_t) clamped;
+        memcpy(out, &s16, 2);
+        break;
+    case WM_OF_S24:
+        s32 = clamped * 256;
+        memcpy(out, &s32, 4);
+        break;
+    case WM_OF_S32:
+        s32 = clamped * 65536;
+        memcpy(out, &s32, 4);
+        break;
+    default:
+        f32 = (float) in / 32768.0f;
+        memcpy(out, &f32, 4);
+        break;
+    }
+}
+
+int main(void) {
+    _WM_Convert converts[WM_CONVERT_KERNELS];
+    const char *names[WM_CONVERT_KERNELS];
+    int32_t in[MAX_SAMPLES];
+    uint8_t want[MAX_SAMPLES * 4 + GUARD + 4];
+    uint8_t got[MAX_SAMPLES * 4 + GUARD + 4];
+    uint32_t convert_count, size, count, offset, i, k;
+    uint8_t format;
+    int failed = 0;
+
+    for (format = WM_OF_S16; format <= WM_OF_F32; format++) {
+        size = _WM_sample_size(format);
+        convert_count = _WM_convert_all(format, converts, names);
+        for (k = 0; k < convert_count; k++) {
+            for (count = 0; count <= MAX_SAMPLES; count++) {
+                /* the output needs no alignment, so try every offset */
+                offset = count & 3;
+
+                for (i = 0; i < count; i++) {
+                    if (i < sizeof(test_values) / sizeof(test_values[0])) {
+                        in[i] = test_values[(i + count) % (sizeof(test_values) / sizeof(test_values[0]))];
+                    } else if (i & 1) {
+                        in[i] = (int32_t) (test_rand() % 131072) - 65536;
+                    } else {
+                        in[i] = (int32_t) ((test_rand() << 8) ^ test_rand());
+                    }
+                }
+
+                memset(want, 0xa5, sizeof(want));
+                for (i = 0; i < count; i++) {
+                    reference(format, in[i], &want[offset + i * size]);
+                }
+                memset(got, 0xa5, sizeof(got));
+                converts[k](in, (int8_t *) &got[offset], count);
+
+                if (memcmp(want, got, sizeof(want)) != 0) {
+                    fprintf(stderr, "%s %s differs from the reference: %u samples\n",
+                            format_names[format], names[k], count);
+                    failed = 1;
+                }
+            }
+            printf("%s %s: checked\n", format_names[format], names[k]);
+        }
+    }
+
+    return (failed);
+}
@@ -0,0 +1,170 @@
+/*
+ * resample_test.c -- Midi Wavetable Processing library
+ *
+ * Copyright (C) WildMIDI Developers 2001-2024
+ *
+ * This file is part of WildMIDI.
+ *
+ * WildMIDI is free software: you can redistribute and/or modify the player
+ * under the terms of the GNU General Public License and you can redistribute
+ * and/or modify the library under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either version 3 of
+ * the licenses, or(at your option) any later version.
+ *
+ * WildMIDI is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License and
+ * the GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License and the
+ * GNU Lesser General Public License along with WildMIDI.  If not,  see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Runs every linear resampler the cpu supports over the same notes as the
+ * plain C one, for each mix bus, stereo and mono, and checks they leave
+ * the notes in the same state and mix the same: exactly on the int buses,
+ * and to within rounding on the float ones, where fused multiply-adds are
+ * allowed.
+ */
+
+#include "config.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+#include "lock.h"
+#include "reverb.h"
+#include "sample.h"
+#include "wildmidi_lib.h"
+#include "internal_midi.h"
+#include "resample.h"
+
+#define DATA_LENGTH 65536
+#define MAX_FRAMES 600
+#define GUARD 16    /* frames past the end that must be left alone */
+#define FLOAT_TOLERANCE 1.0e-5f
+
+static const uint32_t test_incs[] = { 1, 511, 1024, 1500, 4096, 33333 };
+static const uint32_t test_counts[] = { 0, 1, 2, 3, 4, 5, 7, 8, 9, 15, 16, 17, 31, 100, 257, MAX_FRAMES };
+static const int32_t test_env_incs[] = { 0, 41, 3000, -3000 };
+
+static uint32_t test_seed = 1;
+
+static uint32_t test_rand(void) {
+    test_seed = test_seed * 1103515245 + 12345;
+    return (test_seed >> 8);
+}
+
+/* fills a bus of count samples with something to mix into */
+static void test_fill(uint8_t bus, void *buffer, uint32_t count) {
+    uint32_t i;
+
+    for (i = 0; i < count; i++) {
+        if (bus & WM_BUS_FLOAT) {
+            ((float *) buffer)[i] = (float)(test_rand() % 2097152) / 1048576.0f - 1.0f;
+        } else {
+            ((int32_t *) buffer)[i] = (int32_t)(test_rand() % 2097152) - 1048576;
+        }
+    }
+}
+
+static int test_same(uint8_t bus, const void *want, const void *got, uint32_t count) {
+    uint32_t i;
+
+    if (!(bus & WM_BUS_FLOAT)) {
+        return (memcmp(want, got, count * sizeof(int32_t)) == 0);
+    }
+    for (i = 0; i < count; i++) {
+        if (fabsf(((const float *) want)[i] - ((const float *) got)[i]) > FLOAT_TOLERANCE) {
+            return (0);
+        }
+    }
+    return (1);
+}
+
+static int test_bus(uint8_t bus, const char *bus_name, struct _sample *sample, void *want, void *got) {
+    _WM_Resample kernels[WM_RESAMPLE_KERNELS];
+    const char *names[WM_RESAMPLE_KERNELS];
+    uint32_t kernel_count, k, i, j, e;
+    struct _note base, want_note, got_note;
+    uint32_t samples = (MAX_FRAMES + GUARD) * 2;
+    int failed = 0;
+
+    kernel_count = _WM_resample_linear_all(bus, kernels, names);
+    for (k = 1; k < kernel_count; k++) {
+        for (i = 0; i < sizeof(test_incs) / sizeof(test_incs[0]); i++) {
+            for (j = 0; j < sizeof(test_counts) / sizeof(test_counts[0]); j++) {
+                for (e = 0; e < sizeof(test_env_incs) / sizeof(test_env_incs[0]); e++) {
+                    memset(&base, 0, sizeof(base));
+                    base.sample = sample;
+                    base.sample_pos = test_rand() % (30000 << FPBITS);
+                    base.sample_inc = test_incs[i];
+                    base.env_level = 2097152;
+                    base.env_inc = test_env_incs[e];
+                    base.left_mix_volume = test_rand() % 2048;
+                    base.right_mix_volume = test_rand() % 2048;
+                    base.left_gain = (float)base.left_mix_volume / 1024.0f;
+                    base.right_gain = (float)base.right_mix_volume / 1024.0f;
+                    base.mono_mix_volume = (base.left_mix_volume + base.right_mix_volume) / 2;
+                    base.mono_gain = (base.left_gain + base.right_gain) * 0.5f;
+
+                    test_fill(bus, want, samples);
+                    memcpy(got, want, samples * 4);
+                    want_note = base;
+                    got_note = base;
+
+                    kernels[0](&want_note, want, test_counts[j]);
+                    kernels[k](&got_note, got, test_counts[j]);
+
+                    if (!test_same(bus, want, got, samples)
+                            || (want_note.sample_pos != got_note.sample_pos)
+                            || (want_note.env_level != got_note.env_level)) {
+                        fprintf(stderr, "%s %s differs from c: inc %u, %u frames, env_inc %d\n",
+                                bus_name, names[k], test_incs[i], test_counts[j], test_env_incs[e]);
+                        failed = 1;
+                    }
+                }
+            }
+        }
+        printf("%s %s: checked\n", bus_name, names[k]);
+    }
+    return (failed);
+}
+
+int main(void) {
+    int16_t *data;
+    void *want, *got;
+    struct _sample sample;
+    uint32_t i;
+    int failed = 0;
+
+    data = malloc(DATA_LENGTH * sizeof(int16_t));
+    want = malloc((MAX_FRAMES + GUARD) * 2 * 4);
+    got = malloc((MAX_FRAMES + GUARD) * 2 * 4);
+    if ((data == NULL) || (want == NULL) || (got == NULL)) {
+        fprintf(stderr, "out of memory\n");
+        return (1);
+    }
+    for (i = 0; i < DATA_LENGTH; i++) {
+        data[i] = (int16_t)test_rand();
+    }
+    memset(&sample, 0, sizeof(sample));
+    sample.data = data;
+    sample.data_length = DATA_LENGTH << FPBITS;
+
+    failed |= test_bus(WM_BUS_INT, "int", &sample, want, got);
+    failed |= test_bus(WM_BUS_FLOAT, "float", &sample, want, got);
+    failed |= test_bus(WM_BUS_INT | WM_BUS_MONO, "int mono", &sample, want, got);
+    failed |= test_bus(WM_BUS_FLOAT | WM_BUS_MONO, "float mono", &sample, want, got);
+
+    free(data);
+    free(want);
+    free(got);
+    return (failed);
+}